@@ -1,9 +1,14 @@
 ; boot/boot.s - Multiboot Compliant Bootloader
+MBOOT_MAGIC     equ 0x1BADB002
+MBOOT_PAGE_ALIGN equ 1 << 0    ; Load modules on page boundaries
+MBOOT_MEM_INFO  equ 1 << 1     ; Ask for mem_lower/mem_upper and the memory map
+MBOOT_FLAGS     equ MBOOT_PAGE_ALIGN | MBOOT_MEM_INFO
+
 section .multiboot
 align 4
-    dd 0x1BADB002              ; Magic number
-    dd 0x00                    ; Flags
-    dd -(0x1BADB002 + 0x00)    ; Checksum
+    dd MBOOT_MAGIC             ; Magic number
+    dd MBOOT_FLAGS             ; Flags
+    dd -(MBOOT_MAGIC + MBOOT_FLAGS) ; Checksum
 
 section .text
 global _start
@@ -13,7 +18,9 @@ _start:
     ; Set up stack
     mov esp, stack_top
     
-    ; Call kernel main
+    ; Call kernel main(magic, multiboot info)
+    push ebx
+    push eax
     call kernel_main
     
     ; If kernel returns, halt
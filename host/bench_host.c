@@ -0,0 +1,273 @@
+// host/bench_host.c - Scheduler and file system benchmarks on Linux
+//
+// Runs the kernel's process.c, ml_scheduler.c, mlfq.c and fs.c as a
+// plain x86-64 program with host/stubs.c standing in for the hardware,
+// so the same code can be driven with far more processes and files than
+// the VM holds and profiled with perf. Processes are created and scheduled but
+// never run: context_switch() returns at once and the driver carries on
+// as whichever process was picked.
+//
+// Every timed loop is its own noinline function, so `perf record` and
+// `perf stat` attribute samples to one phase. -r repeats each loop to
+// collect enough samples at small sizes.
+//
+// Output lines are "HOST <metric> <n> <ns/op> <cycles/op>".
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "kernel/process.h"
+#include "kernel/ml_scheduler.h"
+#include "kernel/fs.h"
+#include "kernel/kmalloc.h"
+#include "kernel/klog.h"
+#include "kernel/cpu.h"
+
+#define HOST_ITERATIONS 1000000
+
+void string_init(void);
+void host_init(void);
+
+static const int default_processes[] = { 10000, 100000, 1000000 };
+static const int default_files[] = { 1000, 10000, 30000 };
+
+static int repeat = 1;
+static int iterations = HOST_ITERATIONS;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+typedef struct {
+    uint64_t ns;
+    uint64_t cycles;
+} host_timer_t;
+
+static void timer_start(host_timer_t* t) {
+    t->ns = now_ns();
+    t->cycles = rdtsc();
+}
+
+static void report(const char* metric, int n, host_timer_t* t, uint64_t ops) {
+    uint64_t cycles = rdtsc() - t->cycles;
+    uint64_t ns = now_ns() - t->ns;
+    if (ops == 0) ops = 1;
+    printf("HOST %-20s %8d %10.1f %10.1f\n", metric, n,
+           (double)ns / ops, (double)cycles / ops);
+    fflush(stdout);
+}
+
+static void idle_entry(void) {
+}
+
+// --- Processes ---
+
+static __attribute__((noinline)) void loop_create(int n) {
+    char name[32];
+    for (int i = 0; i < n; i++) {
+        snprintf(name, sizeof(name), "p%d", i);
+        if (process_create(idle_entry, name, i % 3) < 0) {
+            fprintf(stderr, "process_create failed at %d\n", i);
+            exit(1);
+        }
+    }
+}
+
+static __attribute__((noinline)) void loop_yield(int count) {
+    for (int i = 0; i < count; i++) {
+        process_tick();
+        process_yield();
+    }
+}
+
+static __attribute__((noinline)) void loop_exit(void) {
+    while (get_current_process()->pid != 0) {
+        process_exit();
+    }
+}
+
+static void bench_processes(int n) {
+    host_timer_t t;
+    
+    for (int r = 0; r < repeat; r++) {
+        timer_start(&t);
+        loop_create(n);
+        report("process_create", n, &t, n);
+        
+        set_scheduler_type(SCHEDULER_ROUND_ROBIN);
+        timer_start(&t);
+        loop_yield(iterations);
+        report("rr_yield", n, &t, iterations);
+        
+        timer_start(&t);
+        set_scheduler_type(SCHEDULER_ML_BASED);
+        report("ml_requeue", n, &t, n);
+        
+        timer_start(&t);
+        loop_yield(iterations);
+        report("ml_yield", n, &t, iterations);
+        
+        timer_start(&t);
+        set_scheduler_type(SCHEDULER_MLFQ);
+        report("mlfq_requeue", n, &t, n);
+        
+        timer_start(&t);
+        loop_yield(iterations);
+        report("mlfq_yield", n, &t, iterations);
+        
+        timer_start(&t);
+        loop_exit();
+        report("process_exit", n, &t, n);
+        set_scheduler_type(SCHEDULER_ROUND_ROBIN);
+    }
+}
+
+// --- Files ---
+
+static void file_name(char* name, int i) {
+    snprintf(name, MAX_FILENAME, "file%07d.dat", i);
+}
+
+static __attribute__((noinline)) void loop_fs_create(int n) {
+    char name[MAX_FILENAME];
+    for (int i = 0; i < n; i++) {
+        file_name(name, i);
+        if (fs_create(name) < 0) {
+            fprintf(stderr, "fs_create failed at %d\n", i);
+            exit(1);
+        }
+    }
+}
+
+// Lookups in a scattered order so probe runs are not walked in sequence
+static __attribute__((noinline)) int loop_fs_lookup(int n, int count) {
+    char name[MAX_FILENAME];
+    int misses = 0;
+    uint32_t x = 1;
+    for (int i = 0; i < count; i++) {
+        x = x * 1103515245u + 12345u;
+        file_name(name, (x >> 8) % n);
+        if (!fs_exists(name)) misses++;
+    }
+    return misses;
+}
+
+static __attribute__((noinline)) void loop_fs_write(int n) {
+    char name[MAX_FILENAME];
+    for (int i = 0; i < n; i++) {
+        file_name(name, i);
+        fs_write(name, "hosted benchmark payload");
+    }
+}
+
+static __attribute__((noinline)) int loop_fs_read(int n) {
+    char name[MAX_FILENAME];
+    char buf[64];
+    int errors = 0;
+    for (int i = 0; i < n; i++) {
+        file_name(name, i);
+        if (fs_read(name, buf, sizeof(buf)) < 0) errors++;
+    }
+    return errors;
+}
+
+static __attribute__((noinline)) void loop_fs_delete(int n) {
+    char name[MAX_FILENAME];
+    for (int i = 0; i < n; i++) {
+        file_name(name, i);
+        fs_delete(name);
+    }
+}
+
+static void bench_files(int n) {
+    host_timer_t t;
+    
+    for (int r = 0; r < repeat; r++) {
+        timer_start(&t);
+        loop_fs_create(n);
+        report("fs_create", n, &t, n);
+        
+        timer_start(&t);
+        int misses = loop_fs_lookup(n, iterations);
+        report("fs_lookup", n, &t, iterations);
+        
+        timer_start(&t);
+        loop_fs_write(n);
+        report("fs_write", n, &t, n);
+        
+        timer_start(&t);
+        int errors = loop_fs_read(n);
+        report("fs_read", n, &t, n);
+        
+        timer_start(&t);
+        fs_sync();
+        report("fs_sync", n, &t, n);
+        
+        timer_start(&t);
+        loop_fs_delete(n);
+        report("fs_delete", n, &t, n);
+        
+        if (misses || errors) {
+            fprintf(stderr, "fs: %d lookup misses, %d read errors\n", misses, errors);
+            exit(1);
+        }
+    }
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "usage: %s [-p processes] [-f files] [-i iterations] [-r repeat]\n"
+                    "  -p 0 or -f 0 skips that part, sizes default to a sweep\n"
+                    "  processes up to %d, files up to %d\n",
+            prog, PROCESS_LIMIT - 1, MAX_FILES - 2);
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    int processes = -1;
+    int files = -1;
+    
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc || argv[i][0] != '-') usage(argv[0]);
+        int value = atoi(argv[++i]);
+        switch (argv[i - 1][1]) {
+            case 'p': processes = value; break;
+            case 'f': files = value; break;
+            case 'i': iterations = value; break;
+            case 'r': repeat = value; break;
+            default: usage(argv[0]);
+        }
+    }
+    // fs_init() creates two files of its own, the idle process takes slot 0
+    if (processes >= PROCESS_LIMIT || files > MAX_FILES - 2 ||
+        iterations <= 0 || repeat <= 0) {
+        usage(argv[0]);
+    }
+    
+    string_init();
+    klog_init();
+    host_init();
+    kmalloc_init();
+    process_init();
+    ml_scheduler_init();
+    fs_init();
+    
+    printf("HOST %-20s %8s %10s %10s\n", "metric", "n", "ns/op", "cycles/op");
+    
+    if (processes > 0) {
+        bench_processes(processes);
+    } else if (processes < 0) {
+        for (unsigned i = 0; i < sizeof(default_processes) / sizeof(default_processes[0]); i++) {
+            if (default_processes[i] < PROCESS_LIMIT) bench_processes(default_processes[i]);
+        }
+    }
+    
+    if (files > 0) {
+        bench_files(files);
+    } else if (files < 0) {
+        for (unsigned i = 0; i < sizeof(default_files) / sizeof(default_files[0]); i++) {
+            if (default_files[i] <= MAX_FILES - 2) bench_files(default_files[i]);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,179 @@
+// host/stubs.c - Console, memory and CPU stand-ins for the hosted build
+//
+// Everything the scheduler and file system call outside their own
+// sources is replaced here. Memory comes from mmap below 2 GB, so the
+// kernel's uint32_t addresses still hold a full pointer on x86-64.
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <time.h>
+#include "kernel/kernel.h"
+#include "kernel/cpu.h"
+#include "kernel/pmm.h"
+#include "kernel/paging.h"
+#include "kernel/kstack.h"
+#include "kernel/timer.h"
+#include "kernel/trace.h"
+#include "kernel/ata.h"
+#include "kernel/smp.h"
+
+pmm_stats_t pmm_stats;
+paging_stats_t paging_stats;
+kstack_stats_t kstack_stats;
+uint32_t kernel_page_dir = 1;
+volatile uint32_t timer_ticks;
+
+// One CPU; this_cpu() is always cpus[0]
+cpu_t cpus[MAX_CPUS];
+int cpu_count = 1;
+int cpus_online = 1;
+
+// Tracing stays off, trace_event() only reads the flag
+trace_record_t trace_ring[TRACE_RECORDS];
+uint32_t trace_head;
+int trace_enabled;
+
+// Every process gets the same stack. It is written once by
+// context_init_stack() and never run on.
+static uint32_t shared_stack;
+
+void print_string(const char* str) {
+    fputs(str, stdout);
+}
+
+void print_char(char c) {
+    putchar(c);
+}
+
+void print_int(int num) {
+    printf("%d", num);
+}
+
+void print_uint(unsigned int value) {
+    printf("%u", value);
+}
+
+void print_col(unsigned int value, int width) {
+    printf("%-*u", width, value);
+}
+
+void print_float(float num) {
+    printf("%.2f", num);
+}
+
+void kernel_panic(const char* message) {
+    fflush(stdout);
+    fprintf(stderr, "KERNEL PANIC: %s\n", message);
+    abort();
+}
+
+static void* map_low(uint32_t bytes) {
+    void* p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+// Size the tables the way process_init() and bcache_init() do on a
+// machine with enough RAM for PROCESS_LIMIT processes
+void host_init(void) {
+    pmm_stats.total_pages = (uint32_t)PROCESS_LIMIT * (PROCESS_RAM_PER_SLOT / PAGE_SIZE);
+    pmm_stats.free_pages = pmm_stats.total_pages;
+    
+    void* stack = map_low(STACK_SIZE);
+    if (stack == NULL) kernel_panic("no low memory for the shared stack");
+    shared_stack = (uint32_t)(uintptr_t)stack + STACK_SIZE;
+    cpus[0].online = 1;
+}
+
+uint32_t pmm_alloc_pages(uint32_t count) {
+    void* p = map_low(count * PAGE_SIZE);
+    if (p == NULL) return 0;
+    pmm_stats.free_pages -= count;
+    pmm_stats.allocs++;
+    return (uint32_t)(uintptr_t)p;
+}
+
+uint32_t pmm_alloc_page(void) {
+    return pmm_alloc_pages(1);
+}
+
+void pmm_free_pages(uint32_t addr, uint32_t count) {
+    munmap((void*)(uintptr_t)addr, count * PAGE_SIZE);
+    pmm_stats.free_pages += count;
+    pmm_stats.frees++;
+}
+
+uint32_t pmm_page_limit(void) {
+    return pmm_stats.total_pages;
+}
+
+void pmm_print_stats(void) {
+    printf("Host pages: %u mapped, %u allocs, %u frees\n",
+           pmm_stats.total_pages - pmm_stats.free_pages, pmm_stats.allocs, pmm_stats.frees);
+}
+
+// Processes all share the kernel's address space
+uint32_t paging_create_dir(void) {
+    return kernel_page_dir;
+}
+
+uint32_t paging_clone_dir(uint32_t parent) {
+    return parent;
+}
+
+void paging_destroy_dir(uint32_t dir) {
+    (void)dir;
+}
+
+void paging_switch(uint32_t dir) {
+    (void)dir;
+}
+
+uint32_t kstack_alloc(void) {
+    kstack_stats.allocs++;
+    return shared_stack;
+}
+
+void kstack_free(uint32_t stack_top) {
+    (void)stack_top;
+    kstack_stats.frees++;
+}
+
+// Nothing to switch to: the caller carries on as the next process, which
+// is exactly the path a benchmark wants to time
+void context_switch(uint32_t* old_esp, uint32_t new_esp) {
+    (void)old_esp;
+    (void)new_esp;
+}
+
+void smp_send_resched(int cpu) {
+    (void)cpu;
+}
+
+uint32_t timer_get_frequency(void) {
+    return TIMER_HZ;
+}
+
+static uint64_t host_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// Measured once against CLOCK_MONOTONIC, like the PIT calibration
+uint32_t timer_tsc_khz(void) {
+    static uint32_t khz;
+    if (khz == 0) {
+        uint64_t start_ns = host_ns();
+        uint64_t start = rdtsc();
+        while (host_ns() - start_ns < 10000000) {
+        }
+        khz = (uint32_t)((rdtsc() - start) * 1000000 / (host_ns() - start_ns));
+    }
+    return khz;
+}
+
+// No disk, fs_init() falls back to the RAM disk
+block_device_t* ata_init(void) {
+    return NULL;
+}
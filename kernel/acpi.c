@@ -0,0 +1,107 @@
+// kernel/acpi.c - Find the processors and APICs listed in the ACPI MADT
+#include "acpi.h"
+#include "kernel.h"
+#include "klog.h"
+#include <stddef.h>
+
+#define BIOS_ROM_START 0xE0000
+#define BIOS_ROM_END 0x100000
+
+// BIOS data area word holding the EBDA segment. A pointer variable, not a
+// constant, so GCC does not take the low address for a null dereference.
+static const uint16_t* volatile bios_ebda_segment = (const uint16_t*)0x40E;
+
+static int bytes_equal(const void* a, const char* b, int n) {
+    const char* p = (const char*)a;
+    for (int i = 0; i < n; i++) {
+        if (p[i] != b[i]) return 0;
+    }
+    return 1;
+}
+
+// Every ACPI structure sums to zero over its length
+static int checksum_ok(const void* data, uint32_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < len; i++) {
+        sum += p[i];
+    }
+    return sum == 0;
+}
+
+// The RSDP sits on a 16-byte boundary in the first KB of the EBDA or in
+// the BIOS ROM area
+static const acpi_rsdp_t* scan_rsdp(uint32_t start, uint32_t end) {
+    for (uint32_t addr = start & ~15u; addr + sizeof(acpi_rsdp_t) <= end; addr += 16) {
+        const acpi_rsdp_t* rsdp = (const acpi_rsdp_t*)addr;
+        if (bytes_equal(rsdp->signature, "RSD PTR ", 8) && checksum_ok(rsdp, sizeof(*rsdp))) {
+            return rsdp;
+        }
+    }
+    return NULL;
+}
+
+static const acpi_rsdp_t* find_rsdp(void) {
+    uint32_t ebda = (uint32_t)*bios_ebda_segment << 4;
+    const acpi_rsdp_t* rsdp = NULL;
+    
+    if (ebda >= 0x80000 && ebda < 0xA0000) {
+        rsdp = scan_rsdp(ebda, ebda + 1024);
+    }
+    return rsdp ? rsdp : scan_rsdp(BIOS_ROM_START, BIOS_ROM_END);
+}
+
+// Reads physical memory directly, so call it before paging is on. Returns
+// 0 and fills info, or -1 if there is no usable MADT.
+int acpi_find_madt(acpi_madt_info_t* info) {
+    const acpi_rsdp_t* rsdp = find_rsdp();
+    if (rsdp == NULL) {
+        klog(KLOG_WARN, KLOG_KERNEL, "ACPI: no RSDP");
+        return -1;
+    }
+    
+    // The RSDT lists 32-bit table addresses after its header. It is in
+    // every ACPI version, so the XSDT of version 2 is not needed.
+    const acpi_header_t* rsdt = (const acpi_header_t*)rsdp->rsdt;
+    if (!bytes_equal(rsdt->signature, "RSDT", 4) || !checksum_ok(rsdt, rsdt->length)) {
+        klog(KLOG_WARN, KLOG_KERNEL, "ACPI: bad RSDT at 0x%x", rsdp->rsdt);
+        return -1;
+    }
+    
+    const uint32_t* tables = (const uint32_t*)(rsdt + 1);
+    uint32_t count = (rsdt->length - sizeof(acpi_header_t)) / 4;
+    const acpi_madt_t* madt = NULL;
+    for (uint32_t i = 0; i < count && madt == NULL; i++) {
+        const acpi_header_t* table = (const acpi_header_t*)tables[i];
+        if (bytes_equal(table->signature, "APIC", 4) && checksum_ok(table, table->length)) {
+            madt = (const acpi_madt_t*)table;
+        }
+    }
+    if (madt == NULL) {
+        klog(KLOG_WARN, KLOG_KERNEL, "ACPI: no MADT");
+        return -1;
+    }
+    
+    info->lapic_addr = madt->lapic_addr;
+    info->ioapic_addr = 0;
+    info->cpu_count = 0;
+    
+    // Variable-length entries, each starting with its type and length
+    const uint8_t* p = (const uint8_t*)(madt + 1);
+    const uint8_t* end = (const uint8_t*)madt + madt->header.length;
+    while (p + 2 <= end && p[1] >= 2) {
+        if (p[0] == MADT_LOCAL_APIC && p[1] >= 8) {
+            uint32_t flags = *(const uint32_t*)(p + 4);
+            if ((flags & MADT_LAPIC_ENABLED) && info->cpu_count < ACPI_MAX_CPUS) {
+                info->apic_ids[info->cpu_count++] = p[3];
+            }
+        } else if (p[0] == MADT_IO_APIC && p[1] >= 12 && info->ioapic_addr == 0) {
+            info->ioapic_addr = *(const uint32_t*)(p + 4);
+        }
+        p += p[1];
+    }
+    
+    klog(KLOG_INFO, KLOG_KERNEL, "ACPI: %d CPUs, local APIC 0x%x, I/O APIC 0x%x",
+         info->cpu_count, info->lapic_addr, info->ioapic_addr);
+    return info->cpu_count > 0 ? 0 : -1;
+}
@@ -0,0 +1,51 @@
+#ifndef ACPI_H
+#define ACPI_H
+
+#include <stdint.h>
+
+// Root System Description Pointer, found by scanning the BIOS areas
+typedef struct {
+    char signature[8];      // "RSD PTR "
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt;
+} __attribute__((packed)) acpi_rsdp_t;
+
+// Common header of every system description table
+typedef struct {
+    char signature[4];
+    uint32_t length;        // including this header
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_header_t;
+
+// Multiple APIC Description Table, signature "APIC"
+typedef struct {
+    acpi_header_t header;
+    uint32_t lapic_addr;
+    uint32_t flags;
+} __attribute__((packed)) acpi_madt_t;
+
+#define MADT_LOCAL_APIC 0
+#define MADT_IO_APIC 1
+#define MADT_LAPIC_ENABLED 0x1
+
+// What the kernel needs from the MADT
+#define ACPI_MAX_CPUS 32
+
+typedef struct {
+    uint32_t lapic_addr;
+    uint32_t ioapic_addr;   // 0 if none was listed
+    int cpu_count;
+    uint8_t apic_ids[ACPI_MAX_CPUS];
+} acpi_madt_info_t;
+
+int acpi_find_madt(acpi_madt_info_t* info);
+
+#endif
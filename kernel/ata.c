@@ -0,0 +1,441 @@
+// kernel/ata.c - ATA driver for the primary master: polled PIO and bus-master DMA
+#include "ata.h"
+#include "cpu.h"
+#include "klog.h"
+#include "kernel.h"
+#include "pci.h"
+#include "idt.h"
+#include "process.h"
+
+static block_device_t ata_device = { "ata0", 0, 0, 0, 0, 0 };
+static block_device_t ata_dma = { "ata0-dma", 0, 0, 0, 0, 0 };
+
+static uint16_t bm_base;
+static ata_prd_t prd_table[ATA_PRD_ENTRIES] __attribute__((aligned(ATA_PRD_ENTRIES * 8)));
+
+// Pending requests sorted by block, and the batch the drive is working on
+static blk_request_t* queue_head;
+static blk_request_t* active[ATA_PRD_ENTRIES];
+static wait_queue_t dma_waiters;
+static int active_count;
+static uint32_t head_position;
+
+ata_dma_stats_t ata_dma_stats;
+
+// Reading the alternate status register four times gives the drive its
+// 400ns to update the status after a command or drive select
+static void ata_delay(void) {
+    for (int i = 0; i < 4; i++) {
+        inb(ATA_PRIMARY_CTRL);
+    }
+}
+
+static int ata_wait_ready(void) {
+    for (int i = 0; i < ATA_TIMEOUT; i++) {
+        if (!(inb(ATA_PRIMARY_IO + ATA_REG_STATUS) & ATA_SR_BSY)) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int ata_wait_drq(void) {
+    for (int i = 0; i < ATA_TIMEOUT; i++) {
+        uint8_t status = inb(ATA_PRIMARY_IO + ATA_REG_STATUS);
+        if (status & ATA_SR_BSY) {
+            continue;
+        }
+        if (status & (ATA_SR_ERR | ATA_SR_DF)) {
+            return -1;
+        }
+        if (status & ATA_SR_DRQ) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int ata_command(uint32_t lba, uint32_t count, uint8_t command) {
+    if (ata_wait_ready() < 0) {
+        return -1;
+    }
+    
+    outb(ATA_PRIMARY_IO + ATA_REG_DRIVE, 0xE0 | ((lba >> 24) & 0x0F));
+    ata_delay();
+    outb(ATA_PRIMARY_IO + ATA_REG_COUNT, count);
+    outb(ATA_PRIMARY_IO + ATA_REG_LBA_LOW, lba);
+    outb(ATA_PRIMARY_IO + ATA_REG_LBA_MID, lba >> 8);
+    outb(ATA_PRIMARY_IO + ATA_REG_LBA_HIGH, lba >> 16);
+    outb(ATA_PRIMARY_IO + ATA_REG_COMMAND, command);
+    ata_delay();
+    return 0;
+}
+
+static int ata_read(uint32_t block, uint32_t count, void* buf) {
+    uint8_t* p = buf;
+    
+    while (count > 0) {
+        uint32_t n = count > ATA_MAX_SECTORS ? ATA_MAX_SECTORS : count;
+        
+        if (ata_command(block, n, ATA_CMD_READ_PIO) < 0) {
+            goto error;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            if (ata_wait_drq() < 0) {
+                goto error;
+            }
+            insw(ATA_PRIMARY_IO + ATA_REG_DATA, p, BLOCK_SIZE / 2);
+            p += BLOCK_SIZE;
+        }
+        block += n;
+        count -= n;
+    }
+    return 0;
+
+error:
+    klog(KLOG_ERR, KLOG_DISK, "ata0: read error at block %u (error %x)",
+         block, inb(ATA_PRIMARY_IO + ATA_REG_ERROR));
+    return -1;
+}
+
+static int ata_write(uint32_t block, uint32_t count, const void* buf) {
+    const uint8_t* p = buf;
+    
+    while (count > 0) {
+        uint32_t n = count > ATA_MAX_SECTORS ? ATA_MAX_SECTORS : count;
+        
+        if (ata_command(block, n, ATA_CMD_WRITE_PIO) < 0) {
+            goto error;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            if (ata_wait_drq() < 0) {
+                goto error;
+            }
+            outsw(ATA_PRIMARY_IO + ATA_REG_DATA, p, BLOCK_SIZE / 2);
+            p += BLOCK_SIZE;
+        }
+        block += n;
+        count -= n;
+    }
+    
+    outb(ATA_PRIMARY_IO + ATA_REG_COMMAND, ATA_CMD_CACHE_FLUSH);
+    ata_delay();
+    if (ata_wait_ready() < 0) {
+        goto error;
+    }
+    return 0;
+
+error:
+    klog(KLOG_ERR, KLOG_DISK, "ata0: write error at block %u (error %x)",
+         block, inb(ATA_PRIMARY_IO + ATA_REG_ERROR));
+    return -1;
+}
+
+// Bus-master DMA
+
+static int prd_count(uint32_t addr, uint32_t len) {
+    int n = 0;
+    while (len > 0) {
+        uint32_t chunk = 0x10000 - (addr & 0xFFFF);
+        if (chunk > len) chunk = len;
+        addr += chunk;
+        len -= chunk;
+        n++;
+    }
+    return n;
+}
+
+// Split a buffer at 64 KB boundaries. Memory is identity mapped, so the
+// virtual address is the physical one.
+static int prd_fill(ata_prd_t* prd, uint32_t addr, uint32_t len) {
+    int n = 0;
+    while (len > 0) {
+        uint32_t chunk = 0x10000 - (addr & 0xFFFF);
+        if (chunk > len) chunk = len;
+        prd[n].addr = addr;
+        prd[n].bytes = chunk & 0xFFFF;
+        prd[n].flags = 0;
+        addr += chunk;
+        len -= chunk;
+        n++;
+    }
+    return n;
+}
+
+static void elevator_insert(blk_request_t* req) {
+    blk_request_t** link = &queue_head;
+    while (*link && (*link)->block <= req->block) {
+        link = &(*link)->next;
+    }
+    req->next = *link;
+    *link = req;
+}
+
+// C-LOOK: the first request at or past the head, wrapping to the lowest
+static blk_request_t** elevator_pick(void) {
+    blk_request_t** link = &queue_head;
+    while (*link && (*link)->block < head_position) {
+        link = &(*link)->next;
+    }
+    return *link ? link : &queue_head;
+}
+
+// Start the next batch if the drive is idle. Queued requests that continue
+// the picked one on disk in the same direction ride along as extra PRDs.
+static void dma_start_next(void) {
+    if (active_count > 0 || !queue_head) {
+        return;
+    }
+    
+    blk_request_t** link = elevator_pick();
+    blk_request_t* first = *link;
+    uint32_t sectors = 0;
+    int prds = 0;
+    
+    while (*link) {
+        blk_request_t* req = *link;
+        uint32_t bytes = req->count * BLOCK_SIZE;
+        
+        if (req->write != first->write || req->block != first->block + sectors ||
+            sectors + req->count > ATA_DMA_MAX_SECTORS ||
+            prds + prd_count((uint32_t)req->buf, bytes) > ATA_PRD_ENTRIES) {
+            break;
+        }
+        
+        prds += prd_fill(&prd_table[prds], (uint32_t)req->buf, bytes);
+        sectors += req->count;
+        active[active_count++] = req;
+        *link = req->next;
+    }
+    prd_table[prds - 1].flags = PRD_EOT;
+    
+    head_position = first->block + sectors;
+    ata_dma_stats.commands++;
+    ata_dma_stats.merged += active_count - 1;
+    ata_dma_stats.sectors += sectors;
+    
+    outb(bm_base + BM_COMMAND, 0);
+    outb(bm_base + BM_STATUS, BM_STATUS_IRQ | BM_STATUS_ERR);
+    outl(bm_base + BM_PRDT, (uint32_t)prd_table);
+    outb(bm_base + BM_COMMAND, first->write ? 0 : BM_CMD_READ);
+    
+    if (ata_command(first->block, sectors, first->write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA) < 0) {
+        ata_dma_stats.errors++;
+        for (int i = 0; i < active_count; i++) {
+            active[i]->status = -1;
+            active[i]->done = 1;
+        }
+        active_count = 0;
+        return;
+    }
+    outb(bm_base + BM_COMMAND, (first->write ? 0 : BM_CMD_READ) | BM_CMD_START);
+}
+
+// Finish the active batch if the controller has raised its interrupt
+static void dma_complete(void) {
+    uint8_t bm_status = inb(bm_base + BM_STATUS);
+    if (!(bm_status & BM_STATUS_IRQ)) {
+        return;
+    }
+    
+    outb(bm_base + BM_COMMAND, 0);
+    uint8_t status = inb(ATA_PRIMARY_IO + ATA_REG_STATUS);
+    outb(bm_base + BM_STATUS, BM_STATUS_IRQ | BM_STATUS_ERR);
+    
+    int error = (bm_status & BM_STATUS_ERR) || (status & (ATA_SR_ERR | ATA_SR_DF));
+    if (error) {
+        ata_dma_stats.errors++;
+        klog(KLOG_ERR, KLOG_DISK, "ata0: DMA error at block %u", active[0]->block);
+    }
+    
+    for (int i = 0; i < active_count; i++) {
+        active[i]->status = error ? -1 : 0;
+        active[i]->done = 1;
+    }
+    active_count = 0;
+    
+    dma_start_next();
+    // After the restart, which fails its whole batch at once on error
+    process_wake_all(&dma_waiters);
+}
+
+static void ata_irq_handler(interrupt_frame_t* frame) {
+    (void)frame;
+    
+    if (active_count > 0) {
+        dma_complete();
+    } else {
+        // Reading the status acknowledges INTRQ after PIO commands
+        inb(ATA_PRIMARY_IO + ATA_REG_STATUS);
+    }
+}
+
+static int ata_submit(blk_request_t* req) {
+    if (req->count == 0 || req->count > ATA_DMA_MAX_SECTORS ||
+        prd_count((uint32_t)req->buf, req->count * BLOCK_SIZE) > ATA_PRD_ENTRIES) {
+        return -1;
+    }
+    
+    req->done = 0;
+    req->status = 0;
+    
+    uint32_t flags = irq_save();
+    ata_dma_stats.requests++;
+    elevator_insert(req);
+    dma_start_next();
+    irq_restore(flags);
+    return 0;
+}
+
+// A process sleeps on dma_waiters until the completion interrupt. The
+// idle context cannot block and yields instead, and before interrupts
+// are enabled at boot the controller is polled.
+static int ata_wait(blk_request_t* req) {
+    while (!req->done) {
+        if (!interrupts_enabled()) {
+            dma_complete();
+        } else if (process_can_block()) {
+            uint32_t flags = irq_save();
+            if (!req->done) {
+                process_block(&dma_waiters);
+            }
+            irq_restore(flags);
+        } else {
+            process_yield();
+        }
+    }
+    return req->status;
+}
+
+static int ata_dma_transfer(uint32_t block, uint32_t count, void* buf, int write) {
+    blk_request_t req;
+    uint8_t* p = buf;
+    
+    while (count > 0) {
+        uint32_t n = count > ATA_DMA_MAX_SECTORS ? ATA_DMA_MAX_SECTORS : count;
+        
+        req.block = block;
+        req.count = n;
+        req.buf = p;
+        req.write = write;
+        if (ata_submit(&req) < 0 || ata_wait(&req) < 0) {
+            return -1;
+        }
+        block += n;
+        count -= n;
+        p += n * BLOCK_SIZE;
+    }
+    return 0;
+}
+
+static int ata_dma_read(uint32_t block, uint32_t count, void* buf) {
+    return ata_dma_transfer(block, count, buf, 0);
+}
+
+static int ata_dma_write(uint32_t block, uint32_t count, const void* buf) {
+    return ata_dma_transfer(block, count, (void*)buf, 1);
+}
+
+static void ata_dma_init(void) {
+    pci_device_t ide;
+    
+    if (pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &ide) < 0) {
+        return;
+    }
+    // Prog IF bit 7: bus mastering supported
+    if (!(ide.prog_if & 0x80)) {
+        return;
+    }
+    
+    bm_base = pci_config_read(&ide, PCI_BAR4) & 0xFFFC;
+    if (bm_base == 0) {
+        return;
+    }
+    pci_enable_bus_master(&ide);
+    
+    ata_dma.blocks = ata_device.blocks;
+    ata_dma.read = ata_dma_read;
+    ata_dma.write = ata_dma_write;
+    ata_dma.submit = ata_submit;
+    ata_dma.wait = ata_wait;
+    
+    klog(KLOG_INFO, KLOG_DISK, "ata0: bus-master DMA at %x (PCI %x:%x)",
+         bm_base, ide.vendor, ide.device);
+}
+
+block_device_t* ata_pio_device(void) {
+    return ata_device.read ? &ata_device : 0;
+}
+
+block_device_t* ata_dma_device(void) {
+    return ata_dma.read ? &ata_dma : 0;
+}
+
+void ata_print_stats(void) {
+    if (!ata_dma.read) {
+        return;
+    }
+    print_string("DMA requests: ");
+    print_int(ata_dma_stats.requests);
+    print_string(", commands: ");
+    print_int(ata_dma_stats.commands);
+    print_string(", merged: ");
+    print_int(ata_dma_stats.merged);
+    print_string(", sectors: ");
+    print_int(ata_dma_stats.sectors);
+    print_string(", errors: ");
+    print_int(ata_dma_stats.errors);
+    print_string("\n");
+}
+
+block_device_t* ata_init(void) {
+    uint16_t identify[256];
+    
+    // Polled IDENTIFY, keep the drive from raising IRQ14 until the
+    // handler is installed
+    outb(ATA_PRIMARY_CTRL, ATA_CTRL_NIEN);
+    
+    // A floating bus reads all ones
+    if (inb(ATA_PRIMARY_IO + ATA_REG_STATUS) == 0xFF) {
+        return 0;
+    }
+    
+    outb(ATA_PRIMARY_IO + ATA_REG_DRIVE, 0xA0);
+    ata_delay();
+    outb(ATA_PRIMARY_IO + ATA_REG_COUNT, 0);
+    outb(ATA_PRIMARY_IO + ATA_REG_LBA_LOW, 0);
+    outb(ATA_PRIMARY_IO + ATA_REG_LBA_MID, 0);
+    outb(ATA_PRIMARY_IO + ATA_REG_LBA_HIGH, 0);
+    outb(ATA_PRIMARY_IO + ATA_REG_COMMAND, ATA_CMD_IDENTIFY);
+    ata_delay();
+    
+    if (inb(ATA_PRIMARY_IO + ATA_REG_STATUS) == 0 || ata_wait_ready() < 0) {
+        return 0;
+    }
+    
+    // ATAPI and SATA devices set the LBA mid/high signature
+    if (inb(ATA_PRIMARY_IO + ATA_REG_LBA_MID) || inb(ATA_PRIMARY_IO + ATA_REG_LBA_HIGH)) {
+        return 0;
+    }
+    
+    if (ata_wait_drq() < 0) {
+        return 0;
+    }
+    insw(ATA_PRIMARY_IO + ATA_REG_DATA, identify, 256);
+    
+    // Words 60-61: sectors addressable with LBA28
+    ata_device.blocks = identify[60] | ((uint32_t)identify[61] << 16);
+    ata_device.read = ata_read;
+    ata_device.write = ata_write;
+    
+    klog(KLOG_INFO, KLOG_DISK, "ata0: %u sectors (%u KB)",
+         ata_device.blocks, ata_device.blocks / 2);
+    
+    // DMA completion is signalled on IRQ14; PIO keeps polling and the
+    // handler just acknowledges it
+    outb(ATA_PRIMARY_CTRL, 0);
+    irq_register_handler(IRQ_ATA_PRIMARY, ata_irq_handler);
+    
+    ata_dma_init();
+    return ata_dma.read ? &ata_dma : &ata_device;
+}
@@ -0,0 +1,76 @@
+#ifndef ATA_H
+#define ATA_H
+
+#include <stdint.h>
+#include "blockdev.h"
+
+// Primary bus, legacy ports
+#define ATA_PRIMARY_IO 0x1F0
+#define ATA_PRIMARY_CTRL 0x3F6
+
+#define ATA_REG_DATA 0
+#define ATA_REG_ERROR 1
+#define ATA_REG_COUNT 2
+#define ATA_REG_LBA_LOW 3
+#define ATA_REG_LBA_MID 4
+#define ATA_REG_LBA_HIGH 5
+#define ATA_REG_DRIVE 6
+#define ATA_REG_STATUS 7
+#define ATA_REG_COMMAND 7
+
+#define ATA_SR_ERR 0x01
+#define ATA_SR_DRQ 0x08
+#define ATA_SR_DF 0x20
+#define ATA_SR_BSY 0x80
+
+#define ATA_CMD_READ_PIO 0x20
+#define ATA_CMD_WRITE_PIO 0x30
+#define ATA_CMD_READ_DMA 0xC8
+#define ATA_CMD_WRITE_DMA 0xCA
+#define ATA_CMD_CACHE_FLUSH 0xE7
+#define ATA_CMD_IDENTIFY 0xEC
+
+#define ATA_CTRL_NIEN 0x02
+#define ATA_MAX_SECTORS 255
+#define ATA_TIMEOUT 1000000
+
+// PIIX bus-master IDE registers, primary channel at BAR4
+#define BM_COMMAND 0
+#define BM_STATUS 2
+#define BM_PRDT 4
+#define BM_CMD_START 0x01
+#define BM_CMD_READ 0x08 // device to memory
+#define BM_STATUS_ACTIVE 0x01
+#define BM_STATUS_ERR 0x02
+#define BM_STATUS_IRQ 0x04
+
+// Physical Region Descriptor: one contiguous buffer that must not cross
+// a 64 KB boundary. bytes == 0 means 64 KB.
+typedef struct {
+    uint32_t addr;
+    uint16_t bytes;
+    uint16_t flags;
+} __attribute__((packed)) ata_prd_t;
+
+#define PRD_EOT 0x8000
+#define ATA_PRD_ENTRIES 64
+#define ATA_DMA_MAX_SECTORS 128 // 64 KB per command
+
+typedef struct {
+    uint32_t requests;
+    uint32_t commands; // requests after merging
+    uint32_t merged;
+    uint32_t sectors;
+    uint32_t errors;
+} ata_dma_stats_t;
+
+extern ata_dma_stats_t ata_dma_stats;
+
+// Master drive on the primary bus, or NULL when none answers IDENTIFY.
+// Returns the DMA device when a bus-master IDE controller is found.
+block_device_t* ata_init(void);
+block_device_t* ata_pio_device(void);
+block_device_t* ata_dma_device(void);
+void ata_print_stats(void);
+
+#endif
@@ -0,0 +1,291 @@
+// kernel/bcache.c - Hashed LRU write-back cache in front of the block device
+#include "bcache.h"
+#include "kernel.h"
+#include "string.h"
+#include "cpu.h"
+#include "klog.h"
+#include "timer.h"
+#include "kmalloc.h"
+#include "pmm.h"
+
+static bcache_buf_t** buffers;
+static uint32_t buffer_count;
+static bcache_buf_t** hash_table;
+static uint32_t hash_mask;
+static bcache_buf_t* lru_head;
+static bcache_buf_t* lru_tail;
+static block_device_t* device;
+static uint8_t sync_staging[BCACHE_SYNC_RUN][BLOCK_SIZE];
+static blk_request_t* sync_requests;
+static bcache_buf_t** sync_dirty;
+
+bcache_stats_t bcache_stats;
+
+static int device_read(uint32_t block, void* buf) {
+    uint64_t start = rdtsc();
+    int ret = device->read(block, 1, buf);
+    bcache_stats.read_cycles += rdtsc() - start;
+    bcache_stats.blocks_read++;
+    return ret;
+}
+
+static int device_write(uint32_t block, uint32_t count, const void* buf) {
+    uint64_t start = rdtsc();
+    int ret = device->write(block, count, buf);
+    bcache_stats.write_cycles += rdtsc() - start;
+    bcache_stats.blocks_written += count;
+    return ret;
+}
+
+static void lru_unlink(bcache_buf_t* b) {
+    if (b->lru_prev) b->lru_prev->lru_next = b->lru_next;
+    else lru_head = b->lru_next;
+    if (b->lru_next) b->lru_next->lru_prev = b->lru_prev;
+    else lru_tail = b->lru_prev;
+}
+
+static void lru_push_front(bcache_buf_t* b) {
+    b->lru_prev = 0;
+    b->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = b;
+    else lru_tail = b;
+    lru_head = b;
+}
+
+static void hash_remove(bcache_buf_t* b) {
+    bcache_buf_t** link = &hash_table[b->block & hash_mask];
+    while (*link != b) {
+        link = &(*link)->hash_next;
+    }
+    *link = b->hash_next;
+}
+
+// Buffer for block, moved to the front of the LRU list. On a miss the
+// least recently used buffer is written back if dirty and reused; fill
+// says whether its old contents must be read from the device.
+static bcache_buf_t* bcache_get(uint32_t block, int fill) {
+    bcache_buf_t* b = hash_table[block & hash_mask];
+    while (b && b->block != block) {
+        b = b->hash_next;
+    }
+    
+    if (b) {
+        bcache_stats.hits++;
+        lru_unlink(b);
+        lru_push_front(b);
+        return b;
+    }
+    
+    bcache_stats.misses++;
+    b = lru_tail;
+    if (b->valid) {
+        if (b->dirty) {
+            if (device_write(b->block, 1, b->data) < 0) {
+                return 0;
+            }
+            bcache_stats.writebacks++;
+            b->dirty = 0;
+        }
+        hash_remove(b);
+        b->valid = 0;
+        bcache_stats.evictions++;
+    }
+    
+    if (fill && device_read(block, b->data) < 0) {
+        return 0;
+    }
+    
+    b->block = block;
+    b->valid = 1;
+    b->hash_next = hash_table[block & hash_mask];
+    hash_table[block & hash_mask] = b;
+    lru_unlink(b);
+    lru_push_front(b);
+    return b;
+}
+
+void bcache_init(block_device_t* dev) {
+    device = dev;
+    memset(&bcache_stats, 0, sizeof(bcache_stats));
+    
+    // Allocated once; a remount reuses the same buffers
+    if (!buffers) {
+        kmem_cache_t* buf_cache = kmem_cache_create("bcache_buf", sizeof(bcache_buf_t));
+        
+        buffer_count = pmm_stats.free_pages / BCACHE_RAM_SHARE * (PAGE_SIZE / BLOCK_SIZE);
+        if (buffer_count < BCACHE_MIN_BUFFERS) buffer_count = BCACHE_MIN_BUFFERS;
+        if (buffer_count > BCACHE_MAX_BUFFERS) buffer_count = BCACHE_MAX_BUFFERS;
+        
+        // Two buckets per buffer, rounded up to a power of two
+        uint32_t buckets = 1;
+        while (buckets < buffer_count * 2) {
+            buckets <<= 1;
+        }
+        hash_mask = buckets - 1;
+        
+        buffers = kmalloc(buffer_count * sizeof(bcache_buf_t*));
+        hash_table = kmalloc(buckets * sizeof(bcache_buf_t*));
+        sync_dirty = kmalloc(buffer_count * sizeof(bcache_buf_t*));
+        sync_requests = kmalloc(buffer_count * sizeof(blk_request_t));
+        for (uint32_t i = 0; i < buffer_count; i++) {
+            buffers[i] = kmem_cache_alloc(buf_cache);
+        }
+    }
+    
+    memset(hash_table, 0, (hash_mask + 1) * sizeof(bcache_buf_t*));
+    lru_head = lru_tail = 0;
+    for (uint32_t i = 0; i < buffer_count; i++) {
+        memset(buffers[i], 0, sizeof(bcache_buf_t));
+        lru_push_front(buffers[i]);
+    }
+    
+    klog(KLOG_INFO, KLOG_DISK, "Buffer cache: %u blocks on %s", buffer_count, dev->name);
+}
+
+block_device_t* bcache_device(void) {
+    return device;
+}
+
+int bcache_read(uint32_t block, uint32_t offset, void* buf, uint32_t len) {
+    bcache_buf_t* b = bcache_get(block, 1);
+    if (b) {
+        memcpy(buf, b->data + offset, len);
+    }
+    return b ? 0 : -1;
+}
+
+// A NULL buf zero-fills. Whole-block writes skip reading the old contents.
+int bcache_write(uint32_t block, uint32_t offset, const void* buf, uint32_t len) {
+    bcache_buf_t* b = bcache_get(block, offset != 0 || len != BLOCK_SIZE);
+    if (b) {
+        if (buf) {
+            memcpy(b->data + offset, buf, len);
+        } else {
+            memset(b->data + offset, 0, len);
+        }
+        b->dirty = 1;
+    }
+    return b ? 0 : -1;
+}
+
+// Queue every dirty buffer at once and let the device's elevator order
+// and merge them
+static int bcache_sync_async(bcache_buf_t** dirty, int count) {
+    int ret = 0;
+    uint64_t start = rdtsc();
+    
+    for (int i = 0; i < count; i++) {
+        sync_requests[i].block = dirty[i]->block;
+        sync_requests[i].count = 1;
+        sync_requests[i].buf = dirty[i]->data;
+        sync_requests[i].write = 1;
+        if (device->submit(&sync_requests[i]) < 0) {
+            sync_requests[i].status = -1;
+            sync_requests[i].done = 1;
+        }
+    }
+    
+    for (int i = 0; i < count; i++) {
+        if (device->wait(&sync_requests[i]) < 0) {
+            ret = -1;
+        } else {
+            dirty[i]->dirty = 0;
+        }
+    }
+    
+    bcache_stats.write_cycles += rdtsc() - start;
+    bcache_stats.blocks_written += count;
+    return ret;
+}
+
+// Write every dirty buffer in block order, batching runs of consecutive
+// blocks into one device call
+int bcache_sync(void) {
+    bcache_buf_t** dirty = sync_dirty;
+    int count = 0;
+    int ret = 0;
+    
+    for (uint32_t i = 0; i < buffer_count; i++) {
+        if (buffers[i]->valid && buffers[i]->dirty) {
+            int j = count++;
+            while (j > 0 && dirty[j - 1]->block > buffers[i]->block) {
+                dirty[j] = dirty[j - 1];
+                j--;
+            }
+            dirty[j] = buffers[i];
+        }
+    }
+    
+    if (device->submit) {
+        ret = bcache_sync_async(dirty, count);
+    }
+    
+    for (int i = 0; !device->submit && i < count; ) {
+        int run = 1;
+        while (i + run < count && run < BCACHE_SYNC_RUN &&
+               dirty[i + run]->block == dirty[i]->block + run) {
+            run++;
+        }
+        
+        for (int j = 0; j < run; j++) {
+            memcpy(sync_staging[j], dirty[i + j]->data, BLOCK_SIZE);
+        }
+        if (device_write(dirty[i]->block, run, sync_staging) < 0) {
+            ret = -1;
+        } else {
+            for (int j = 0; j < run; j++) {
+                dirty[i + j]->dirty = 0;
+            }
+        }
+        i += run;
+    }
+    
+    klog(KLOG_DEBUG, KLOG_DISK, "Synced %d blocks", count);
+    return ret;
+}
+
+static void print_rate(const char* label, uint32_t blocks, uint64_t cycles) {
+    print_string(label);
+    print_int(blocks);
+    print_string(" blocks");
+    if (blocks > 0 && cycles > 0) {
+        uint32_t per_block = (uint32_t)div64_u32(cycles, blocks);
+        print_string(", ");
+        print_int(per_block);
+        print_string(" cycles/block, ");
+        print_int((uint32_t)div64_u32((uint64_t)timer_tsc_khz() * 1000, per_block ? per_block : 1));
+        print_string(" blocks/s");
+    }
+    print_string("\n");
+}
+
+void bcache_print_stats(void) {
+    uint32_t lookups = bcache_stats.hits + bcache_stats.misses;
+    int dirty = 0;
+    
+    for (uint32_t i = 0; i < buffer_count; i++) {
+        dirty += buffers[i]->valid && buffers[i]->dirty;
+    }
+    
+    print_string("\n=== Buffer Cache (");
+    print_string(device->name);
+    print_string(") ===\n");
+    print_string("Buffers: ");
+    print_int(buffer_count);
+    print_string(", dirty: ");
+    print_int(dirty);
+    print_string("\nHits: ");
+    print_int(bcache_stats.hits);
+    print_string(", misses: ");
+    print_int(bcache_stats.misses);
+    print_string(", hit rate: ");
+    print_int(lookups ? (uint32_t)div64_u32((uint64_t)bcache_stats.hits * 100, lookups) : 0);
+    print_string("%\nEvictions: ");
+    print_int(bcache_stats.evictions);
+    print_string(", write-backs: ");
+    print_int(bcache_stats.writebacks);
+    print_string("\n");
+    print_rate("Device reads: ", bcache_stats.blocks_read, bcache_stats.read_cycles);
+    print_rate("Device writes: ", bcache_stats.blocks_written, bcache_stats.write_cycles);
+    print_string("=============================\n");
+}
@@ -0,0 +1,45 @@
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include <stdint.h>
+#include "blockdev.h"
+
+// The cache takes 1/BCACHE_RAM_SHARE of free RAM, within these bounds
+#define BCACHE_RAM_SHARE 32
+#define BCACHE_MIN_BUFFERS 128
+#define BCACHE_MAX_BUFFERS 8192
+#define BCACHE_SYNC_RUN 16 // contiguous dirty blocks written per device call
+
+typedef struct bcache_buf {
+    uint32_t block;
+    uint8_t valid;
+    uint8_t dirty;
+    struct bcache_buf* hash_next;
+    struct bcache_buf* lru_prev; // toward most recently used
+    struct bcache_buf* lru_next; // toward least recently used
+    uint8_t data[BLOCK_SIZE];
+} bcache_buf_t;
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t writebacks;
+    uint32_t blocks_read;
+    uint32_t blocks_written;
+    uint64_t read_cycles;
+    uint64_t write_cycles;
+} bcache_stats_t;
+
+extern bcache_stats_t bcache_stats;
+
+// The cache has no lock of its own. Its only user is fs.c, which calls
+// it with fs_lock held, or from fs_init() before anything else runs.
+void bcache_init(block_device_t* dev);
+block_device_t* bcache_device(void);
+int bcache_read(uint32_t block, uint32_t offset, void* buf, uint32_t len);
+int bcache_write(uint32_t block, uint32_t offset, const void* buf, uint32_t len);
+int bcache_sync(void);
+void bcache_print_stats(void);
+
+#endif
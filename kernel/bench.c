@@ -0,0 +1,1200 @@
+// kernel/bench.c - Kernel microbenchmarks
+#include "bench.h"
+#include "kernel.h"
+#include "process.h"
+#include "string.h"
+#include "cpu.h"
+#include "runqueue.h"
+#include "ml_scheduler.h"
+#include "timer.h"
+#include "fs.h"
+#include "ata.h"
+#include "kmalloc.h"
+#include "pmm.h"
+#include "kstack.h"
+#include "paging.h"
+#include "trace.h"
+#include "timer_wheel.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "mutex.h"
+
+// Machine-readable "BENCH <metric> <value>" lines, printed only while
+// the headless suite runs and checked by tools/bench_check.py
+static int bench_emit_results = 0;
+
+static void bench_result(const char* metric, uint32_t value) {
+    if (!bench_emit_results) return;
+    print_string("BENCH ");
+    print_string(metric);
+    print_string(" ");
+    print_int(value);
+    print_string("\n");
+}
+
+static void bench_result_n(const char* metric, uint32_t n, uint32_t value) {
+    if (!bench_emit_results) return;
+    print_string("BENCH ");
+    print_string(metric);
+    print_int(n);
+    print_string(" ");
+    print_int(value);
+    print_string("\n");
+}
+
+static uint8_t bench_stack[STACK_SIZE] __attribute__((aligned(16)));
+static uint32_t bench_main_esp;
+static uint32_t bench_thread_esp;
+
+// Partner context for the ping-pong switch benchmark
+static void bench_switch_partner(void) {
+    while (1) {
+        context_switch(&bench_thread_esp, bench_main_esp);
+    }
+}
+
+void bench_context_switch(void) {
+    bench_thread_esp = context_init_stack((uint32_t)&bench_stack[STACK_SIZE],
+                                          bench_switch_partner);
+    
+    // Warm up caches and the branch predictor
+    for (int i = 0; i < 100; i++) {
+        context_switch(&bench_main_esp, bench_thread_esp);
+    }
+    
+    uint64_t start = rdtsc();
+    for (int i = 0; i < BENCH_SWITCH_ITERATIONS; i++) {
+        context_switch(&bench_main_esp, bench_thread_esp);
+    }
+    uint32_t cycles = (uint32_t)(rdtsc() - start);
+    
+    // Each iteration switches there and back again
+    print_string("[BENCH] context switch: ");
+    print_int(cycles / (2 * BENCH_SWITCH_ITERATIONS));
+    print_string(" cycles/yield\n");
+    bench_result("switch", cycles / (2 * BENCH_SWITCH_ITERATIONS));
+}
+
+// Synthetic PCBs, never scheduled, used to fill a private run queue
+static pcb_t bench_pcbs[BENCH_RQ_MAX_PROCESSES];
+static runqueue_t bench_rq;
+
+void bench_runqueue(void) {
+    print_string("[BENCH] run queue pick-next + requeue:\n");
+    
+    for (int n = 16; n <= BENCH_RQ_MAX_PROCESSES; n *= 4) {
+        rq_init(&bench_rq);
+        for (int i = 0; i < n; i++) {
+            bench_pcbs[i].pid = i + 1;
+            bench_pcbs[i].priority = 1 + (i % 4);
+            rq_enqueue(&bench_rq, &bench_pcbs[i]);
+        }
+        
+        // One scheduling round: take the best process and put it back
+        uint64_t start = rdtsc();
+        for (int i = 0; i < BENCH_RQ_ITERATIONS; i++) {
+            pcb_t* next = rq_pick_next(&bench_rq);
+            rq_dequeue(&bench_rq, next);
+            rq_enqueue(&bench_rq, next);
+        }
+        uint32_t cycles = (uint32_t)(rdtsc() - start);
+        
+        print_string("  ");
+        print_int(n);
+        print_string(" processes: ");
+        print_int(cycles / BENCH_RQ_ITERATIONS);
+        print_string(" cycles/pick\n");
+    }
+}
+
+static pcb_t* bench_heap_nodes[BENCH_RQ_MAX_PROCESSES];
+static ml_heap_t bench_heap;
+
+void bench_ml_schedule(void) {
+    print_string("[BENCH] ML heap pick-next + requeue:\n");
+    
+    for (int n = 16; n <= BENCH_RQ_MAX_PROCESSES; n *= 4) {
+        ml_heap_init(&bench_heap, bench_heap_nodes, BENCH_RQ_MAX_PROCESSES);
+        for (int i = 0; i < n; i++) {
+            bench_pcbs[i].pid = i + 1;
+            bench_pcbs[i].predicted_burst = 4 + (i % 5);
+            bench_pcbs[i].priority_score = 1.0f / bench_pcbs[i].predicted_burst;
+            ml_heap_push(&bench_heap, &bench_pcbs[i]);
+        }
+        
+        uint64_t start = rdtsc();
+        for (int i = 0; i < BENCH_RQ_ITERATIONS; i++) {
+            pcb_t* next = ml_heap_top(&bench_heap);
+            ml_heap_remove(&bench_heap, next);
+            ml_heap_push(&bench_heap, next);
+        }
+        uint32_t cycles = (uint32_t)(rdtsc() - start);
+        
+        print_string("  ");
+        print_int(n);
+        print_string(" processes: ");
+        print_int(cycles / BENCH_RQ_ITERATIONS);
+        print_string(" cycles/decision\n");
+        bench_result_n("ml_decision_", n, cycles / BENCH_RQ_ITERATIONS);
+    }
+}
+
+// Cycles to whole units per second using the calibrated TSC
+static uint32_t bench_per_second(uint32_t units, uint32_t cycles) {
+    if (cycles == 0) return 0;
+    return (uint32_t)div64_u32((uint64_t)units * timer_tsc_khz() * 1000, cycles);
+}
+
+void bench_console(void) {
+    static const char line[] =
+        "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-+*/.\n";
+    uint32_t chars = (sizeof(line) - 1) * BENCH_CONSOLE_LINES;
+    
+    // Every line scrolls the screen once the cursor reaches the bottom
+    uint64_t start = rdtsc();
+    for (int i = 0; i < BENCH_CONSOLE_LINES; i++) {
+        print_string(line);
+    }
+    uint32_t cycles = (uint32_t)(rdtsc() - start);
+    
+    print_string("[BENCH] console: ");
+    print_int(cycles / chars);
+    print_string(" cycles/char, ");
+    print_int(bench_per_second(chars, cycles));
+    print_string(" chars/s\n");
+    bench_result("console_char", cycles / chars);
+}
+
+static uint8_t mem_src[BENCH_MEM_MAX + 64] __attribute__((aligned(64)));
+static uint8_t mem_dst[BENCH_MEM_MAX + 64] __attribute__((aligned(64)));
+static uint32_t mem_seed = 1;
+
+static uint8_t bench_random_byte(void) {
+    mem_seed = mem_seed * 1103515245 + 12345;
+    return (uint8_t)(mem_seed >> 16);
+}
+
+static const size_t selftest_lengths[] = {
+    0, 1, 2, 3, 4, 5, 7, 8, 15, 16, 17, 31, 32, 33, 63, 64, 65,
+    255, 256, 257, 511, 1000, 4095, 4096, 4097
+};
+#define SELFTEST_LENGTHS (sizeof(selftest_lengths) / sizeof(selftest_lengths[0]))
+#define SELFTEST_GUARD 0xEE
+
+// Copy and fill with every head/tail misalignment and check that not a
+// byte outside the target range was touched. Returns failed cases.
+static int selftest_impl(const string_impl_t* impl) {
+    int failures = 0;
+    
+    for (size_t l = 0; l < SELFTEST_LENGTHS; l++) {
+        size_t n = selftest_lengths[l];
+        for (int so = 0; so < 16; so++) {
+            for (int dofs = 0; dofs < 16; dofs++) {
+                for (size_t i = 0; i < n + 48; i++) {
+                    mem_src[i] = bench_random_byte();
+                    mem_dst[i] = SELFTEST_GUARD;
+                }
+                impl->memcpy(mem_dst + dofs, mem_src + so, n);
+                for (size_t i = 0; i < n + 32; i++) {
+                    uint8_t expect = (i < (size_t)dofs || i >= dofs + n)
+                                     ? SELFTEST_GUARD : mem_src[so + i - dofs];
+                    if (mem_dst[i] != expect) {
+                        failures++;
+                        break;
+                    }
+                }
+                
+                for (size_t i = 0; i < n + 48; i++) {
+                    mem_dst[i] = SELFTEST_GUARD;
+                }
+                impl->memset(mem_dst + dofs, 0x5A, n);
+                for (size_t i = 0; i < n + 32; i++) {
+                    uint8_t expect = (i < (size_t)dofs || i >= dofs + n)
+                                     ? SELFTEST_GUARD : 0x5A;
+                    if (mem_dst[i] != expect) {
+                        failures++;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    return failures;
+}
+
+static int selftest_strings(void) {
+    int failures = 0;
+    char* a = (char*)mem_src;
+    char* b = (char*)mem_dst;
+    
+    for (int ofs = 0; ofs < 8; ofs++) {
+        for (size_t n = 0; n < 70; n++) {
+            for (int i = 0; i < 80; i++) a[i] = 'a' + i % 26;
+            a[ofs + n] = '\0';
+            if (strlen(a + ofs) != n) failures++;
+        }
+    }
+    
+    // Equal strings and strings differing at every position, for all
+    // relative alignments of the two operands
+    for (int o1 = 0; o1 < 4; o1++) {
+        for (int o2 = 0; o2 < 4; o2++) {
+            for (int n = 0; n < 40; n++) {
+                for (int diff = -1; diff < n; diff++) {
+                    char* s1 = a + o1;
+                    char* s2 = b + 8 + o2;
+                    for (int i = 0; i < n; i++) s1[i] = s2[i] = 'a' + i % 20;
+                    s1[n] = s2[n] = '\0';
+                    int expect = 0;
+                    if (diff >= 0) {
+                        s2[diff] = 'z' + 1;
+                        expect = -1;
+                    }
+                    int got = strcmp(s1, s2);
+                    if ((got < 0) != (expect < 0) || (got == 0) != (expect == 0)) {
+                        failures++;
+                    }
+                }
+            }
+        }
+    }
+    
+    strcpy(b, "unaligned tail!");
+    if (strcmp(b, "unaligned tail!") != 0) failures++;
+    return failures;
+}
+
+int bench_string_selftest(void) {
+    int total = 0;
+    
+    for (int i = 0; i < STRING_IMPLS; i++) {
+        if (!string_impls[i].available) continue;
+        int failures = selftest_impl(&string_impls[i]);
+        print_string("[TEST] memcpy/memset ");
+        print_string(string_impls[i].name);
+        print_string(failures ? ": FAIL (" : ": PASS (");
+        print_int(failures);
+        print_string(" failures)\n");
+        total += failures;
+    }
+    
+    int failures = selftest_strings();
+    print_string("[TEST] strlen/strcmp/strcpy: ");
+    print_string(failures ? "FAIL (" : "PASS (");
+    print_int(failures);
+    print_string(" failures)\n");
+    
+    return total + failures;
+}
+
+void bench_memory(void) {
+    bench_string_selftest();
+    
+    print_string("[BENCH] memcpy bytes/cycle (active: ");
+    print_string(string_impl_name());
+    print_string(")\n");
+    
+    for (size_t size = 1; size <= BENCH_MEM_MAX; size *= 4) {
+        uint32_t iterations = BENCH_MEM_BYTES / size;
+        
+        print_string("  ");
+        print_int(size);
+        print_string("B:");
+        for (int i = 0; i < STRING_IMPLS; i++) {
+            if (!string_impls[i].available) continue;
+            
+            uint64_t start = rdtsc();
+            for (uint32_t k = 0; k < iterations; k++) {
+                string_impls[i].memcpy(mem_dst, mem_src, size);
+            }
+            uint32_t cycles = (uint32_t)(rdtsc() - start);
+            
+            print_string(" ");
+            print_string(string_impls[i].name);
+            print_string("=");
+            print_float((float)(iterations * size) / (cycles ? cycles : 1));
+        }
+        print_string("\n");
+    }
+}
+
+void bench_fs(void) {
+    const char* name = "bench.dat";
+    uint32_t chunk = BENCH_FS_CHUNK;
+    
+    if(!fs_exists(name) && fs_create(name) < 0) {
+        print_string("[BENCH] fs: could not create bench.dat\n");
+        return;
+    }
+    fs_truncate(name);
+    for (uint32_t i = 0; i < BENCH_FS_BYTES; i++) {
+        mem_src[i] = bench_random_byte();
+    }
+    
+    uint64_t start = rdtsc();
+    for (uint32_t off = 0; off < BENCH_FS_BYTES; off += chunk) {
+        fs_append(name, mem_src + off, chunk);
+    }
+    uint32_t write_cycles = (uint32_t)(rdtsc() - start);
+    
+    start = rdtsc();
+    for (uint32_t off = 0; off < BENCH_FS_BYTES; off += chunk) {
+        fs_read_at(name, off, mem_dst + off, chunk);
+    }
+    uint32_t read_cycles = (uint32_t)(rdtsc() - start);
+    
+    start = rdtsc();
+    for (uint32_t off = 0; off < BENCH_FS_BYTES; off += chunk) {
+        memcpy(mem_dst + off, mem_src + off, chunk);
+    }
+    uint32_t copy_cycles = (uint32_t)(rdtsc() - start);
+    
+    int ok = fs_size(name) == BENCH_FS_BYTES;
+    for (uint32_t off = 0; ok && off < BENCH_FS_BYTES; off += chunk) {
+        fs_read_at(name, off, mem_dst, chunk);
+        for (uint32_t i = 0; i < chunk; i++) {
+            if (mem_dst[i] != mem_src[off + i]) ok = 0;
+        }
+    }
+    fs_delete(name);
+    
+    print_string("[BENCH] fs sequential ");
+    print_int(BENCH_FS_BYTES);
+    print_string(" bytes in ");
+    print_int(chunk);
+    print_string("B chunks (bytes/cycle)\n");
+    print_string("  write=");
+    print_float((float)BENCH_FS_BYTES / (write_cycles ? write_cycles : 1));
+    print_string(" read=");
+    print_float((float)BENCH_FS_BYTES / (read_cycles ? read_cycles : 1));
+    print_string(" memcpy=");
+    print_float((float)BENCH_FS_BYTES / (copy_cycles ? copy_cycles : 1));
+    print_string(ok ? " verify=PASS\n" : " verify=FAIL\n");
+    bench_result("fs_write_kb", write_cycles / (BENCH_FS_BYTES / 1024));
+    bench_result("fs_read_kb", read_cycles / (BENCH_FS_BYTES / 1024));
+    bench_result("fs_verify_errors", !ok);
+}
+
+static void bench_file_name(char* buf, uint32_t n) {
+    const char* hex = "0123456789abcdef";
+    buf[0] = 'b';
+    buf[1] = 'f';
+    for (int i = 0; i < 5; i++) {
+        buf[6 - i] = hex[n & 0xF];
+        n >>= 4;
+    }
+    buf[7] = '\0';
+}
+
+// Create, look up and delete n files; cycles per op should stay flat as n
+// grows since every op is one hash probe
+static void bench_fs_index_run(uint32_t n) {
+    char name[8];
+    uint32_t found = 0;
+    
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < n; i++) {
+        bench_file_name(name, i);
+        fs_create(name);
+    }
+    uint32_t create_cycles = (uint32_t)(rdtsc() - start);
+    
+    start = rdtsc();
+    for (uint32_t i = 0; i < n; i++) {
+        bench_file_name(name, n - 1 - i);
+        found += fs_exists(name);
+    }
+    uint32_t lookup_cycles = (uint32_t)(rdtsc() - start);
+    
+    start = rdtsc();
+    for (uint32_t i = 0; i < n; i++) {
+        bench_file_name(name, i);
+        fs_delete(name);
+    }
+    uint32_t delete_cycles = (uint32_t)(rdtsc() - start);
+    
+    print_string("  N=");
+    print_int(n);
+    print_string(" create=");
+    print_int(create_cycles / n);
+    print_string(" lookup=");
+    print_int(lookup_cycles / n);
+    print_string(" delete=");
+    print_int(delete_cycles / n);
+    print_string(found == n ? " cycles/op\n" : " cycles/op (lookup FAIL)\n");
+    
+    if (n == BENCH_FS_FILES) {
+        bench_result("fs_create", create_cycles / n);
+        bench_result("fs_lookup", lookup_cycles / n);
+        bench_result("fs_lookup_errors", n - found);
+    }
+}
+
+void bench_fs_index(void) {
+    print_string("[BENCH] fs name index, cycles per op\n");
+    for (uint32_t n = 16; n <= BENCH_FS_FILES; n *= 4) {
+        bench_fs_index_run(n);
+    }
+}
+
+static blk_request_t disk_requests[BENCH_DISK_DEPTH];
+
+static uint32_t bench_random_block(uint32_t blocks) {
+    mem_seed = mem_seed * 1103515245 + 12345;
+    return (mem_seed >> 4) % blocks;
+}
+
+static void bench_disk_rate(const char* label, uint32_t blocks, uint32_t cycles) {
+    print_string(label);
+    print_int(cycles ? (uint32_t)div64_u32((uint64_t)blocks * BLOCK_SIZE / 1024 *
+                                           timer_tsc_khz() * 1000, cycles) : 0);
+}
+
+// Read-only, so it is safe to run against the mounted file system's disk
+static void bench_disk_device(block_device_t* dev) {
+    uint64_t start = rdtsc();
+    for (uint32_t b = 0; b < BENCH_DISK_SEQ_BLOCKS; b += BENCH_DISK_SEQ_RUN) {
+        dev->read(b, BENCH_DISK_SEQ_RUN, mem_dst);
+    }
+    uint32_t seq_cycles = (uint32_t)(rdtsc() - start);
+    
+    mem_seed = 1;
+    start = rdtsc();
+    for (uint32_t i = 0; i < BENCH_DISK_RANDOM; i++) {
+        dev->read(bench_random_block(dev->blocks), 1, mem_dst);
+    }
+    uint32_t random_cycles = (uint32_t)(rdtsc() - start);
+    
+    print_string("  ");
+    print_string(dev->name);
+    bench_disk_rate(" seq=", BENCH_DISK_SEQ_BLOCKS, seq_cycles);
+    bench_disk_rate(" random=", BENCH_DISK_RANDOM, random_cycles);
+    
+    // Keep BENCH_DISK_DEPTH reads in flight so the elevator can sort them
+    if (dev->submit) {
+        mem_seed = 1;
+        start = rdtsc();
+        for (uint32_t i = 0; i < BENCH_DISK_RANDOM; i += BENCH_DISK_DEPTH) {
+            for (int r = 0; r < BENCH_DISK_DEPTH; r++) {
+                disk_requests[r].block = bench_random_block(dev->blocks);
+                disk_requests[r].count = 1;
+                disk_requests[r].buf = mem_dst + r * BLOCK_SIZE;
+                disk_requests[r].write = 0;
+                dev->submit(&disk_requests[r]);
+            }
+            for (int r = 0; r < BENCH_DISK_DEPTH; r++) {
+                dev->wait(&disk_requests[r]);
+            }
+        }
+        uint32_t queued_cycles = (uint32_t)(rdtsc() - start);
+        bench_disk_rate(" random-queued=", BENCH_DISK_RANDOM, queued_cycles);
+    }
+    print_string(" KB/s\n");
+}
+
+void bench_disk(void) {
+    block_device_t* pio = ata_pio_device();
+    block_device_t* dma = ata_dma_device();
+    
+    if (!pio) {
+        print_string("[BENCH] disk: no ATA drive\n");
+        return;
+    }
+    
+    print_string("[BENCH] disk reads, ");
+    print_int(BENCH_DISK_SEQ_BLOCKS);
+    print_string(" sequential blocks in ");
+    print_int(BENCH_DISK_SEQ_RUN);
+    print_string("-block requests, ");
+    print_int(BENCH_DISK_RANDOM);
+    print_string(" random blocks\n");
+    
+    bench_disk_device(pio);
+    if (dma) {
+        bench_disk_device(dma);
+    }
+}
+
+static void* alloc_slots[BENCH_ALLOC_OPS];
+
+// Cycles per kmalloc and kfree once the slabs are warm, plus the cost of
+// a cold page allocation
+void bench_alloc(void) {
+    print_string("[BENCH] kmalloc/kfree cycles per op\n");
+    
+    for (uint32_t size = 16; size <= 4096; size *= 4) {
+        // Warm the cache so the loop measures the freelist fast path
+        for (int i = 0; i < BENCH_ALLOC_OPS; i++) alloc_slots[i] = kmalloc(size);
+        for (int i = 0; i < BENCH_ALLOC_OPS; i++) kfree(alloc_slots[i]);
+        
+        uint64_t start = rdtsc();
+        for (int i = 0; i < BENCH_ALLOC_OPS; i++) {
+            alloc_slots[i] = kmalloc(size);
+        }
+        uint32_t alloc_cycles = (uint32_t)(rdtsc() - start);
+        
+        start = rdtsc();
+        for (int i = 0; i < BENCH_ALLOC_OPS; i++) {
+            kfree(alloc_slots[i]);
+        }
+        uint32_t free_cycles = (uint32_t)(rdtsc() - start);
+        
+        print_string("  ");
+        print_int(size);
+        print_string("B: kmalloc=");
+        print_int(alloc_cycles / BENCH_ALLOC_OPS);
+        print_string(" kfree=");
+        print_int(free_cycles / BENCH_ALLOC_OPS);
+        print_string("\n");
+    }
+    
+    uint64_t start = rdtsc();
+    for (int i = 0; i < BENCH_ALLOC_OPS; i++) {
+        alloc_slots[i] = (void*)pmm_alloc_page();
+    }
+    uint32_t page_cycles = (uint32_t)(rdtsc() - start);
+    for (int i = 0; i < BENCH_ALLOC_OPS; i++) {
+        pmm_free_pages((uint32_t)alloc_slots[i], 1);
+    }
+    print_string("  page: pmm_alloc_page=");
+    print_int(page_cycles / BENCH_ALLOC_OPS);
+    print_string("\n");
+}
+
+static volatile uint32_t spawn_exited;
+
+static void bench_spawn_child(void) {
+    __sync_fetch_and_add(&spawn_exited, 1);
+}
+
+// Create and reap batches of short-lived processes. After the first
+// round their PCBs and stacks come back from the slab and stack pool.
+void bench_spawn(void) {
+    uint32_t hits_before = kstack_stats.pool_hits;
+    uint32_t created = 0;
+    uint32_t create_cycles = 0;
+    uint32_t exit_cycles = 0;
+    
+    for (int round = 0; round < BENCH_SPAWN_ROUNDS; round++) {
+        uint32_t batch = 0;
+        spawn_exited = 0;
+        
+        uint64_t start = rdtsc();
+        for (int i = 0; i < BENCH_SPAWN_BATCH; i++) {
+            if (process_create_priority(bench_spawn_child, "spawn", 0, 0) < 0) break;
+            batch++;
+        }
+        create_cycles += (uint32_t)(rdtsc() - start);
+        
+        // Priority 0 runs ahead of everything else, so each yield runs
+        // the batch to completion and reaps it
+        start = rdtsc();
+        while (spawn_exited < batch) {
+            process_yield();
+        }
+        exit_cycles += (uint32_t)(rdtsc() - start);
+        created += batch;
+    }
+    
+    if (created == 0) {
+        print_string("[BENCH] spawn: process table full\n");
+        return;
+    }
+    print_string("[BENCH] spawn: create=");
+    print_int(create_cycles / created);
+    print_string(" run+exit=");
+    print_int(exit_cycles / created);
+    print_string(" cycles/process, ");
+    print_int(kstack_stats.pool_hits - hits_before);
+    print_string("/");
+    print_int(created);
+    print_string(" stacks from pool\n");
+    bench_result("process_create", create_cycles / created);
+    bench_result("process_run_exit", exit_cycles / created);
+}
+
+static volatile uint32_t fault_cycles;
+static volatile uint32_t touch_cycles;
+static volatile int fault_done;
+
+// Runs in its own address space: the first pass faults every page in,
+// the second finds them mapped
+static void bench_fault_child(void) {
+    volatile uint8_t* user = (volatile uint8_t*)USER_BASE;
+    
+    uint64_t start = rdtsc();
+    for (int i = 0; i < BENCH_FAULT_PAGES; i++) {
+        user[i * PAGE_SIZE] = 1;
+    }
+    fault_cycles = (uint32_t)(rdtsc() - start);
+    
+    start = rdtsc();
+    for (int i = 0; i < BENCH_FAULT_PAGES; i++) {
+        user[i * PAGE_SIZE]++;
+    }
+    touch_cycles = (uint32_t)(rdtsc() - start);
+    fault_done = 1;
+}
+
+void bench_paging(void) {
+    fault_done = 0;
+    if (process_create_priority(bench_fault_child, "faults", 0, 0) < 0) {
+        print_string("[BENCH] paging: could not create a process\n");
+        return;
+    }
+    while (!fault_done) {
+        process_yield();
+    }
+    
+    // Reloading the same CR3 flushes the non-global TLB entries
+    uint32_t cr3 = read_cr3();
+    uint64_t start = rdtsc();
+    for (int i = 0; i < BENCH_CR3_RELOADS; i++) {
+        write_cr3(cr3);
+    }
+    uint32_t reload_cycles = (uint32_t)(rdtsc() - start);
+    
+    print_string("[BENCH] paging: demand fault=");
+    print_int(fault_cycles / BENCH_FAULT_PAGES);
+    print_string(" mapped touch=");
+    print_int(touch_cycles / BENCH_FAULT_PAGES);
+    print_string(" CR3 reload=");
+    print_int(reload_cycles / BENCH_CR3_RELOADS);
+    print_string(" cycles\n");
+    paging_print_stats();
+}
+
+static volatile uint32_t clone_exited;
+static volatile uint32_t clone_write_cycles;
+static volatile int clone_done;
+
+// Each child writes one shared page, paying for a single copy
+static void bench_clone_child(void) {
+    volatile uint8_t* user = (volatile uint8_t*)USER_BASE;
+    
+    uint64_t start = rdtsc();
+    user[0] = 2;
+    __sync_fetch_and_add(&clone_write_cycles, (uint32_t)(rdtsc() - start));
+    __sync_fetch_and_add(&clone_exited, 1);
+}
+
+// Grows its own address space and clones workers at each size
+static void bench_clone_parent(void) {
+    volatile uint8_t* user = (volatile uint8_t*)USER_BASE;
+    uint32_t touched = 0;
+    
+    for (uint32_t pages = 1; pages <= BENCH_CLONE_MAX_PAGES; pages *= 4) {
+        for (; touched < pages; touched++) {
+            user[touched * PAGE_SIZE] = 1;
+        }
+        // Take the pages back from the last round's children
+        for (uint32_t i = 0; i < pages; i++) {
+            user[i * PAGE_SIZE] = 1;
+        }
+        
+        clone_exited = 0;
+        clone_write_cycles = 0;
+        uint32_t cloned = 0;
+        
+        uint64_t start = rdtsc();
+        for (int i = 0; i < BENCH_CLONE_CHILDREN; i++) {
+            if (process_clone(bench_clone_child, "clone") < 0) break;
+            cloned++;
+        }
+        uint32_t clone_cycles = (uint32_t)(rdtsc() - start);
+        
+        while (clone_exited < cloned) {
+            process_yield();
+        }
+        if (cloned == 0) {
+            print_string("  clone failed\n");
+            break;
+        }
+        
+        print_string("  ");
+        print_int(pages * 4);
+        print_string(" KB: clone=");
+        print_int(clone_cycles / cloned);
+        print_string(" first write=");
+        print_int(clone_write_cycles / cloned);
+        print_string("\n");
+    }
+    clone_done = 1;
+}
+
+// Clone latency against the parent's resident size. It grows with the
+// number of page tables and entries, not with the bytes mapped.
+void bench_clone(void) {
+    print_string("[BENCH] copy-on-write clone, cycles per child\n");
+    clone_done = 0;
+    if (process_create_priority(bench_clone_parent, "cloner", 0, 0) < 0) {
+        print_string("[BENCH] clone: could not create a process\n");
+        return;
+    }
+    while (!clone_done) {
+        process_yield();
+    }
+}
+
+// Cost of one trace record; the ring is cleared afterwards
+void bench_trace(void) {
+    int was_enabled = trace_enabled;
+    uint32_t flags = local_irq_save();
+    trace_set_enabled(1);
+    
+    uint64_t start = rdtsc();
+    for (int i = 0; i < BENCH_TRACE_EVENTS; i++) {
+        trace_event(TRACE_READY, i, TRACE_REASON_NONE, 0);
+    }
+    uint32_t cycles = (uint32_t)(rdtsc() - start);
+    
+    trace_set_enabled(was_enabled);
+    local_irq_restore(flags);
+    trace_clear();
+    
+    print_string("[BENCH] trace: ");
+    print_int(cycles / BENCH_TRACE_EVENTS);
+    print_string(" cycles/event\n");
+}
+
+static ktimer_t bench_timers[BENCH_TIMER_OPS];
+static volatile int sleepers_done;
+static volatile uint32_t sleep_overshoot;
+
+static void bench_timer_fn(void* arg) {
+    (void)arg;
+}
+
+static void bench_sleeper(void) {
+    for (int i = 0; i < BENCH_SLEEP_ROUNDS; i++) {
+        uint32_t start = timer_ticks;
+        sleep_ticks(BENCH_SLEEP_TICKS);
+        uint32_t flags = irq_save();
+        sleep_overshoot += timer_ticks - start - BENCH_SLEEP_TICKS;
+        sleepers_done += i == BENCH_SLEEP_ROUNDS - 1;
+        irq_restore(flags);
+    }
+}
+
+// Timer wheel add/cancel cost with expiries spread over every level,
+// then sleepers that should all finish in the time one of them sleeps
+void bench_sleep(void) {
+    uint32_t seed = 1;
+    uint32_t flags = irq_save();
+    uint64_t start = rdtsc();
+    for (int i = 0; i < BENCH_TIMER_OPS; i++) {
+        seed = seed * 1103515245u + 12345u;
+        timer_wheel_add(&bench_timers[i], timer_ticks + 1 + (seed >> 8) % WHEEL_MAX_DELAY,
+                        bench_timer_fn, NULL);
+    }
+    uint32_t add_cycles = (uint32_t)(rdtsc() - start);
+    start = rdtsc();
+    for (int i = 0; i < BENCH_TIMER_OPS; i++) {
+        timer_wheel_cancel(&bench_timers[i]);
+    }
+    uint32_t cancel_cycles = (uint32_t)(rdtsc() - start);
+    irq_restore(flags);
+    
+    print_string("[BENCH] timer wheel: add=");
+    print_int(add_cycles / BENCH_TIMER_OPS);
+    print_string(" cancel=");
+    print_int(cancel_cycles / BENCH_TIMER_OPS);
+    print_string(" cycles\n");
+    bench_result("timer_add_cancel", (add_cycles + cancel_cycles) / BENCH_TIMER_OPS);
+    
+    // Sleeping needs the tick, even when run from the boot demo. Not
+    // irq_save(): the kernel lock must not be held across hlt.
+    int was_enabled = interrupts_enabled();
+    interrupts_enable();
+    sleepers_done = 0;
+    sleep_overshoot = 0;
+    int created = 0;
+    for (int i = 0; i < BENCH_SLEEPERS; i++) {
+        if (process_create_priority(bench_sleeper, "sleeper", 1, 0) >= 0) created++;
+    }
+    uint32_t ticks = timer_ticks;
+    while (sleepers_done < created) {
+        process_yield();
+        asm volatile ("hlt");
+    }
+    ticks = timer_ticks - ticks;
+    if (!was_enabled) interrupts_disable();
+    
+    print_string("[BENCH] sleep: ");
+    print_int(created);
+    print_string(" processes x ");
+    print_int(BENCH_SLEEP_ROUNDS);
+    print_string(" sleeps of ");
+    print_int(BENCH_SLEEP_TICKS);
+    print_string(" ticks took ");
+    print_int(ticks);
+    print_string(" ticks, ");
+    print_int(created ? sleep_overshoot / created : 0);
+    print_string(" ticks late per process\n");
+}
+
+static uint32_t spin_per_ms;
+
+// Burn about us microseconds of CPU. Counted in loop iterations rather
+// than TSC time, so time spent preempted is not counted as work done.
+static void bench_spin(uint32_t us) {
+    uint32_t n = (uint32_t)div64_u32((uint64_t)spin_per_ms * us, 1000);
+    for (volatile uint32_t i = 0; i < n; i++) {
+    }
+}
+
+static void bench_spin_calibrate(void) {
+    uint32_t flags = local_irq_save();
+    uint64_t start = rdtsc();
+    spin_per_ms = 1000;
+    bench_spin(100000);
+    uint32_t cycles = (uint32_t)(rdtsc() - start);
+    spin_per_ms = (uint32_t)div64_u32((uint64_t)100000 * timer_tsc_khz(), cycles ? cycles : 1);
+    local_irq_restore(flags);
+}
+
+static uint64_t policy_start;
+static uint64_t policy_wait[3];
+static uint64_t policy_turnaround[3];
+static volatile int policy_done;
+
+// Waiting is time spent ready but not running; turnaround runs from the
+// common start to exit
+static void policy_finish(int type) {
+    uint32_t flags = irq_save();
+    policy_wait[type] += get_current_process()->wait_cycles;
+    policy_turnaround[type] += rdtsc() - policy_start;
+    policy_done++;
+    irq_restore(flags);
+}
+
+static void policy_cpu(void) {
+    bench_spin(BENCH_POLICY_CPU_US);
+    policy_finish(0);
+}
+
+static void policy_io(void) {
+    for (int i = 0; i < BENCH_POLICY_ROUNDS; i++) {
+        bench_spin(BENCH_POLICY_IO_US);
+        sleep_ticks(1);
+    }
+    policy_finish(1);
+}
+
+static void policy_ml(void) {
+    for (int i = 0; i < BENCH_POLICY_ROUNDS; i++) {
+        bench_spin(BENCH_POLICY_ML_US);
+        process_yield();
+    }
+    policy_finish(2);
+}
+
+static uint32_t policy_avg_us(uint64_t cycles, uint32_t count) {
+    return count ? (uint32_t)div64_u32(div64_u32(cycles * 1000, timer_tsc_khz()), count) : 0;
+}
+
+static void bench_policy_run(scheduler_type_t type) {
+    static void (*const entries[3])(void) = { policy_cpu, policy_io, policy_ml };
+    static const char* const names[3] = { "policy_cpu", "policy_io", "policy_ml" };
+    int created[3] = { 0, 0, 0 };
+    
+    set_scheduler_type(type);
+    for (int t = 0; t < 3; t++) {
+        policy_wait[t] = 0;
+        policy_turnaround[t] = 0;
+    }
+    policy_done = 0;
+    policy_start = rdtsc();
+    for (int i = 0; i < BENCH_POLICY_EACH; i++) {
+        for (int t = 0; t < 3; t++) {
+            if (process_create(entries[t], names[t], t) >= 0) created[t]++;
+        }
+    }
+    while (policy_done < created[0] + created[1] + created[2]) {
+        process_yield();
+        asm volatile ("hlt");
+    }
+    
+    uint64_t wait = 0;
+    uint64_t turnaround = 0;
+    print_string("[BENCH] policy ");
+    print_string(scheduler_name(type));
+    print_string(": wait/turnaround us");
+    for (int t = 0; t < 3; t++) {
+        wait += policy_wait[t];
+        turnaround += policy_turnaround[t];
+        print_string(t == 0 ? " CPU " : t == 1 ? " IO " : " ML ");
+        print_int(policy_avg_us(policy_wait[t], created[t]));
+        print_string("/");
+        print_int(policy_avg_us(policy_turnaround[t], created[t]));
+    }
+    print_string(", avg ");
+    print_int(policy_avg_us(wait, policy_done));
+    print_string("/");
+    print_int(policy_avg_us(turnaround, policy_done));
+    print_string("\n");
+}
+
+// The same mix of long, short and medium bursts under each policy. The
+// processes all arrive together; only the order they run in differs.
+void bench_policy(void) {
+    scheduler_type_t saved = get_scheduler_type();
+    bench_spin_calibrate();
+    
+    // The processes sleep and are preempted, which needs the tick
+    int was_enabled = interrupts_enabled();
+    interrupts_enable();
+    bench_policy_run(SCHEDULER_ROUND_ROBIN);
+    bench_policy_run(SCHEDULER_ML_BASED);
+    bench_policy_run(SCHEDULER_MLFQ);
+    if (!was_enabled) interrupts_disable();
+    set_scheduler_type(saved);
+}
+
+static volatile int smp_done;
+
+static void smp_worker(void) {
+    bench_spin(BENCH_SMP_WORK_US);
+    __sync_fetch_and_add(&smp_done, 1);
+}
+
+// The same batch of CPU-bound processes on 1, 2, 4 and 8 CPUs, as many
+// as are online. Idle CPUs steal from busy ones, so the wall time should
+// drop with every doubling until there are fewer processes than CPUs.
+void bench_smp(void) {
+    bench_spin_calibrate();
+    int was_enabled = interrupts_enabled();
+    interrupts_enable();
+    
+    uint32_t base_ms = 0;
+    for (int n = 1; n <= cpus_online; n *= 2) {
+        process_set_cpu_limit(n);
+        smp_done = 0;
+        int created = 0;
+        uint64_t start = rdtsc();
+        for (int i = 0; i < BENCH_SMP_PROCESSES; i++) {
+            if (process_create_priority(smp_worker, "smp", 0, 0) >= 0) created++;
+        }
+        while (smp_done < created) {
+            process_yield();
+            asm volatile ("hlt");
+        }
+        uint32_t ms = (uint32_t)div64_u32(rdtsc() - start, timer_tsc_khz());
+        if (n == 1) base_ms = ms;
+        
+        uint32_t speedup = base_ms * 100 / (ms ? ms : 1);
+        print_string("[BENCH] smp: ");
+        print_int(n);
+        print_string(" CPUs, ");
+        print_int(created);
+        print_string(" x ");
+        print_int(BENCH_SMP_WORK_US / 1000);
+        print_string(" ms of work in ");
+        print_int(ms);
+        print_string(" ms, speedup ");
+        print_int(speedup / 100);
+        print_string(".");
+        print_int(speedup % 100 / 10);
+        print_int(speedup % 10);
+        print_string("\n");
+    }
+    
+    process_set_cpu_limit(MAX_CPUS);
+    if (!was_enabled) interrupts_disable();
+}
+
+static lock_stats_t bench_lock_stats = LOCK_STATS_INIT("bench");
+static spinlock_t bench_lock = SPINLOCK_INIT_STATS(&bench_lock_stats);
+static volatile uint32_t bench_lock_count;
+static volatile int lock_done;
+
+static void lock_worker(void) {
+    for (int i = 0; i < BENCH_LOCK_OPS; i++) {
+        uint32_t flags = spin_lock_irqsave(&bench_lock);
+        bench_lock_count++;
+        spin_unlock_irqrestore(&bench_lock, flags);
+    }
+    __sync_fetch_and_add(&lock_done, 1);
+}
+
+static void bench_lock_cost(const char* label, uint64_t cycles) {
+    print_string("[BENCH] locks: ");
+    print_string(label);
+    print_int((uint32_t)div64_u32(cycles, BENCH_LOCK_OPS));
+    print_string(" cycles/lock+unlock\n");
+}
+
+// Uncontended cost of each lock type, then one worker per online CPU
+// hammering the profiled "bench" spinlock. Its row in the locks command
+// shows how much of that time went into waiting.
+void bench_locks(void) {
+    spinlock_t plain = SPINLOCK_INIT;
+    mutex_t mutex = MUTEX_INIT;
+    uint32_t flags;
+    uint64_t start;
+    
+    start = rdtsc();
+    for (int i = 0; i < BENCH_LOCK_OPS; i++) {
+        spin_lock(&plain);
+        spin_unlock(&plain);
+    }
+    bench_lock_cost("spinlock ", rdtsc() - start);
+    
+    start = rdtsc();
+    for (int i = 0; i < BENCH_LOCK_OPS; i++) {
+        spin_lock(&bench_lock);
+        spin_unlock(&bench_lock);
+    }
+    bench_lock_cost("profiled spinlock ", rdtsc() - start);
+    
+    start = rdtsc();
+    for (int i = 0; i < BENCH_LOCK_OPS; i++) {
+        flags = spin_lock_irqsave(&plain);
+        spin_unlock_irqrestore(&plain, flags);
+    }
+    bench_lock_cost("irqsave spinlock ", rdtsc() - start);
+    
+    start = rdtsc();
+    for (int i = 0; i < BENCH_LOCK_OPS; i++) {
+        mutex_lock(&mutex);
+        mutex_unlock(&mutex);
+    }
+    bench_lock_cost("mutex ", rdtsc() - start);
+    
+    int was_enabled = interrupts_enabled();
+    interrupts_enable();
+    process_set_cpu_limit(MAX_CPUS);
+    bench_lock_count = 0;
+    lock_done = 0;
+    int created = 0;
+    uint32_t contended = bench_lock_stats.contended;
+    start = rdtsc();
+    for (int i = 0; i < cpus_online; i++) {
+        if (process_create_priority(lock_worker, "locker", 0, 0) >= 0) created++;
+    }
+    while (lock_done < created) {
+        process_yield();
+        asm volatile ("hlt");
+    }
+    uint64_t cycles = rdtsc() - start;
+    process_set_cpu_limit(1);
+    if (!was_enabled) interrupts_disable();
+    
+    print_string("[BENCH] locks: ");
+    print_int(created);
+    print_string(" workers, ");
+    print_int(bench_lock_count);
+    print_string(" acquires in ");
+    print_int((uint32_t)div64_u32(cycles, timer_tsc_khz() ? timer_tsc_khz() : 1));
+    print_string(" ms, ");
+    print_int(bench_lock_stats.contended - contended);
+    print_string(" contended\n");
+}
+
+// Fixed suite for headless runs (make bench). Returns the number of
+// self-test failures; timings are judged on the host.
+int bench_suite(void) {
+    bench_emit_results = 1;
+    process_set_cpu_limit(1);
+    print_string("BENCH begin\n");
+    
+    int failures = bench_string_selftest();
+    bench_result("string_selftest_errors", failures);
+    bench_context_switch();
+    bench_ml_schedule();
+    bench_spawn();
+    bench_fs();
+    bench_fs_index();
+    bench_console();
+    bench_sleep();
+    
+    print_string("BENCH end\n");
+    process_set_cpu_limit(MAX_CPUS);
+    bench_emit_results = 0;
+    return failures;
+}
+
+void bench_run(const char* name) {
+    int all = strcmp(name, "all") == 0;
+    int found = 0;
+    
+    // Keep the other benchmarks on CPU 0 so their numbers do not depend
+    // on -smp; bench smp sets its own limit
+    process_set_cpu_limit(1);
+    
+    if (all || strcmp(name, "switch") == 0) {
+        bench_context_switch();
+        found = 1;
+    }
+    if (all || strcmp(name, "runqueue") == 0) {
+        bench_runqueue();
+        found = 1;
+    }
+    if (all || strcmp(name, "ml") == 0) {
+        bench_ml_schedule();
+        found = 1;
+    }
+    if (all || strcmp(name, "console") == 0) {
+        bench_console();
+        found = 1;
+    }
+    if (all || strcmp(name, "mem") == 0) {
+        bench_memory();
+        found = 1;
+    }
+    if (all || strcmp(name, "fs") == 0) {
+        bench_fs();
+        found = 1;
+    }
+    if (all || strcmp(name, "files") == 0) {
+        bench_fs_index();
+        found = 1;
+    }
+    if (all || strcmp(name, "disk") == 0) {
+        bench_disk();
+        found = 1;
+    }
+    if (all || strcmp(name, "alloc") == 0) {
+        bench_alloc();
+        found = 1;
+    }
+    if (all || strcmp(name, "spawn") == 0) {
+        bench_spawn();
+        found = 1;
+    }
+    if (all || strcmp(name, "paging") == 0) {
+        bench_paging();
+        found = 1;
+    }
+    if (all || strcmp(name, "clone") == 0) {
+        bench_clone();
+        found = 1;
+    }
+    if (all || strcmp(name, "trace") == 0) {
+        bench_trace();
+        found = 1;
+    }
+    if (all || strcmp(name, "sleep") == 0) {
+        bench_sleep();
+        found = 1;
+    }
+    if (all || strcmp(name, "policy") == 0) {
+        bench_policy();
+        found = 1;
+    }
+    if (all || strcmp(name, "smp") == 0) {
+        bench_smp();
+        found = 1;
+    }
+    if (all || strcmp(name, "locks") == 0) {
+        bench_locks();
+        found = 1;
+    }
+    process_set_cpu_limit(MAX_CPUS);
+    
+    if (!found) {
+        print_string("[BENCH] Unknown benchmark: ");
+        print_string(name);
+        print_string("\n[BENCH] Available: " BENCH_NAMES "\n");
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#define BENCH_SWITCH_ITERATIONS 10000
+#define BENCH_RQ_MAX_PROCESSES 4096
+#define BENCH_RQ_ITERATIONS 10000
+#define BENCH_CONSOLE_LINES 200
+#define BENCH_MEM_MAX (64 * 1024)
+#define BENCH_MEM_BYTES (1024 * 1024)
+#define BENCH_FS_BYTES (48 * 1024)
+#define BENCH_FS_CHUNK 4096
+#define BENCH_FS_FILES 1024
+#define BENCH_DISK_SEQ_BLOCKS 2048
+#define BENCH_DISK_SEQ_RUN 16
+#define BENCH_DISK_RANDOM 256
+#define BENCH_DISK_DEPTH 32
+#define BENCH_ALLOC_OPS 1024
+#define BENCH_SPAWN_BATCH 64
+#define BENCH_SPAWN_ROUNDS 16
+#define BENCH_FAULT_PAGES 256
+#define BENCH_CR3_RELOADS 1000
+#define BENCH_CLONE_MAX_PAGES 1024
+#define BENCH_CLONE_CHILDREN 8
+#define BENCH_TRACE_EVENTS 10000
+#define BENCH_TIMER_OPS 4096
+#define BENCH_SLEEPERS 8
+#define BENCH_SLEEP_ROUNDS 5
+#define BENCH_SLEEP_TICKS 2
+#define BENCH_POLICY_EACH 3       // processes of each type per run
+#define BENCH_POLICY_CPU_US 40000 // CPU: one long burst
+#define BENCH_POLICY_IO_US 500    // IO: short bursts, then sleep a tick
+#define BENCH_POLICY_ML_US 2000   // ML: medium bursts, then yield
+#define BENCH_POLICY_ROUNDS 10
+#define BENCH_SMP_PROCESSES 16
+#define BENCH_SMP_WORK_US 20000   // CPU each process burns before exiting
+#define BENCH_LOCK_OPS 100000
+
+// QEMU -device isa-debug-exit,iobase=0xf4: exit status is (value << 1) | 1
+#define QEMU_DEBUG_EXIT_PORT 0xF4
+
+#define BENCH_NAMES "switch runqueue ml console mem fs files disk alloc spawn paging clone trace sleep policy smp locks all"
+
+// Kernel microbenchmarks
+void bench_context_switch(void);
+void bench_runqueue(void);
+void bench_ml_schedule(void);
+void bench_console(void);
+int bench_string_selftest(void);
+void bench_memory(void);
+void bench_fs(void);
+void bench_fs_index(void);
+void bench_disk(void);
+void bench_alloc(void);
+void bench_spawn(void);
+void bench_paging(void);
+void bench_clone(void);
+void bench_trace(void);
+void bench_sleep(void);
+void bench_policy(void);
+void bench_smp(void);
+void bench_locks(void);
+void bench_run(const char* name);
+int bench_suite(void);
+
+#endif
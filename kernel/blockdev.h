@@ -0,0 +1,30 @@
+#ifndef BLOCKDEV_H
+#define BLOCKDEV_H
+
+#include <stdint.h>
+
+#define BLOCK_SIZE 512
+
+// One queued transfer. done is set from the completion IRQ.
+typedef struct blk_request {
+    uint32_t block;
+    uint32_t count;
+    void* buf;
+    uint8_t write;
+    volatile uint8_t done;
+    int8_t status;
+    struct blk_request* next;
+} blk_request_t;
+
+// A disk addressed in BLOCK_SIZE units. read/write return 0 or -1.
+// Devices that can queue requests also set submit and wait.
+typedef struct {
+    const char* name;
+    uint32_t blocks;
+    int (*read)(uint32_t block, uint32_t count, void* buf);
+    int (*write)(uint32_t block, uint32_t count, const void* buf);
+    int (*submit)(blk_request_t* req);
+    int (*wait)(blk_request_t* req);
+} block_device_t;
+
+#endif
@@ -0,0 +1,219 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdint.h>
+
+// Read the time stamp counter
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// 64-by-32 bit unsigned division without pulling in libgcc's __udivdi3
+static inline uint64_t div64_u32(uint64_t n, uint32_t d) {
+    uint32_t hi = (uint32_t)(n >> 32);
+    uint32_t q_hi = hi / d;
+    uint32_t r = hi % d;
+    uint32_t q_lo;
+    asm ("divl %4" : "=a"(q_lo), "=d"(r) : "a"((uint32_t)n), "d"(r), "rm"(d));
+    return ((uint64_t)q_hi << 32) | q_lo;
+}
+
+// Index of the lowest set bit, x must be non-zero
+static inline int bit_scan_forward(uint32_t x) {
+    int index;
+    asm ("bsf %1, %0" : "=r"(index) : "rm"(x));
+    return index;
+}
+
+// Index of the highest set bit, x must be non-zero
+static inline int bit_scan_reverse(uint32_t x) {
+    int index;
+    asm ("bsr %1, %0" : "=r"(index) : "rm"(x));
+    return index;
+}
+
+// Atomically replace *ptr with desired if it still holds expected
+#ifdef HOSTED
+// Pointer-sized pairs are 16 bytes on the x86-64 host, built with -mcx16
+#define cmpxchg8b(ptr, expected, desired) \
+    __sync_bool_compare_and_swap(ptr, expected, desired)
+#else
+static inline int cmpxchg8b(volatile uint64_t* ptr, uint64_t expected, uint64_t desired) {
+    uint8_t ok;
+    asm volatile ("lock; cmpxchg8b %1; sete %0"
+                  : "=q"(ok), "+m"(*ptr), "+A"(expected)
+                  : "b"((uint32_t)desired), "c"((uint32_t)(desired >> 32))
+                  : "memory");
+    return ok;
+}
+#endif
+
+// CPUID and control register bits
+#define CPUID_EDX_PSE   (1 << 3)
+#define CPUID_EDX_PGE   (1 << 13)
+#define CPUID_EDX_SSE2  (1 << 26)
+#define CR0_MP          (1 << 1)
+#define CR0_EM          (1 << 2)
+#define CR0_WP          (1 << 16)
+#define CR0_PG          (1u << 31)
+#define CR4_PSE         (1 << 4)
+#define CR4_PGE         (1 << 7)
+#define CR4_OSFXSR      (1 << 9)
+#define CR4_OSXMMEXCPT  (1 << 10)
+
+static inline void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t* eax,
+                         uint32_t* ebx, uint32_t* ecx, uint32_t* edx) {
+    asm volatile ("cpuid"
+                  : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                  : "a"(leaf), "c"(subleaf));
+}
+
+static inline uint32_t read_cr0(void) {
+    uint32_t val;
+    asm volatile ("mov %%cr0, %0" : "=r"(val));
+    return val;
+}
+
+static inline void write_cr0(uint32_t val) {
+    asm volatile ("mov %0, %%cr0" : : "r"(val) : "memory");
+}
+
+// Faulting linear address of the last page fault
+static inline uint32_t read_cr2(void) {
+    uint32_t val;
+    asm volatile ("mov %%cr2, %0" : "=r"(val));
+    return val;
+}
+
+static inline uint32_t read_cr3(void) {
+    uint32_t val;
+    asm volatile ("mov %%cr3, %0" : "=r"(val));
+    return val;
+}
+
+// Loading CR3 flushes every non-global TLB entry
+static inline void write_cr3(uint32_t val) {
+    asm volatile ("mov %0, %%cr3" : : "r"(val) : "memory");
+}
+
+static inline uint32_t read_cr4(void) {
+    uint32_t val;
+    asm volatile ("mov %%cr4, %0" : "=r"(val));
+    return val;
+}
+
+static inline void write_cr4(uint32_t val) {
+    asm volatile ("mov %0, %%cr4" : : "r"(val) : "memory");
+}
+
+static inline void invlpg(uint32_t addr) {
+    asm volatile ("invlpg (%0)" : : "r"(addr) : "memory");
+}
+
+// Port I/O
+static inline void outb(uint16_t port, uint8_t val) {
+    asm volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline uint8_t inb(uint16_t port) {
+    uint8_t ret;
+    asm volatile ("inb %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static inline void outw(uint16_t port, uint16_t val) {
+    asm volatile ("outw %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline uint16_t inw(uint16_t port) {
+    uint16_t ret;
+    asm volatile ("inw %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static inline void outl(uint16_t port, uint32_t val) {
+    asm volatile ("outl %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline uint32_t inl(uint16_t port) {
+    uint32_t ret;
+    asm volatile ("inl %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static inline void insw(uint16_t port, void* buf, uint32_t count) {
+    asm volatile ("rep insw" : "+D"(buf), "+c"(count) : "d"(port) : "memory");
+}
+
+static inline void outsw(uint16_t port, const void* buf, uint32_t count) {
+    asm volatile ("rep outsw" : "+S"(buf), "+c"(count) : "d"(port) : "memory");
+}
+
+static inline void io_wait(void) {
+    outb(0x80, 0);
+}
+
+// Processors brought up at boot, see smp.c
+#define MAX_CPUS 8
+
+// Interrupt flag control
+#define EFLAGS_IF 0x200
+
+#ifdef HOSTED
+// The hosted build runs in a single Linux thread with nothing to mask
+static inline void interrupts_enable(void) {}
+static inline void interrupts_disable(void) {}
+static inline uint32_t irq_save(void) { return 0; }
+static inline int interrupts_enabled(void) { return 0; }
+static inline void irq_restore(uint32_t flags) { (void)flags; }
+static inline uint32_t local_irq_save(void) { return 0; }
+static inline void local_irq_restore(uint32_t flags) { (void)flags; }
+#else
+// irq_save() also takes the kernel lock, so a section that masks
+// interrupts excludes the other CPUs as well. See smp.c.
+void kernel_lock_acquire(void);
+void kernel_lock_release(void);
+
+static inline void interrupts_enable(void) {
+    asm volatile ("sti" : : : "memory");
+}
+
+static inline void interrupts_disable(void) {
+    asm volatile ("cli" : : : "memory");
+}
+
+// Masks interrupts on this CPU only, for sections that touch nothing
+// another CPU could reach, such as the XMM registers in string.c
+static inline uint32_t local_irq_save(void) {
+    uint32_t flags;
+    asm volatile ("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void local_irq_restore(uint32_t flags) {
+    if (flags & EFLAGS_IF) {
+        asm volatile ("sti" : : : "memory");
+    }
+}
+
+static inline uint32_t irq_save(void) {
+    uint32_t flags = local_irq_save();
+    kernel_lock_acquire();
+    return flags;
+}
+
+static inline int interrupts_enabled(void) {
+    uint32_t flags;
+    asm volatile ("pushf; pop %0" : "=r"(flags));
+    return (flags & EFLAGS_IF) != 0;
+}
+
+static inline void irq_restore(uint32_t flags) {
+    kernel_lock_release();
+    local_irq_restore(flags);
+}
+#endif
+
+#endif
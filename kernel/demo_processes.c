@@ -1,26 +1,35 @@
 #include "process.h"
 #include "kernel.h"
 #include "fs.h" 
+#include "klog.h"
+#include "timer.h"
+
+// Simulated device latency of io_process
+#define IO_WAIT_MS 50
 
 // Demo process functions
 void cpu_process(void) {
     while(1) {
+        klog_drain();
         print_string("[CPU] Process running\n");
         for(int i = 0; i < 1000000; i++);
         process_yield();
     }
 }
 
+// Short bursts between waits; the wait leaves the CPU to the others
 void io_process(void) {
     while(1) {
+        klog_drain();
         print_string("[IO] Process running\n");
-        for(int i = 0; i < 500000; i++);
-        process_yield();
+        for(int i = 0; i < 50000; i++);
+        sleep_ticks(IO_WAIT_MS * timer_get_frequency() / 1000 + 1);
     }
 }
 
 void ml_process(void) {
     while(1) {
+        klog_drain();
         print_string("[ML] Process running\n");
         for(int i = 0; i < 800000; i++);
         process_yield();
@@ -33,14 +42,14 @@ void demo_file_system(void) {
     fs_list(); 
     
     char buffer[100];
-    int bytes_read = fs_read("readme.txt", buffer); 
+    int bytes_read = fs_read("readme.txt", buffer, sizeof(buffer)); 
     if(bytes_read > 0) {
         print_string("[FS] Read from readme.txt: ");
         print_string(buffer);
         print_string("\n");
     }
     
-    bytes_read = fs_read("ml_info.txt", buffer);  // CORRECT - 2 arguments
+    bytes_read = fs_read("ml_info.txt", buffer, sizeof(buffer));  // CORRECT - 2 arguments
     if(bytes_read > 0) {
         print_string("[FS] Read from ml_info.txt: ");
         print_string(buffer);
@@ -67,14 +76,9 @@ void init_demo_processes(void) {
     demo_file_system();
     
     // Step 2:create processes
-    int pid1 = process_create(cpu_process, "CPU_Process", 0);
-    ml_update_process_features(pid1, 0);
-    
-    int pid2 = process_create(io_process, "IO_Process", 1);
-    ml_update_process_features(pid2, 1);
-    
-    int pid3 = process_create(ml_process, "ML_Process", 2);
-    ml_update_process_features(pid3, 2);
+    process_create(cpu_process, "CPU_Process", 0);
+    process_create(io_process, "IO_Process", 1);
+    process_create(ml_process, "ML_Process", 2);
     
     print_string("=== Demo Processes Created ===\n\n");
 }
\ No newline at end of file
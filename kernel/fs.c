@@ -1,225 +1,647 @@
 #include "fs.h"
 #include "kernel.h"
 #include "string.h"
+#include "klog.h"
+#include "cpu.h"
+#include "bcache.h"
+#include "ata.h"
+#include "ramdisk.h"
+#include "mutex.h"
 
 static filesystem_t fs;
-static uint8_t data_blocks[512][BLOCK_SIZE];
 
-static void delay(int cycles) {
-    for(int i = 0; i < cycles; i++) { 
-        asm volatile ("nop"); 
+// Serializes every public call, and with them the buffer cache. A
+// sleeping lock, since reads and writes can wait on the disk while
+// holding it. The file_* helpers below expect it held.
+static lock_stats_t fs_lock_stats = LOCK_STATS_INIT("fs");
+static mutex_t fs_lock = MUTEX_INIT_STATS(&fs_lock_stats);
+
+// FNV-1a
+static uint32_t fs_hash(const char* name) {
+    uint32_t hash = 2166136261u;
+    while(*name) {
+        hash = (hash ^ (uint8_t)*name++) * 16777619u;
     }
+    return hash;
 }
 
-void fs_init(void) {
-    print_string("[FS] Initializing File System...\n");
-    delay(5000000);
-    
-    memset(&fs, 0, sizeof(fs));
+// Slot in name_index holding filename, or the empty slot ending its probe
+static uint32_t index_probe(const char* filename, uint32_t hash) {
+    uint32_t slot = hash & (FS_HASH_SLOTS - 1);
     
-    for(int i = 0; i < 4; i++) {
-        fs.block_bitmap[i / 8] |= (1 << (i % 8));
+    while(fs.name_index[slot] != FS_SLOT_EMPTY) {
+        file_entry_t* f = &fs.files[fs.name_index[slot]];
+        if(f->name_hash == hash && strcmp(f->name, filename) == 0) {
+            break;
+        }
+        slot = (slot + 1) & (FS_HASH_SLOTS - 1);
     }
+    return slot;
+}
+
+// Backward-shift delete: pull later entries of the probe run into the
+// hole so lookups never need tombstones
+static void index_remove(uint32_t hole) {
+    uint32_t slot = hole;
     
-    fs_create("readme.txt");
-    delay(5000000);
-    fs_write("readme.txt", "Welcome to Mini OS with ML Scheduler!");
-    delay(5000000);
+    fs.name_index[hole] = FS_SLOT_EMPTY;
+    while(1) {
+        slot = (slot + 1) & (FS_HASH_SLOTS - 1);
+        if(fs.name_index[slot] == FS_SLOT_EMPTY) {
+            return;
+        }
+        
+        uint32_t home = fs.files[fs.name_index[slot]].name_hash & (FS_HASH_SLOTS - 1);
+        if(((slot - home) & (FS_HASH_SLOTS - 1)) >= ((slot - hole) & (FS_HASH_SLOTS - 1))) {
+            fs.name_index[hole] = fs.name_index[slot];
+            fs.name_index[slot] = FS_SLOT_EMPTY;
+            hole = slot;
+        }
+    }
+}
+
+static file_entry_t* fs_lookup(const char* filename) {
+    uint32_t slot = index_probe(filename, fs_hash(filename));
+    if(fs.name_index[slot] == FS_SLOT_EMPTY) {
+        return NULL;
+    }
+    return &fs.files[fs.name_index[slot]];
+}
+
+static file_entry_t* fs_find(const char* filename) {
+    file_entry_t* f = fs_lookup(filename);
+    if(!f) {
+        klog(KLOG_ERR, KLOG_FS, "File not found - %s", filename);
+    }
+    return f;
+}
+
+static void file_dirty(const file_entry_t* f) {
+    uint32_t table_block = (f - fs.files) / FS_ENTRIES_PER_BLOCK;
+    fs.dirty_table[table_block / 32] |= 1u << (table_block % 32);
+}
+
+static void mark_blocks(uint32_t start, uint32_t count, int used) {
+    if(count == 0) {
+        return;
+    }
+    fs.free_blocks += used ? -count : count;
     
-    fs_create("ml_info.txt");
-    delay(5000000);
-    fs_write("ml_info.txt", "ML Scheduler: CPU=8, IO=4, ML=6 bursts");
-    delay(5000000);
+    uint32_t first = start / (BLOCK_SIZE * 8);
+    uint32_t last = (start + count - 1) / (BLOCK_SIZE * 8);
+    for(uint32_t b = first; b <= last; b++) {
+        fs.dirty_bitmap |= 1u << b;
+    }
     
-    print_string("[FS] File System Ready\n");
-    delay(5000000);
+    while(count > 0) {
+        uint32_t bit = start % 32;
+        uint32_t n = 32 - bit < count ? 32 - bit : count;
+        uint32_t mask = (n == 32) ? 0xFFFFFFFF : ((1u << n) - 1) << bit;
+        
+        if(used) {
+            fs.block_bitmap[start / 32] |= mask;
+        } else {
+            fs.block_bitmap[start / 32] &= ~mask;
+        }
+        start += n;
+        count -= n;
+    }
 }
 
-int fs_create(const char* filename) {
-    int i;
-    for(i = 0; i < MAX_FILES; i++) {
-        if(!fs.files[i].used) {
+// Length of the free run starting at block, capped at max
+static uint32_t free_run_length(uint32_t block, uint32_t max) {
+    uint32_t len = 0;
+    
+    while(len < max && block < fs.total_blocks) {
+        uint32_t bit = block % 32;
+        uint32_t used = fs.block_bitmap[block / 32] >> bit;
+        uint32_t avail = used ? (uint32_t)bit_scan_forward(used) : 32 - bit;
+        
+        len += avail;
+        block += avail;
+        if(avail < 32 - bit) {
             break;
         }
     }
+    return len < max ? len : max;
+}
+
+// First run of at least want blocks, or the longest run if none is that
+// long. Fully used words are skipped 32 blocks at a time.
+static int find_free_run(uint32_t want, uint32_t* count) {
+    int best_start = -1;
+    uint32_t best_len = 0;
+    uint32_t block = 0;
     
-    if(i >= MAX_FILES) {
-        print_string("[FS] Error: File table full\n");
-        delay(5000000);
+    while(block < fs.total_blocks) {
+        uint32_t word = block / 32;
+        uint32_t free = ~fs.block_bitmap[word] & (0xFFFFFFFF << (block % 32));
+        if(!free) {
+            block = (word + 1) * 32;
+            continue;
+        }
+        
+        uint32_t start = word * 32 + bit_scan_forward(free);
+        uint32_t len = free_run_length(start, want);
+        if(len >= want) {
+            *count = len;
+            return start;
+        }
+        if(len > best_len) {
+            best_start = start;
+            best_len = len;
+        }
+        block = start + len;
+    }
+    
+    *count = best_len;
+    return best_start;
+}
+
+static uint32_t file_blocks(const file_entry_t* f) {
+    uint32_t blocks = 0;
+    for(int e = 0; e < f->extent_count; e++) {
+        blocks += f->extents[e].count;
+    }
+    return blocks;
+}
+
+// Extend the last extent in place when possible, otherwise add a new one
+static int file_grow(file_entry_t* f, uint32_t blocks_needed) {
+    uint32_t have = file_blocks(f);
+    
+    if(blocks_needed > have && blocks_needed - have > fs.free_blocks) {
+        klog(KLOG_ERR, KLOG_FS, "No free blocks");
         return -1;
     }
     
-    int block = -1;
-    for(int j = 0; j < 512; j++) {
-        if(!(fs.block_bitmap[j / 8] & (1 << (j % 8)))) {
-            block = j;
-            fs.block_bitmap[j / 8] |= (1 << (j % 8));
-            break;
+    while(have < blocks_needed) {
+        uint32_t want = blocks_needed - have;
+        uint32_t n;
+        
+        if(f->extent_count > 0) {
+            fs_extent_t* last = &f->extents[f->extent_count - 1];
+            n = free_run_length(last->start + last->count, want);
+            if(n > 0) {
+                mark_blocks(last->start + last->count, n, 1);
+                last->count += n;
+                file_dirty(f);
+                have += n;
+                continue;
+            }
+        }
+        
+        if(f->extent_count >= FS_MAX_EXTENTS) {
+            klog(KLOG_ERR, KLOG_FS, "%s: too many extents", f->name);
+            return -1;
+        }
+        
+        int start = find_free_run(want, &n);
+        if(start < 0) {
+            klog(KLOG_ERR, KLOG_FS, "No free blocks");
+            return -1;
+        }
+        mark_blocks(start, n, 1);
+        f->extents[f->extent_count].start = start;
+        f->extents[f->extent_count].count = n;
+        f->extent_count++;
+        file_dirty(f);
+        have += n;
+    }
+    return 0;
+}
+
+// Copy between a file and a flat buffer one block at a time through the
+// buffer cache. A NULL buffer zero-fills the range instead.
+static int file_copy(file_entry_t* f, uint32_t offset, uint8_t* buffer,
+                     uint32_t len, int to_file) {
+    for(int e = 0; e < f->extent_count && len > 0; e++) {
+        uint32_t bytes = f->extents[e].count * BLOCK_SIZE;
+        if(offset >= bytes) {
+            offset -= bytes;
+            continue;
+        }
+        
+        while(offset < bytes && len > 0) {
+            uint32_t block = f->extents[e].start + offset / BLOCK_SIZE;
+            uint32_t block_offset = offset % BLOCK_SIZE;
+            uint32_t n = BLOCK_SIZE - block_offset < len ? BLOCK_SIZE - block_offset : len;
+            int ret;
+            
+            if(to_file) {
+                ret = bcache_write(block, block_offset, buffer, n);
+            } else {
+                ret = bcache_read(block, block_offset, buffer, n);
+            }
+            if(ret < 0) {
+                return -1;
+            }
+            
+            if(buffer) {
+                buffer += n;
+            }
+            offset += n;
+            len -= n;
+        }
+        offset = 0;
+    }
+    return 0;
+}
+
+static void fs_reset(void) {
+    memset(&fs, 0, sizeof(fs));
+    memset(fs.name_index, 0xFF, sizeof(fs.name_index));
+}
+
+// Rebuild the name index and free slot stack from the file table
+static void fs_build_index(void) {
+    fs.free_file_count = 0;
+    for(int i = MAX_FILES - 1; i >= 0; i--) {
+        if(fs.files[i].used) {
+            uint32_t slot = index_probe(fs.files[i].name, fs.files[i].name_hash);
+            fs.name_index[slot] = i;
+        } else {
+            fs.free_files[fs.free_file_count++] = i;
         }
     }
+}
+
+static void fs_format(uint32_t total_blocks) {
+    fs_reset();
+    fs.total_blocks = total_blocks;
+    
+    // Blocks past the end of the disk stay marked used so scans skip them
+    memset(fs.block_bitmap, 0xFF, sizeof(fs.block_bitmap));
+    mark_blocks(0, total_blocks, 0);
+    mark_blocks(0, FS_DATA_START, 1);
+    fs.free_blocks = total_blocks - FS_DATA_START;
     
-    if(block == -1) {
-        print_string("[FS] Error: No free blocks\n");
-        delay(5000000);
+    for(uint32_t t = 0; t < FS_TABLE_BLOCKS; t++) {
+        fs.dirty_table[t / 32] |= 1u << (t % 32);
+    }
+    fs_build_index();
+    
+    klog(KLOG_INFO, KLOG_FS, "Formatted %u blocks", total_blocks);
+}
+
+static int fs_mount(void) {
+    fs_superblock_t sb;
+    uint8_t block[BLOCK_SIZE];
+    
+    if(bcache_read(FS_SUPERBLOCK, 0, &sb, sizeof(sb)) < 0) {
+        return -1;
+    }
+    if(sb.magic != FS_MAGIC || sb.version != FS_VERSION || sb.max_files != MAX_FILES ||
+       sb.data_start != FS_DATA_START || sb.total_blocks > bcache_device()->blocks ||
+       sb.total_blocks > FS_MAX_BLOCKS) {
         return -1;
     }
     
-    strcpy(fs.files[i].name, filename);
-    fs.files[i].size = 0;
-    fs.files[i].start_block = block;
-    fs.files[i].used = 1;
+    fs_reset();
+    fs.total_blocks = sb.total_blocks;
+    fs.free_blocks = sb.free_blocks;
     
-    memset(data_blocks[block], 0, BLOCK_SIZE);
+    for(uint32_t b = 0; b < FS_BITMAP_BLOCKS; b++) {
+        if(bcache_read(FS_BITMAP_START + b, 0,
+                       (uint8_t*)fs.block_bitmap + b * BLOCK_SIZE, BLOCK_SIZE) < 0) {
+            return -1;
+        }
+    }
     
-    print_string("[FS] Created file: ");
-    delay(5000000);
-    print_string(filename);
-    delay(5000000);
-    print_string("\n");
-    delay(5000000);
+    for(uint32_t t = 0; t < FS_TABLE_BLOCKS; t++) {
+        if(bcache_read(FS_TABLE_START + t, 0, block, BLOCK_SIZE) < 0) {
+            return -1;
+        }
+        for(uint32_t e = 0; e < FS_ENTRIES_PER_BLOCK; e++) {
+            uint32_t i = t * FS_ENTRIES_PER_BLOCK + e;
+            if(i < MAX_FILES) {
+                memcpy(&fs.files[i], block + e * sizeof(file_entry_t), sizeof(file_entry_t));
+            }
+        }
+    }
+    fs_build_index();
     
+    klog(KLOG_INFO, KLOG_FS, "Mounted %u blocks, %u free", fs.total_blocks, fs.free_blocks);
     return 0;
 }
 
-int fs_write(const char* filename, const char* data) {
-    int i;
-    for(i = 0; i < MAX_FILES; i++) {
-        if(fs.files[i].used && strcmp(fs.files[i].name, filename) == 0) {
-            break;
+// Write changed metadata into the cache, then flush every dirty block
+int fs_sync(void) {
+    fs_superblock_t sb;
+    uint8_t block[BLOCK_SIZE];
+    int ret = 0;
+    
+    mutex_lock(&fs_lock);
+    // A block stays dirty until its write succeeds, so the next sync
+    // retries whatever failed this time
+    for(uint32_t b = 0; b < FS_BITMAP_BLOCKS; b++) {
+        if(!(fs.dirty_bitmap & (1u << b))) {
+            continue;
         }
+        int err = bcache_write(FS_BITMAP_START + b, 0,
+                               (uint8_t*)fs.block_bitmap + b * BLOCK_SIZE, BLOCK_SIZE);
+        if(err == 0) {
+            fs.dirty_bitmap &= ~(1u << b);
+        }
+        ret |= err;
+    }
+    
+    for(uint32_t t = 0; t < FS_TABLE_BLOCKS; t++) {
+        if(!(fs.dirty_table[t / 32] & (1u << (t % 32)))) {
+            continue;
+        }
+        memset(block, 0, BLOCK_SIZE);
+        for(uint32_t e = 0; e < FS_ENTRIES_PER_BLOCK; e++) {
+            uint32_t i = t * FS_ENTRIES_PER_BLOCK + e;
+            if(i < MAX_FILES) {
+                memcpy(block + e * sizeof(file_entry_t), &fs.files[i], sizeof(file_entry_t));
+            }
+        }
+        int err = bcache_write(FS_TABLE_START + t, 0, block, BLOCK_SIZE);
+        if(err == 0) {
+            fs.dirty_table[t / 32] &= ~(1u << (t % 32));
+        }
+        ret |= err;
+    }
+    
+    memset(block, 0, BLOCK_SIZE);
+    sb.magic = FS_MAGIC;
+    sb.version = FS_VERSION;
+    sb.total_blocks = fs.total_blocks;
+    sb.free_blocks = fs.free_blocks;
+    sb.max_files = MAX_FILES;
+    sb.data_start = FS_DATA_START;
+    memcpy(block, &sb, sizeof(sb));
+    ret |= bcache_write(FS_SUPERBLOCK, 0, block, BLOCK_SIZE);
+    
+    ret |= bcache_sync();
+    mutex_unlock(&fs_lock);
+    
+    if(ret < 0) {
+        klog(KLOG_ERR, KLOG_FS, "Sync failed");
     }
+    return ret < 0 ? -1 : 0;
+}
+
+void fs_init(void) {
+    klog(KLOG_INFO, KLOG_FS, "Initializing File System...");
+    
+    block_device_t* dev = ata_init();
+    if(dev && dev->blocks <= FS_DATA_START) {
+        klog(KLOG_WARN, KLOG_FS, "%s too small for the file system", dev->name);
+        dev = 0;
+    }
+    if(!dev) {
+        klog(KLOG_WARN, KLOG_FS, "No disk, using RAM disk (not persistent)");
+        dev = ramdisk_init();
+    }
+    bcache_init(dev);
     
-    if(i >= MAX_FILES) {
-        print_string("[FS] Error: File not found - ");
-        delay(5000000);
-        print_string(filename);
-        delay(5000000);
-        print_string("\n");
-        delay(5000000);
+    if(fs_mount() < 0) {
+        fs_format(dev->blocks < FS_MAX_BLOCKS ? dev->blocks : FS_MAX_BLOCKS);
+        
+        fs_create("readme.txt");
+        fs_write("readme.txt", "Welcome to Mini OS with ML Scheduler!");
+        
+        fs_create("ml_info.txt");
+        fs_write("ml_info.txt", "ML Scheduler: Random Forest predicts each burst");
+        
+        fs_sync();
+    }
+    
+    klog(KLOG_INFO, KLOG_FS, "File System Ready");
+}
+
+static int file_create(const char* filename) {
+    if(strlen(filename) >= MAX_FILENAME) {
+        klog(KLOG_ERR, KLOG_FS, "File name too long - %s", filename);
         return -1;
     }
     
-    int len = strlen(data);
-    if(len >= BLOCK_SIZE) {
-        len = BLOCK_SIZE - 1;
+    uint32_t hash = fs_hash(filename);
+    uint32_t slot = index_probe(filename, hash);
+    if(fs.name_index[slot] != FS_SLOT_EMPTY) {
+        klog(KLOG_ERR, KLOG_FS, "File exists - %s", filename);
+        return -1;
     }
     
-    memcpy(data_blocks[fs.files[i].start_block], data, len);
-    data_blocks[fs.files[i].start_block][len] = '\0';
-    fs.files[i].size = len;
+    if(fs.free_file_count == 0) {
+        klog(KLOG_ERR, KLOG_FS, "File table full");
+        return -1;
+    }
+    
+    uint16_t i = fs.free_files[--fs.free_file_count];
+    
+    // Blocks are allocated on first write
+    memset(&fs.files[i], 0, sizeof(file_entry_t));
+    strcpy(fs.files[i].name, filename);
+    fs.files[i].name_hash = hash;
+    fs.files[i].used = 1;
+    fs.name_index[slot] = i;
+    file_dirty(&fs.files[i]);
     
-    print_string("[FS] Written to ");
-    delay(5000000);
-    print_string(filename);
-    delay(5000000);
-    print_string(": ");
-    delay(5000000);
-    print_string(data);
-    delay(5000000);
-    print_string("\n");
-    delay(5000000);
+    klog(KLOG_DEBUG, KLOG_FS, "Created file: %s", filename);
     
     return 0;
 }
 
-int fs_read(const char* filename, char* buffer) {
-    int i;
-    for(i = 0; i < MAX_FILES; i++) {
-        if(fs.files[i].used && strcmp(fs.files[i].name, filename) == 0) {
-            break;
-        }
+static int file_write_at(file_entry_t* f, uint32_t offset, const void* data, uint32_t len) {
+    if(offset > MAX_FILE_SIZE || len > MAX_FILE_SIZE - offset) {
+        klog(KLOG_ERR, KLOG_FS, "%s: write past %u bytes", f->name, MAX_FILE_SIZE);
+        return -1;
     }
     
-    if(i >= MAX_FILES) {
-        print_string("[FS] Error: File not found - ");
-        delay(5000000);
-        print_string(filename);
-        delay(5000000);
-        print_string("\n");
-        delay(5000000);
+    uint32_t end = offset + len;
+    if(file_grow(f, (end + BLOCK_SIZE - 1) / BLOCK_SIZE) < 0) {
         return -1;
     }
     
-    memcpy(buffer, data_blocks[fs.files[i].start_block], fs.files[i].size);
-    buffer[fs.files[i].size] = '\0';
+    if(offset > f->size && file_copy(f, f->size, NULL, offset - f->size, 1) < 0) {
+        return -1;
+    }
+    if(file_copy(f, offset, (uint8_t*)data, len, 1) < 0) {
+        return -1;
+    }
+    if(end > f->size) {
+        f->size = end;
+        file_dirty(f);
+    }
     
-    return fs.files[i].size;
+    klog(KLOG_DEBUG, KLOG_FS, "Wrote %u bytes to %s at %u", len, f->name, offset);
+    
+    return len;
 }
 
-int fs_delete(const char* filename) {
-    int i;
-    for(i = 0; i < MAX_FILES; i++) {
-        if(fs.files[i].used && strcmp(fs.files[i].name, filename) == 0) {
-            break;
-        }
+static void file_truncate(file_entry_t* f) {
+    for(int e = 0; e < f->extent_count; e++) {
+        mark_blocks(f->extents[e].start, f->extents[e].count, 0);
+    }
+    f->extent_count = 0;
+    f->size = 0;
+    file_dirty(f);
+}
+
+static int file_read_at(file_entry_t* f, uint32_t offset, void* buffer, uint32_t len) {
+    if(offset >= f->size) {
+        return 0;
+    }
+    if(len > f->size - offset) {
+        len = f->size - offset;
+    }
+    
+    if(file_copy(f, offset, buffer, len, 0) < 0) {
+        return -1;
     }
     
-    if(i >= MAX_FILES) {
-        print_string("[FS] Error: File not found - ");
-        delay(5000000);
-        print_string(filename);
-        delay(5000000);
-        print_string("\n");
-        delay(5000000);
+    return len;
+}
+
+static int file_delete(const char* filename) {
+    uint32_t slot = index_probe(filename, fs_hash(filename));
+    if(fs.name_index[slot] == FS_SLOT_EMPTY) {
+        klog(KLOG_ERR, KLOG_FS, "File not found - %s", filename);
         return -1;
     }
     
-    fs.block_bitmap[fs.files[i].start_block / 8] &= ~(1 << (fs.files[i].start_block % 8));
+    uint16_t i = fs.name_index[slot];
+    file_entry_t* f = &fs.files[i];
     
-    fs.files[i].used = 0;
+    file_truncate(f);
+    index_remove(slot);
+    f->used = 0;
+    file_dirty(f);
+    fs.free_files[fs.free_file_count++] = i;
     
-    print_string("[FS] Deleted file: ");
-    delay(5000000);
-    print_string(filename);
-    delay(5000000);
-    print_string("\n");
-    delay(5000000);
+    klog(KLOG_DEBUG, KLOG_FS, "Deleted file: %s", filename);
     
     return 0;
 }
 
+int fs_create(const char* filename) {
+    mutex_lock(&fs_lock);
+    int ret = file_create(filename);
+    mutex_unlock(&fs_lock);
+    return ret;
+}
+
+int fs_write_at(const char* filename, uint32_t offset, const void* data, uint32_t len) {
+    mutex_lock(&fs_lock);
+    file_entry_t* f = fs_find(filename);
+    int ret = f ? file_write_at(f, offset, data, len) : -1;
+    mutex_unlock(&fs_lock);
+    return ret;
+}
+
+int fs_append(const char* filename, const void* data, uint32_t len) {
+    mutex_lock(&fs_lock);
+    file_entry_t* f = fs_find(filename);
+    int ret = f ? file_write_at(f, f->size, data, len) : -1;
+    mutex_unlock(&fs_lock);
+    return ret;
+}
+
+int fs_truncate(const char* filename) {
+    mutex_lock(&fs_lock);
+    file_entry_t* f = fs_find(filename);
+    if(f) {
+        file_truncate(f);
+    }
+    mutex_unlock(&fs_lock);
+    return f ? 0 : -1;
+}
+
+int fs_write(const char* filename, const char* data) {
+    int ret = -1;
+    
+    mutex_lock(&fs_lock);
+    file_entry_t* f = fs_find(filename);
+    if(f) {
+        file_truncate(f);
+        ret = file_write_at(f, 0, data, strlen(data)) < 0 ? -1 : 0;
+    }
+    mutex_unlock(&fs_lock);
+    
+    if(ret == 0) {
+        klog(KLOG_INFO, KLOG_FS, "Written to %s: %s", filename, data);
+    }
+    return ret;
+}
+
+int fs_read_at(const char* filename, uint32_t offset, void* buffer, uint32_t len) {
+    mutex_lock(&fs_lock);
+    file_entry_t* f = fs_find(filename);
+    int ret = f ? file_read_at(f, offset, buffer, len) : -1;
+    mutex_unlock(&fs_lock);
+    return ret;
+}
+
+int fs_read(const char* filename, char* buffer, uint32_t buffer_size) {
+    if(buffer_size == 0) {
+        return -1;
+    }
+    
+    int len = fs_read_at(filename, 0, buffer, buffer_size - 1);
+    if(len < 0) {
+        return -1;
+    }
+    buffer[len] = '\0';
+    
+    return len;
+}
+
+int fs_size(const char* filename) {
+    mutex_lock(&fs_lock);
+    file_entry_t* f = fs_find(filename);
+    int size = f ? (int)f->size : -1;
+    mutex_unlock(&fs_lock);
+    return size;
+}
+
+int fs_delete(const char* filename) {
+    mutex_lock(&fs_lock);
+    int ret = file_delete(filename);
+    mutex_unlock(&fs_lock);
+    return ret;
+}
+
 void fs_list(void) {
     print_string("\n=== File System Contents ===\n");
-    delay(5000000);
     print_string("Filename        Size\n");
-    delay(5000000);
     print_string("--------        ----\n");
-    delay(5000000);
     
     int count = 0;
+    mutex_lock(&fs_lock);
     for(int i = 0; i < MAX_FILES; i++) {
         if(fs.files[i].used) {
             print_string(fs.files[i].name);
-            delay(5000000);
             
             int padding = 16 - strlen(fs.files[i].name);
             for(int j = 0; j < padding; j++) {
                 print_string(" ");
             }
-            delay(5000000);
             
             print_int(fs.files[i].size);
-            delay(5000000);
             print_string(" bytes\n");
-            delay(5000000);
             count++;
         }
     }
     
     if(count == 0) {
         print_string("No files found\n");
-        delay(5000000);
     }
     
+    print_int(fs.free_blocks);
+    print_string(" of ");
+    print_int(fs.total_blocks);
+    print_string(" blocks free\n");
+    mutex_unlock(&fs_lock);
+    
     print_string("============================\n");
-    delay(5000000);
 }
 
 int fs_exists(const char* filename) {
-    for(int i = 0; i < MAX_FILES; i++) {
-        if(fs.files[i].used && strcmp(fs.files[i].name, filename) == 0) {
-            return 1;
-        }
-    }
-    return 0;
+    mutex_lock(&fs_lock);
+    int exists = fs_lookup(filename) != NULL;
+    mutex_unlock(&fs_lock);
+    return exists;
 }
\ No newline at end of file
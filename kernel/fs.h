@@ -2,31 +2,80 @@
 #define FS_H
 
 #include <stdint.h>
+#include "blockdev.h"
 
-#define MAX_FILES 32
+#ifndef MAX_FILES
+#define MAX_FILES 2048 // at most 32768, name_index holds 16-bit slots
+#define FS_HASH_SLOTS 4096 // power of two, at most half full
+#endif
 #define MAX_FILENAME 32
-#define BLOCK_SIZE 512
-#define MAX_FILE_SIZE 4096
+#define FS_MAX_BLOCKS 65536 // 32 MB, larger disks are used up to this
+#define FS_MAX_EXTENTS 8
+#define MAX_FILE_SIZE (64 * 1024)
+
+// A run of contiguous data blocks
+typedef struct {
+    uint32_t start;
+    uint32_t count;
+} fs_extent_t;
 
 typedef struct {
     char name[MAX_FILENAME];
+    uint32_t name_hash;
     uint32_t size;
-    uint32_t start_block;
+    fs_extent_t extents[FS_MAX_EXTENTS];
+    uint8_t extent_count;
     uint8_t used;
 } file_entry_t;
 
+// On-disk layout: superblock, block bitmap, file table, then data
+#define FS_MAGIC 0x53464C4D // "MLFS"
+#define FS_VERSION 1
+#define FS_ENTRIES_PER_BLOCK (BLOCK_SIZE / sizeof(file_entry_t))
+#define FS_BITMAP_BLOCKS (FS_MAX_BLOCKS / (BLOCK_SIZE * 8))
+#define FS_TABLE_BLOCKS ((MAX_FILES + FS_ENTRIES_PER_BLOCK - 1) / FS_ENTRIES_PER_BLOCK)
+#define FS_SUPERBLOCK 0
+#define FS_BITMAP_START 1
+#define FS_TABLE_START (FS_BITMAP_START + FS_BITMAP_BLOCKS)
+#define FS_DATA_START (FS_TABLE_START + FS_TABLE_BLOCKS)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t total_blocks;
+    uint32_t free_blocks;
+    uint32_t max_files;
+    uint32_t data_start;
+} fs_superblock_t;
+
 typedef struct {
     file_entry_t files[MAX_FILES];
-    uint8_t block_bitmap[64]; // 64 * 8 = 512 blocks
+    uint16_t name_index[FS_HASH_SLOTS]; // open addressing, file slot or FS_SLOT_EMPTY
+    uint16_t free_files[MAX_FILES];
+    uint32_t free_file_count;
+    uint32_t block_bitmap[FS_MAX_BLOCKS / 32];
+    uint32_t total_blocks;
+    uint32_t free_blocks;
+    // Metadata blocks changed since the last fs_sync()
+    uint32_t dirty_bitmap;
+    uint32_t dirty_table[(FS_TABLE_BLOCKS + 31) / 32];
 } filesystem_t;
 
+#define FS_SLOT_EMPTY 0xFFFF
+
 // File system functions
 void fs_init(void);
 int fs_create(const char* filename);
 int fs_write(const char* filename, const char* data);
-int fs_read(const char* filename, char* buffer);
+int fs_write_at(const char* filename, uint32_t offset, const void* data, uint32_t len);
+int fs_append(const char* filename, const void* data, uint32_t len);
+int fs_read(const char* filename, char* buffer, uint32_t buffer_size);
+int fs_read_at(const char* filename, uint32_t offset, void* buffer, uint32_t len);
+int fs_truncate(const char* filename);
+int fs_size(const char* filename);
 int fs_delete(const char* filename);
+int fs_sync(void);
 void fs_list(void);
 int fs_exists(const char* filename);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,115 @@
+// kernel/gdt.c - Flat segments and the double-fault task
+#include "gdt.h"
+#include "kernel.h"
+#include "cpu.h"
+#include "kstack.h"
+
+#define DOUBLE_FAULT_STACK_SIZE 4096
+
+typedef struct {
+    uint16_t limit_low;
+    uint16_t base_low;
+    uint8_t base_mid;
+    uint8_t access;
+    uint8_t granularity;
+    uint8_t base_high;
+} __attribute__((packed)) gdt_entry_t;
+
+typedef struct {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed)) gdt_ptr_t;
+
+static gdt_entry_t gdt[GDT_ENTRIES];
+
+// The CPU saves the interrupted state here when it enters the
+// double-fault task. Application processors use cpu_tss.
+static tss_t kernel_tss;
+static tss_t cpu_tss[MAX_CPUS];
+
+// A stack overflow into a guard page faults again while pushing the
+// page fault frame. The double fault then switches to this task, which
+// has a stack of its own.
+static tss_t double_fault_tss;
+static uint8_t double_fault_stack[DOUBLE_FAULT_STACK_SIZE] __attribute__((aligned(16)));
+
+static void gdt_set_entry(int i, uint32_t base, uint32_t limit, uint8_t access, uint8_t gran) {
+    gdt[i].limit_low = limit & 0xFFFF;
+    gdt[i].base_low = base & 0xFFFF;
+    gdt[i].base_mid = (base >> 16) & 0xFF;
+    gdt[i].access = access;
+    gdt[i].granularity = ((limit >> 16) & 0x0F) | gran;
+    gdt[i].base_high = (base >> 24) & 0xFF;
+}
+
+static void gdt_load(void) {
+    gdt_ptr_t gdtr;
+    gdtr.limit = sizeof(gdt) - 1;
+    gdtr.base = (uint32_t)&gdt;
+    asm volatile ("lgdt %0" : : "m"(gdtr));
+    
+    // Reload every segment register from the new table
+    asm volatile ("ljmp %0, $1f\n"
+                  "1:\n"
+                  "mov %1, %%ax\n"
+                  "mov %%ax, %%ds\n"
+                  "mov %%ax, %%es\n"
+                  "mov %%ax, %%fs\n"
+                  "mov %%ax, %%gs\n"
+                  "mov %%ax, %%ss\n"
+                  : : "i"(GDT_KERNEL_CODE), "i"(GDT_KERNEL_DATA) : "eax", "memory");
+}
+
+static void double_fault_task(void) {
+    uint32_t addr = read_cr2();
+    
+    if (kstack_is_guard(addr)) {
+        kernel_panic("Kernel stack overflow (double fault)");
+    }
+    print_string("\n[GDT] Double fault, last page fault at ");
+    print_int(addr);
+    print_string(", EIP ");
+    print_int(kernel_tss.eip);
+    kernel_panic("Double fault");
+}
+
+void gdt_init(void) {
+    gdt_set_entry(0, 0, 0, 0, 0);
+    gdt_set_entry(1, 0, 0xFFFFF, 0x9A, 0xC0);   // ring 0 code, 4 GB
+    gdt_set_entry(2, 0, 0xFFFFF, 0x92, 0xC0);   // ring 0 data, 4 GB
+    gdt_set_entry(3, (uint32_t)&kernel_tss, sizeof(tss_t) - 1, 0x89, 0x00);
+    gdt_set_entry(4, (uint32_t)&double_fault_tss, sizeof(tss_t) - 1, 0x89, 0x00);
+    
+    double_fault_tss.eip = (uint32_t)double_fault_task;
+    double_fault_tss.esp = (uint32_t)&double_fault_stack[DOUBLE_FAULT_STACK_SIZE];
+    double_fault_tss.eflags = 0x2;     // interrupts off
+    double_fault_tss.cs = GDT_KERNEL_CODE;
+    double_fault_tss.ss = GDT_KERNEL_DATA;
+    double_fault_tss.ds = GDT_KERNEL_DATA;
+    double_fault_tss.es = GDT_KERNEL_DATA;
+    double_fault_tss.fs = GDT_KERNEL_DATA;
+    double_fault_tss.gs = GDT_SELECTOR(GDT_CPU_DATA_BASE);
+    double_fault_tss.iomap_base = sizeof(tss_t);
+    kernel_tss.iomap_base = sizeof(tss_t);
+    
+    gdt_load();
+    asm volatile ("ltr %w0" : : "r"(GDT_KERNEL_TSS));
+}
+    
+// Point %gs at this CPU's data. An application processor also switches
+// from the trampoline's table to this one and loads its own TSS.
+void gdt_init_cpu(int cpu, void* data, uint32_t size) {
+    gdt_set_entry(GDT_CPU_DATA_BASE + cpu, (uint32_t)data, size - 1, 0x92, 0x40);
+    if (cpu != 0) {
+        cpu_tss[cpu].iomap_base = sizeof(tss_t);
+        gdt_set_entry(GDT_CPU_TSS_BASE + cpu, (uint32_t)&cpu_tss[cpu], sizeof(tss_t) - 1, 0x89, 0x00);
+        gdt_load();
+        asm volatile ("ltr %w0" : : "r"(GDT_SELECTOR(GDT_CPU_TSS_BASE + cpu)));
+    }
+    asm volatile ("mov %w0, %%gs" : : "r"(GDT_SELECTOR(GDT_CPU_DATA_BASE + cpu)));
+}
+
+// The double-fault task runs on the kernel page directory
+void gdt_set_fault_cr3(uint32_t cr3) {
+    double_fault_tss.cr3 = cr3;
+}
@@ -0,0 +1,35 @@
+#ifndef GDT_H
+#define GDT_H
+
+#include <stdint.h>
+#include "cpu.h"
+
+// Segment selectors
+#define GDT_KERNEL_CODE 0x08
+#define GDT_KERNEL_DATA 0x10
+#define GDT_KERNEL_TSS  0x18
+#define GDT_DOUBLE_FAULT_TSS 0x20
+
+// Each CPU gets a data segment over its cpu_t, loaded into %gs, and the
+// application processors a TSS of their own
+#define GDT_CPU_DATA_BASE 5
+#define GDT_CPU_TSS_BASE (GDT_CPU_DATA_BASE + MAX_CPUS)
+#define GDT_ENTRIES (GDT_CPU_TSS_BASE + MAX_CPUS)
+#define GDT_SELECTOR(index) ((index) * 8)
+
+// 32-bit task state segment
+typedef struct {
+    uint32_t link;
+    uint32_t esp0, ss0, esp1, ss1, esp2, ss2;
+    uint32_t cr3, eip, eflags;
+    uint32_t eax, ecx, edx, ebx, esp, ebp, esi, edi;
+    uint32_t es, cs, ss, ds, fs, gs;
+    uint32_t ldt;
+    uint16_t trap, iomap_base;
+} __attribute__((packed)) tss_t;
+
+void gdt_init(void);
+void gdt_init_cpu(int cpu, void* data, uint32_t size);
+void gdt_set_fault_cr3(uint32_t cr3);
+
+#endif
@@ -0,0 +1,172 @@
+// kernel/idt.c - Interrupt descriptor table and 8259 PIC
+#include "idt.h"
+#include "kernel.h"
+#include "process.h"
+#include "cpu.h"
+#include "gdt.h"
+#include "smp.h"
+
+#ifndef NULL
+#define NULL ((void*)0)
+#endif
+
+#define PIC1_COMMAND 0x20
+#define PIC1_DATA    0x21
+#define PIC2_COMMAND 0xA0
+#define PIC2_DATA    0xA1
+#define PIC_EOI      0x20
+
+#define IDT_GATE_INTERRUPT 0x8E    // present, ring 0, 32-bit interrupt gate
+#define IDT_GATE_TASK      0x85    // present, ring 0, task gate
+#define EXC_DOUBLE_FAULT   8
+
+typedef struct {
+    uint16_t offset_low;
+    uint16_t selector;
+    uint8_t zero;
+    uint8_t type_attr;
+    uint16_t offset_high;
+} __attribute__((packed)) idt_entry_t;
+
+typedef struct {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed)) idt_ptr_t;
+
+extern uint32_t isr_stub_table[ISR_STUBS];
+
+static idt_entry_t idt[IDT_ENTRIES];
+static interrupt_handler_t handlers[IDT_ENTRIES];
+
+static const char* exception_names[32] = {
+    "Divide Error", "Debug", "NMI", "Breakpoint", "Overflow",
+    "Bound Range", "Invalid Opcode", "Device Not Available",
+    "Double Fault", "Coprocessor Overrun", "Invalid TSS",
+    "Segment Not Present", "Stack Fault", "General Protection",
+    "Page Fault", "Reserved", "x87 FPU Error", "Alignment Check",
+    "Machine Check", "SIMD Exception", "Virtualization", "Control Protection",
+    "Reserved", "Reserved", "Reserved", "Reserved", "Reserved", "Reserved",
+    "Reserved", "Reserved", "Security Exception", "Reserved"
+};
+
+static void idt_set_gate(uint8_t vector, uint32_t handler, uint16_t selector) {
+    idt[vector].offset_low = handler & 0xFFFF;
+    idt[vector].selector = selector;
+    idt[vector].zero = 0;
+    idt[vector].type_attr = IDT_GATE_INTERRUPT;
+    idt[vector].offset_high = (handler >> 16) & 0xFFFF;
+}
+
+// Enter a separate task with its own stack instead of a handler
+static void idt_set_task_gate(uint8_t vector, uint16_t tss_selector) {
+    idt[vector].offset_low = 0;
+    idt[vector].selector = tss_selector;
+    idt[vector].zero = 0;
+    idt[vector].type_attr = IDT_GATE_TASK;
+    idt[vector].offset_high = 0;
+}
+
+// Move the PIC vectors away from the CPU exceptions and mask every IRQ
+static void pic_remap(void) {
+    outb(PIC1_COMMAND, 0x11); io_wait();
+    outb(PIC2_COMMAND, 0x11); io_wait();
+    outb(PIC1_DATA, IRQ_BASE); io_wait();
+    outb(PIC2_DATA, IRQ_BASE + 8); io_wait();
+    outb(PIC1_DATA, 0x04); io_wait();
+    outb(PIC2_DATA, 0x02); io_wait();
+    outb(PIC1_DATA, 0x01); io_wait();
+    outb(PIC2_DATA, 0x01); io_wait();
+    
+    outb(PIC1_DATA, 0xFB);     // everything masked except the cascade
+    outb(PIC2_DATA, 0xFF);
+}
+
+void pic_unmask(uint8_t irq) {
+    uint16_t port = irq < 8 ? PIC1_DATA : PIC2_DATA;
+    outb(port, inb(port) & ~(1 << (irq % 8)));
+}
+
+void pic_mask(uint8_t irq) {
+    uint16_t port = irq < 8 ? PIC1_DATA : PIC2_DATA;
+    outb(port, inb(port) | (1 << (irq % 8)));
+}
+
+void pic_send_eoi(uint8_t irq) {
+    if (irq >= 8) {
+        outb(PIC2_COMMAND, PIC_EOI);
+    }
+    outb(PIC1_COMMAND, PIC_EOI);
+}
+
+void idt_init(void) {
+    uint16_t code_selector;
+    asm volatile ("mov %%cs, %0" : "=r"(code_selector));
+    
+    for (int i = 0; i < ISR_STUBS; i++) {
+        idt_set_gate(i, isr_stub_table[i], code_selector);
+    }
+    idt_set_task_gate(EXC_DOUBLE_FAULT, GDT_DOUBLE_FAULT_TSS);
+    
+    pic_remap();
+    idt_load();
+}
+    
+// Every CPU shares the one table
+void idt_load(void) {
+    idt_ptr_t idtr;
+    idtr.limit = sizeof(idt) - 1;
+    idtr.base = (uint32_t)&idt;
+    asm volatile ("lidt %0" : : "m"(idtr));
+}
+
+void idt_register_handler(uint8_t vector, interrupt_handler_t handler) {
+    handlers[vector] = handler;
+}
+
+void irq_register_handler(uint8_t irq, interrupt_handler_t handler) {
+    handlers[IRQ_BASE + irq] = handler;
+    pic_unmask(irq);
+}
+
+static void exception_panic(interrupt_frame_t* frame) {
+    panic_begin();
+    print_string("\n[IDT] Exception: ");
+    print_string(exception_names[frame->vector]);
+    print_string(" (vector ");
+    print_int(frame->vector);
+    print_string(", error ");
+    print_int(frame->error_code);
+    print_string(") at EIP ");
+    print_int(frame->eip);
+    print_string("\n[IDT] System halted\n");
+    
+    while (1) {
+        asm volatile ("cli; hlt");
+    }
+}
+
+// Called from isr_common with interrupts disabled. Handlers run under
+// the kernel lock like any other section with interrupts masked.
+void interrupt_dispatch(interrupt_frame_t* frame) {
+    uint32_t vector = frame->vector;
+    
+    // An unhandled exception, or the NMI smp_halt_others() sends, stops
+    // this CPU before it waits for a kernel lock that may never come free
+    if (handlers[vector] == NULL && vector < IRQ_BASE) {
+        exception_panic(frame);
+    }
+    
+    uint32_t flags = irq_save();
+    if (handlers[vector] != NULL) {
+        handlers[vector](frame);
+    }
+    
+    if (vector >= IRQ_BASE && vector < IRQ_BASE + IRQ_COUNT) {
+        pic_send_eoi(vector - IRQ_BASE);
+        process_preempt();
+    } else if (vector >= LAPIC_TIMER_VECTOR && vector < LAPIC_SPURIOUS_VECTOR) {
+        lapic_eoi();
+        process_preempt();
+    }
+    irq_restore(flags);
+}
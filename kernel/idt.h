@@ -0,0 +1,39 @@
+#ifndef IDT_H
+#define IDT_H
+
+#include <stdint.h>
+
+#define IDT_ENTRIES 256
+#define IRQ_BASE 32
+#define IRQ_COUNT 16
+
+// Vectors above the PIC's, delivered by the local APICs. Interrupt
+// stubs exist for every vector below ISR_STUBS.
+#define LAPIC_TIMER_VECTOR 48
+#define IPI_RESCHED_VECTOR 49
+#define LAPIC_SPURIOUS_VECTOR 63
+#define ISR_STUBS 64
+
+#define IRQ_TIMER 0
+#define IRQ_ATA_PRIMARY 14
+
+// Register state pushed by the interrupt stubs in kernel/interrupts.s
+typedef struct {
+    uint32_t edi, esi, ebp, esp, ebx, edx, ecx, eax;
+    uint32_t vector;
+    uint32_t error_code;
+    uint32_t eip, cs, eflags;
+} interrupt_frame_t;
+
+typedef void (*interrupt_handler_t)(interrupt_frame_t* frame);
+
+void idt_init(void);
+void idt_load(void);
+void idt_register_handler(uint8_t vector, interrupt_handler_t handler);
+void irq_register_handler(uint8_t irq, interrupt_handler_t handler);
+void pic_unmask(uint8_t irq);
+void pic_mask(uint8_t irq);
+void pic_send_eoi(uint8_t irq);
+void interrupt_dispatch(interrupt_frame_t* frame);
+
+#endif
@@ -4,40 +4,97 @@
 #include "fs.h"
 #include "shell.h"
 #include "string.h"
+#include "idt.h"
+#include "timer.h"
+#include "cpu.h"
+#include "klog.h"
+#include "pmm.h"
+#include "kmalloc.h"
+#include "gdt.h"
+#include "paging.h"
+#include "serial.h"
+#include "bench.h"
+#include "smp.h"
 
 // VGA Text Buffer
 volatile uint16_t* vga_buffer = (uint16_t*)0xB8000;
 
+#define VGA_CRTC_INDEX 0x3D4
+#define VGA_CRTC_DATA  0x3D5
+#define VGA_ALL_ROWS   ((1u << VGA_HEIGHT) - 1)
+
 // Terminal state
 int terminal_row;
 int terminal_col;
 uint8_t terminal_color;
 
-void terminal_initialize(void) {
-    terminal_row = 0;
-    terminal_col = 0;
-    terminal_color = ((COLOR_BLACK << 4) | COLOR_WHITE);
+// RAM copy of the screen. Rows are stored circularly starting at
+// shadow_top, so scrolling only moves the index. Rows that changed since
+// the last flush are tracked per screen line in dirty_rows.
+static uint16_t shadow[VGA_HEIGHT][VGA_WIDTH] __attribute__((aligned(16)));
+static int shadow_top;
+static uint32_t dirty_rows;
+
+static inline uint16_t vga_entry(char c, uint8_t color) {
+    return (uint16_t)(unsigned char)c | (uint16_t)(color << 8);
+}
+
+static inline uint16_t* shadow_row(int row) {
+    int index = shadow_top + row;
+    if (index >= VGA_HEIGHT) index -= VGA_HEIGHT;
+    return shadow[index];
+}
+
+static void shadow_clear_row(uint16_t* row) {
+    uint32_t blank = vga_entry(' ', terminal_color);
+    blank |= blank << 16;
+    uint32_t* cells = (uint32_t*)row;
+    for (int x = 0; x < VGA_WIDTH / 2; x++) {
+        cells[x] = blank;
+    }
+}
+
+static void console_update_cursor(void) {
+    uint16_t pos = terminal_row * VGA_WIDTH + terminal_col;
+    outb(VGA_CRTC_INDEX, 0x0F);
+    outb(VGA_CRTC_DATA, pos & 0xFF);
+    outb(VGA_CRTC_INDEX, 0x0E);
+    outb(VGA_CRTC_DATA, (pos >> 8) & 0xFF);
+}
+
+// Copy dirty rows to VGA memory two cells at a time
+static void console_flush(void) {
+    uint32_t rows = dirty_rows;
+    dirty_rows = 0;
     
-    // Clear screen
-    for (int y = 0; y < VGA_HEIGHT; y++) {
-        for (int x = 0; x < VGA_WIDTH; x++) {
-            const size_t index = y * VGA_WIDTH + x;
-            vga_buffer[index] = (uint16_t)' ' | (uint16_t)(terminal_color << 8);
+    while (rows != 0) {
+        int y = bit_scan_forward(rows);
+        rows &= rows - 1;
+        
+        const uint32_t* src = (const uint32_t*)shadow_row(y);
+        volatile uint32_t* dst = (volatile uint32_t*)&vga_buffer[y * VGA_WIDTH];
+        for (int x = 0; x < VGA_WIDTH / 2; x++) {
+            dst[x] = src[x];
         }
     }
+    
+    console_update_cursor();
 }
 
-void terminal_setcolor(uint8_t color) {
-    terminal_color = color;
+static void console_scroll(void) {
+    shadow_clear_row(shadow[shadow_top]);
+    shadow_top = shadow_top + 1 == VGA_HEIGHT ? 0 : shadow_top + 1;
+    terminal_row = VGA_HEIGHT - 1;
+    dirty_rows = VGA_ALL_ROWS;
 }
 
-void print_char(char c) {
+static void console_putc(char c) {
     if (c == '\n') {
         terminal_col = 0;
         terminal_row++;
     } else {
-        const size_t index = terminal_row * VGA_WIDTH + terminal_col;
-        vga_buffer[index] = (uint16_t)c | (uint16_t)(terminal_color << 8);
+        shadow_row(terminal_row)[terminal_col] = vga_entry(c, terminal_color);
+        dirty_rows |= 1u << terminal_row;
         terminal_col++;
     }
 
@@ -46,48 +103,125 @@ void print_char(char c) {
         terminal_row++;
     }
     
-    // Proper scroll when at bottom
     if (terminal_row >= VGA_HEIGHT) {
-        for (int y = 0; y < VGA_HEIGHT-1; y++) {
-            for (int x = 0; x < VGA_WIDTH; x++) {
-                vga_buffer[y * VGA_WIDTH + x] = vga_buffer[(y+1) * VGA_WIDTH + x];
-            }
-        }
-        // Clear the last line
-        for (int x = 0; x < VGA_WIDTH; x++) {
-            vga_buffer[(VGA_HEIGHT-1) * VGA_WIDTH + x] = (uint16_t)' ' | (uint16_t)(terminal_color << 8);
-        }
-        terminal_row = VGA_HEIGHT - 1;
+        console_scroll();
     }
 }
 
-void print_string(const char* str) {
-    for (size_t i = 0; str[i] != '\0'; i++) {
-        print_char(str[i]);
+void terminal_initialize(void) {
+    terminal_row = 0;
+    terminal_col = 0;
+    terminal_color = ((COLOR_BLACK << 4) | COLOR_WHITE);
+    shadow_top = 0;
+    
+    // Clear screen
+    for (int y = 0; y < VGA_HEIGHT; y++) {
+        shadow_clear_row(shadow[y]);
     }
+    dirty_rows = VGA_ALL_ROWS;
+    console_flush();
 }
 
-void print_int(int num) {
-    if (num == 0) {
-        print_char('0');
+void terminal_setcolor(uint8_t color) {
+    terminal_color = color;
+}
+
+static void vga_console_write(const char* str, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) {
+        console_putc(str[i]);
+    }
+    console_flush();
+}
+
+// Every print_* call goes to each enabled sink in turn
+static console_write_t console_sinks[CONSOLE_SINKS] = { vga_console_write };
+static uint32_t console_mask = 1u << CONSOLE_SINK_VGA;
+
+void console_register_sink(int sink, console_write_t write) {
+    console_sinks[sink] = write;
+}
+
+void console_enable_sink(int sink, int enabled) {
+    uint32_t flags = irq_save();
+    if (enabled) {
+        console_mask |= 1u << sink;
+    } else {
+        console_mask &= ~(1u << sink);
+    }
+    irq_restore(flags);
+}
+
+int console_sink_enabled(int sink) {
+    return (console_mask >> sink) & 1;
+}
+
+// Set by the first CPU to panic. From then on console output skips the
+// kernel lock, which the CPU that went wrong may never release.
+static volatile uint32_t kernel_panicked;
+
+static void panic_write(const char* str, uint32_t len) {
+    if (console_mask & (1u << CONSOLE_SINK_VGA)) {
+        vga_console_write(str, len);
+    }
+    if (console_mask & (1u << CONSOLE_SINK_SERIAL)) {
+        serial_panic_write(str, len);
+    }
+}
+
+static void console_write(const char* str, uint32_t len) {
+    if (kernel_panicked) {
+        panic_write(str, len);
         return;
     }
     
-    if (num < 0) {
-        print_char('-');
-        num = -num;
+    uint32_t flags = irq_save();
+    for (int i = 0; i < CONSOLE_SINKS; i++) {
+        if ((console_mask & (1u << i)) && console_sinks[i] != NULL) {
+            console_sinks[i](str, len);
+        }
     }
+    irq_restore(flags);
+}
+
+void print_char(char c) {
+    console_write(&c, 1);
+}
+
+void print_string(const char* str) {
+    console_write(str, strlen(str));
+}
+
+void print_uint(unsigned int value) {
+    char buffer[16];
+    int i = sizeof(buffer) - 1;
+    buffer[i] = '\0';
     
-    char buffer[32];
-    int i = 0;
+    do {
+        buffer[--i] = '0' + (value % 10);
+        value /= 10;
+    } while (value > 0);
     
-    while (num > 0) {
-        buffer[i++] = '0' + (num % 10);
-        num /= 10;
+    print_string(&buffer[i]);
+}
+
+// print_uint padded with spaces to width columns, for tables
+void print_col(unsigned int value, int width) {
+    int digits = 1;
+    for (unsigned int v = value; v >= 10; v /= 10) {
+        digits++;
     }
-    
-    for (int j = i - 1; j >= 0; j--) {
-        print_char(buffer[j]);
+    print_uint(value);
+    while (digits++ < width) {
+        print_char(' ');
+    }
+}
+
+void print_int(int num) {
+    if (num < 0) {
+        print_char('-');
+        print_uint(-(unsigned int)num);
+    } else {
+        print_uint(num);
     }
 }
 
@@ -107,48 +241,91 @@ void print_float(float num) {
     }
 }
 
-void clear_screen(void) {
-    terminal_initialize();
+// Stop the other CPUs and take the console for the panic report. A CPU
+// that panics second, or gets the halt NMI, stops here for good.
+void panic_begin(void) {
+    interrupts_disable();
+    if (__sync_lock_test_and_set(&kernel_panicked, 1)) {
+        while (1) {
+            asm volatile ("cli; hlt");
+        }
+    }
+    smp_halt_others();
 }
 
-// Utility Functions
-
-void memcpy(void* dest, const void* src, size_t n) {
-    char* d = (char*)dest;
-    const char* s = (const char*)src;
-    for (size_t i = 0; i < n; i++) {
-        d[i] = s[i];
+void kernel_panic(const char* message) {
+    panic_begin();
+    print_string("\n[PANIC] ");
+    print_string(message);
+    print_string("\n[PANIC] System halted\n");
+    
+    while (1) {
+        asm volatile ("cli; hlt");
     }
 }
 
-void memset(void* dest, int val, size_t n) {
-    char* d = (char*)dest;
-    for (size_t i = 0; i < n; i++) {
-        d[i] = (char)val;
+// VGA starts over at the top; a serial terminal is sent the ANSI clear
+void clear_screen(void) {
+    terminal_initialize();
+    if (console_sink_enabled(CONSOLE_SINK_SERIAL) && console_sinks[CONSOLE_SINK_SERIAL] != NULL) {
+        console_sinks[CONSOLE_SINK_SERIAL]("\033[H\033[2J", 7);
     }
 }
 
-
-void kernel_main(void) {
+void kernel_main(uint32_t magic, multiboot_info_t* mbi) {
+    uint64_t boot_start = rdtsc();
+    // irq_save() finds the kernel lock depth through %gs, so the per-CPU
+    // segment comes first
+    gdt_init();
+    smp_init_bsp();
+    string_init();
     terminal_initialize();
+    klog_init();
+    klog(KLOG_INFO, KLOG_KERNEL, "memcpy/memset: %s", string_impl_name());
+    idt_init();
+    serial_init();
+    pmm_init(magic, mbi);
+    kmalloc_init();
+    smp_detect();
 
     print_string("Mini OS: Bootloader+Kernel+Process+ML+FS+Shell\n");
     print_string("===============================================\n\n");
 
     // Initialize quietly
+    paging_init();
     process_init();
     ml_scheduler_init();
     fs_init();
+    timer_init();
+    smp_boot_aps();
+    
+#ifdef BENCH_MODE
+    // Headless benchmark kernel: run the suite, report over serial and
+    // leave QEMU with the self-test result as the exit status
+    interrupts_enable();
+    int failures = bench_suite();
+    klog_drain();
+    serial_flush();
+    outb(QEMU_DEBUG_EXIT_PORT, failures ? 1 : 0);
+    kernel_panic("isa-debug-exit not present");
+#endif
     
     // Create demo processes
     init_demo_processes();
 
+    klog(KLOG_INFO, KLOG_KERNEL, "Boot to shell: %u Mcycles",
+         (uint32_t)div64_u32(rdtsc() - boot_start, 1000000));
+    klog_drain();
     print_string("System Ready. Starting Shell Demo...\n\n");
     
     // Start shell
     shell_start();
 
+    // Become the idle process and let the timer preempt the demo processes
+    interrupts_enable();
     while(1) {
+        process_yield();
+        klog_drain();
         asm volatile ("hlt");
     }
 }
\ No newline at end of file
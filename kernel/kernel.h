@@ -3,7 +3,11 @@
 
 #include <stdint.h>
 
+#ifdef HOSTED
+#include <stddef.h>
+#else
 typedef unsigned int size_t;
+#endif
 
 #define VGA_WIDTH 80
 #define VGA_HEIGHT 25
@@ -29,16 +33,31 @@ enum vga_color {
 
 // Process management
 #include "process.h"
+#include "multiboot.h"
+
+// Console output sinks
+#define CONSOLE_SINK_VGA 0
+#define CONSOLE_SINK_SERIAL 1
+#define CONSOLE_SINKS 4
+
+typedef void (*console_write_t)(const char* str, uint32_t len);
 
 // Function declarations
-void kernel_main(void);
+void kernel_main(uint32_t magic, multiboot_info_t* mbi);
 void print_string(const char* str);
 void print_char(char c);
 void print_int(int num);
+void print_uint(unsigned int value);
+void print_col(unsigned int value, int width);
 void print_float(float num);
 void clear_screen(void);
+void kernel_panic(const char* message);
+void panic_begin(void);
 void terminal_initialize(void);
 void terminal_setcolor(uint8_t color);
+void console_register_sink(int sink, console_write_t write);
+void console_enable_sink(int sink, int enabled);
+int console_sink_enabled(int sink);
 void memcpy(void* dest, const void* src, size_t n);
 void memset(void* dest, int val, size_t n);
 // Demo processes
@@ -47,7 +66,7 @@ void init_demo_processes(void);
 // ML Scheduler functions
 void ml_scheduler_init(void);
 void ml_schedule(void);
-void ml_update_process_features(int pid, int process_type);
+void ml_update_process_features(pcb_t* pcb, int process_type);
 void print_ml_scheduler_stats(void);
 
 #endif
\ No newline at end of file
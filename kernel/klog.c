@@ -0,0 +1,203 @@
+// kernel/klog.c - Kernel log ring buffer
+#include "klog.h"
+#include "kernel.h"
+#include "timer.h"
+#include "cpu.h"
+#include <stdarg.h>
+
+// Nops per paced console line, the old hardwired demo delay
+#define KLOG_PACE_CYCLES 5000000
+
+static klog_record_t klog_ring[KLOG_RECORDS];
+static uint32_t klog_next_seq = 0;      // sequence of the next record written
+static uint32_t klog_console_seq = 0;   // next record the console has not seen
+static uint32_t klog_dropped = 0;       // overwritten before reaching the console
+static klog_level_t console_level = KLOG_INFO;
+static int klog_pacing = 0;
+
+static const char* level_names[] = { "ERR", "WARN", "INFO", "DEBUG" };
+static const char* subsys_names[KLOG_SUBSYSTEMS] = {
+    "KERNEL", "PROCESS", "SCHED", "ML", "FS", "SHELL", "TIMER", "DISK", "MEM"
+};
+
+// Minimal formatter: %s %c %d %u %x %% with an optional zero-pad width
+static int klog_format(char* out, int size, const char* fmt, va_list args) {
+    int pos = 0;
+    
+    for (; *fmt && pos < size - 1; fmt++) {
+        if (*fmt != '%') {
+            out[pos++] = *fmt;
+            continue;
+        }
+        fmt++;
+        
+        int pad_zero = 0, width = 0;
+        if (*fmt == '0') {
+            pad_zero = 1;
+            fmt++;
+        }
+        while (*fmt >= '0' && *fmt <= '9') {
+            width = width * 10 + (*fmt++ - '0');
+        }
+        
+        char digits[12];
+        int len = 0, negative = 0;
+        const char* str = digits;
+        
+        switch (*fmt) {
+            case 's':
+                str = va_arg(args, const char*);
+                if (str == 0) str = "(null)";
+                while (str[len]) len++;
+                break;
+            case 'c':
+                digits[0] = (char)va_arg(args, int);
+                len = 1;
+                break;
+            case 'd':
+            case 'u':
+            case 'x': {
+                uint32_t value;
+                uint32_t base = *fmt == 'x' ? 16 : 10;
+                if (*fmt == 'd') {
+                    int32_t v = va_arg(args, int32_t);
+                    negative = v < 0;
+                    value = negative ? (uint32_t)-v : (uint32_t)v;
+                } else {
+                    value = va_arg(args, uint32_t);
+                }
+                char tmp[12];
+                int n = 0;
+                do {
+                    tmp[n++] = "0123456789abcdef"[value % base];
+                    value /= base;
+                } while (value);
+                if (negative) digits[len++] = '-';
+                for (int k = n; k < width - negative; k++) {
+                    digits[len++] = pad_zero ? '0' : ' ';
+                }
+                while (n > 0) digits[len++] = tmp[--n];
+                break;
+            }
+            case '%':
+                digits[0] = '%';
+                len = 1;
+                break;
+            default:
+                digits[0] = '?';
+                len = 1;
+                break;
+        }
+        
+        for (int k = 0; k < len && pos < size - 1; k++) {
+            out[pos++] = str[k];
+        }
+    }
+    
+    out[pos] = '\0';
+    return pos;
+}
+
+void klog_init(void) {
+    klog_next_seq = 0;
+    klog_console_seq = 0;
+    klog_dropped = 0;
+}
+
+void klog(klog_level_t level, klog_subsys_t subsys, const char* fmt, ...) {
+    uint32_t flags = irq_save();
+    
+    klog_record_t* rec = &klog_ring[klog_next_seq % KLOG_RECORDS];
+    rec->seq = klog_next_seq++;
+    rec->tick = timer_ticks;
+    rec->level = level;
+    rec->subsys = subsys;
+    
+    va_list args;
+    va_start(args, fmt);
+    klog_format(rec->msg, KLOG_MSG_LEN, fmt, args);
+    va_end(args);
+    
+    // The console fell a whole ring behind, skip what was overwritten
+    if (klog_next_seq - klog_console_seq > KLOG_RECORDS) {
+        klog_dropped += klog_next_seq - klog_console_seq - KLOG_RECORDS;
+        klog_console_seq = klog_next_seq - KLOG_RECORDS;
+    }
+    
+    irq_restore(flags);
+}
+
+static void klog_print_record(const klog_record_t* rec) {
+    print_string("[");
+    print_string(subsys_names[rec->subsys]);
+    if (rec->level != KLOG_INFO) {
+        print_string(" ");
+        print_string(level_names[rec->level]);
+    }
+    print_string("] ");
+    print_string(rec->msg);
+    print_string("\n");
+}
+
+// Print records the console has not shown yet. Runs in process context,
+// never from an interrupt handler.
+void klog_drain(void) {
+    while (1) {
+        klog_record_t rec;
+        uint32_t flags = irq_save();
+        if (klog_console_seq == klog_next_seq) {
+            irq_restore(flags);
+            break;
+        }
+        rec = klog_ring[klog_console_seq % KLOG_RECORDS];
+        klog_console_seq++;
+        irq_restore(flags);
+        
+        if (rec.level <= console_level) {
+            klog_print_record(&rec);
+            klog_pace();
+        }
+    }
+}
+
+// dmesg: every record still in the ring, regardless of console level
+void klog_dump(void) {
+    uint32_t flags = irq_save();
+    uint32_t end = klog_next_seq;
+    uint32_t start = end > KLOG_RECORDS ? end - KLOG_RECORDS : 0;
+    irq_restore(flags);
+    
+    for (uint32_t seq = start; seq < end; seq++) {
+        klog_record_t rec = klog_ring[seq % KLOG_RECORDS];
+        if (rec.seq != seq) continue;   // overwritten while printing
+        
+        print_int(rec.tick);
+        print_string(" ");
+        klog_print_record(&rec);
+    }
+    
+    if (klog_dropped > 0) {
+        print_int(klog_dropped);
+        print_string(" records never reached the console\n");
+    }
+}
+
+void klog_set_console_level(klog_level_t level) {
+    console_level = level;
+}
+
+void klog_set_pacing(int enabled) {
+    klog_pacing = enabled;
+}
+
+int klog_get_pacing(void) {
+    return klog_pacing;
+}
+
+// Demo mode: slow console output down so it can be followed by eye
+void klog_pace(void) {
+    if (!klog_pacing) return;
+    for (int i = 0; i < KLOG_PACE_CYCLES; i++) {
+        asm volatile ("nop");
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef KLOG_H
+#define KLOG_H
+
+#include <stdint.h>
+
+#define KLOG_RECORDS 256
+#define KLOG_MSG_LEN 80
+
+typedef enum {
+    KLOG_ERR,
+    KLOG_WARN,
+    KLOG_INFO,
+    KLOG_DEBUG
+} klog_level_t;
+
+typedef enum {
+    KLOG_KERNEL,
+    KLOG_PROC,
+    KLOG_SCHED,
+    KLOG_ML,
+    KLOG_FS,
+    KLOG_SHELL,
+    KLOG_TIMER,
+    KLOG_DISK,
+    KLOG_MEM,
+    KLOG_SUBSYSTEMS
+} klog_subsys_t;
+
+// One log line, stored in a ring and printed later by klog_drain()
+typedef struct {
+    uint32_t seq;
+    uint32_t tick;
+    uint8_t level;
+    uint8_t subsys;
+    char msg[KLOG_MSG_LEN];
+} klog_record_t;
+
+void klog_init(void);
+void klog(klog_level_t level, klog_subsys_t subsys, const char* fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+void klog_drain(void);
+void klog_dump(void);
+void klog_set_console_level(klog_level_t level);
+void klog_set_pacing(int enabled);
+int klog_get_pacing(void);
+void klog_pace(void);
+
+#endif
@@ -0,0 +1,179 @@
+// kernel/kmalloc.c - Slab caches and size-class kmalloc on top of the page allocator
+#include "kmalloc.h"
+#include "pmm.h"
+#include "kernel.h"
+#include "string.h"
+#include "cpu.h"
+#include "klog.h"
+
+static kmem_cache_t caches[KMEM_MAX_CACHES];
+static int cache_count;
+
+// Power-of-two classes from 16 bytes to KMALLOC_MAX_SLAB_SIZE
+#define KMALLOC_CLASSES 7
+static kmem_cache_t* size_classes[KMALLOC_CLASSES];
+static const char* size_class_names[KMALLOC_CLASSES] = {
+    "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+    "kmalloc-256", "kmalloc-512", "kmalloc-1024"
+};
+
+static uint32_t large_pages;
+
+static void freelist_push_chain(kmem_cache_t* cache, void* first, void* last) {
+    kmem_freelist_t old, new;
+    do {
+        old.raw = cache->freelist.raw;
+        *(void**)last = old.head;
+        new.head = first;
+        new.tag = old.tag + 1;
+    } while (!cmpxchg8b(&cache->freelist.raw, old.raw, new.raw));
+}
+
+// Slab pages are never returned, so reading the next pointer of a head
+// that another CPU just popped is harmless: the cmpxchg8b then fails
+static void* freelist_pop(kmem_cache_t* cache) {
+    kmem_freelist_t old, new;
+    do {
+        old.raw = cache->freelist.raw;
+        if (!old.head) {
+            return 0;
+        }
+        new.head = *(void**)old.head;
+        new.tag = old.tag + 1;
+    } while (!cmpxchg8b(&cache->freelist.raw, old.raw, new.raw));
+    return old.head;
+}
+
+// Slow path: carve a fresh page into objects and push them all at once
+static int cache_grow(kmem_cache_t* cache) {
+    uint32_t page = pmm_alloc_page();
+    if (!page) {
+        return -1;
+    }
+    
+    kmem_slab_t* slab = (kmem_slab_t*)page;
+    slab->magic = KMEM_SLAB_MAGIC;
+    slab->cache = cache;
+    slab->pages = 1;
+    
+    uint8_t* first = (uint8_t*)page + KMEM_SLAB_HEADER;
+    uint8_t* obj = first;
+    for (uint32_t i = 0; i + 1 < cache->objects_per_slab; i++) {
+        *(void**)obj = obj + cache->object_size;
+        obj += cache->object_size;
+    }
+    
+    freelist_push_chain(cache, first, obj);
+    __sync_fetch_and_add(&cache->slabs, 1);
+    return 0;
+}
+
+kmem_cache_t* kmem_cache_create(const char* name, uint32_t object_size) {
+    if (cache_count >= KMEM_MAX_CACHES || object_size > KMALLOC_MAX_SLAB_SIZE) {
+        klog(KLOG_ERR, KLOG_MEM, "Cannot create cache %s", name);
+        return 0;
+    }
+    
+    kmem_cache_t* cache = &caches[cache_count++];
+    memset(cache, 0, sizeof(*cache));
+    cache->name = name;
+    cache->object_size = object_size < sizeof(void*) ? sizeof(void*) : (object_size + 7) & ~7u;
+    cache->objects_per_slab = (PAGE_SIZE - KMEM_SLAB_HEADER) / cache->object_size;
+    return cache;
+}
+
+void* kmem_cache_alloc(kmem_cache_t* cache) {
+    void* obj;
+    
+    while (!(obj = freelist_pop(cache))) {
+        if (cache_grow(cache) < 0) {
+            klog(KLOG_ERR, KLOG_MEM, "%s: out of memory", cache->name);
+            return 0;
+        }
+    }
+    __sync_fetch_and_add(&cache->allocs, 1);
+    return obj;
+}
+
+void kmem_cache_free(kmem_cache_t* cache, void* obj) {
+    freelist_push_chain(cache, obj, obj);
+    __sync_fetch_and_add(&cache->frees, 1);
+}
+
+void kmalloc_init(void) {
+    cache_count = 0;
+    for (int i = 0; i < KMALLOC_CLASSES; i++) {
+        size_classes[i] = kmem_cache_create(size_class_names[i], 16u << i);
+    }
+}
+
+void* kmalloc(size_t size) {
+    if (size <= KMALLOC_MAX_SLAB_SIZE) {
+        int index = size <= 16 ? 0 : 32 - __builtin_clz(size - 1) - 4;
+        return kmem_cache_alloc(size_classes[index]);
+    }
+    
+    uint32_t pages = (size + KMEM_SLAB_HEADER + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint32_t page = pmm_alloc_pages(pages);
+    if (!page) {
+        return 0;
+    }
+    
+    kmem_slab_t* header = (kmem_slab_t*)page;
+    header->magic = KMEM_LARGE_MAGIC;
+    header->cache = 0;
+    header->pages = pages;
+    __sync_fetch_and_add(&large_pages, pages);
+    return (uint8_t*)page + KMEM_SLAB_HEADER;
+}
+
+void* kzalloc(size_t size) {
+    void* ptr = kmalloc(size);
+    if (ptr) {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+void kfree(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    
+    kmem_slab_t* slab = (kmem_slab_t*)((uint32_t)ptr & ~(PAGE_SIZE - 1));
+    if (slab->magic == KMEM_SLAB_MAGIC) {
+        kmem_cache_free(slab->cache, ptr);
+    } else if (slab->magic == KMEM_LARGE_MAGIC) {
+        __sync_fetch_and_sub(&large_pages, slab->pages);
+        slab->magic = 0;
+        pmm_free_pages((uint32_t)slab, slab->pages);
+    } else {
+        klog(KLOG_ERR, KLOG_MEM, "kfree of unknown pointer %x", (uint32_t)ptr);
+    }
+}
+
+void kmalloc_print_stats(void) {
+    print_string("\n=== Memory ===\n");
+    pmm_print_stats();
+    print_string("Cache          Size  Slabs  In use  Allocs\n");
+    
+    for (int i = 0; i < cache_count; i++) {
+        kmem_cache_t* c = &caches[i];
+        print_string(c->name);
+        for (int pad = strlen(c->name); pad < 15; pad++) {
+            print_string(" ");
+        }
+        print_int(c->object_size);
+        print_string("  ");
+        print_int(c->slabs);
+        print_string("  ");
+        print_int(c->allocs - c->frees);
+        print_string("  ");
+        print_int(c->allocs);
+        print_string("\n");
+    }
+    print_string("Large allocations: ");
+    print_int(large_pages);
+    print_string(" pages\n");
+    print_string("==============\n");
+}
@@ -0,0 +1,57 @@
+#ifndef KMALLOC_H
+#define KMALLOC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define KMEM_SLAB_MAGIC 0x51AB51AB
+#define KMEM_LARGE_MAGIC 0x1A46E000
+#define KMEM_SLAB_HEADER 16
+#define KMEM_MAX_CACHES 24
+#define KMALLOC_MAX_SLAB_SIZE 1024 // larger requests get whole pages
+
+// Free objects form a singly linked list through their first word. The
+// head is paired with a tag bumped on every change, and both are swapped
+// together with cmpxchg8b, so a pop cannot succeed against a head that was
+// popped and pushed back in the meantime (ABA).
+typedef union {
+#ifdef HOSTED
+    unsigned __int128 raw;
+#else
+    uint64_t raw;
+#endif
+    struct {
+        void* head;
+        uint32_t tag;
+    };
+} kmem_freelist_t;
+
+typedef struct {
+    const char* name;
+    uint32_t object_size;
+    uint32_t objects_per_slab;
+    volatile kmem_freelist_t freelist;
+    uint32_t slabs;
+    uint32_t allocs;
+    uint32_t frees;
+} kmem_cache_t;
+
+// Every slab is one page starting with this header, so kfree() finds the
+// cache of any object by rounding its address down
+typedef struct {
+    uint32_t magic;
+    kmem_cache_t* cache;
+    uint32_t pages; // large allocations only
+    uint32_t reserved;
+} kmem_slab_t;
+
+void kmalloc_init(void);
+kmem_cache_t* kmem_cache_create(const char* name, uint32_t object_size);
+void* kmem_cache_alloc(kmem_cache_t* cache);
+void kmem_cache_free(kmem_cache_t* cache, void* obj);
+void* kmalloc(size_t size);
+void* kzalloc(size_t size);
+void kfree(void* ptr);
+void kmalloc_print_stats(void);
+
+#endif
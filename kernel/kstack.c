@@ -0,0 +1,111 @@
+// kernel/kstack.c - Pooled kernel stacks with guard pages
+#include "kstack.h"
+#include "kernel.h"
+#include "cpu.h"
+
+// Free stacks are linked through their top word and stay mapped; they
+// are not zeroed when reused
+static uint32_t pool_head;
+
+// Window slots that have no stack mapped
+static uint16_t free_slots[KSTACK_SLOTS];
+static uint32_t free_slot_count;
+static uint32_t next_slot; // slots at and above this were never used
+
+kstack_stats_t kstack_stats;
+
+static uint32_t slot_base(uint32_t slot) {
+    return KERNEL_WINDOW_BASE + slot * KSTACK_SLOT_SIZE;
+}
+
+// Unmap the stack pages of a slot, the guard page is never mapped
+static void unmap_stack(uint32_t base, uint32_t pages) {
+    for (uint32_t i = 0; i < pages; i++) {
+        uint32_t virt = base + (KSTACK_GUARD_PAGES + i) * PAGE_SIZE;
+        pmm_free_pages(paging_unmap(kernel_page_dir, virt), 1);
+    }
+}
+
+// Returns the top of a STACK_SIZE stack, or 0 when memory is exhausted
+uint32_t kstack_alloc(void) {
+    uint32_t flags = irq_save();
+    kstack_stats.allocs++;
+    
+    if (pool_head) {
+        uint32_t top = pool_head;
+        pool_head = *(uint32_t*)(top - 4);
+        kstack_stats.pool_size--;
+        kstack_stats.pool_hits++;
+        irq_restore(flags);
+        return top;
+    }
+    
+    uint32_t slot;
+    if (free_slot_count > 0) {
+        slot = free_slots[--free_slot_count];
+    } else if (next_slot < KSTACK_SLOTS) {
+        slot = next_slot++;
+    } else {
+        irq_restore(flags);
+        return 0;
+    }
+    irq_restore(flags);
+    
+    uint32_t base = slot_base(slot);
+    for (uint32_t i = 0; i < KSTACK_PAGES; i++) {
+        uint32_t frame = pmm_alloc_page();
+        uint32_t virt = base + (KSTACK_GUARD_PAGES + i) * PAGE_SIZE;
+        if (!frame || paging_map(kernel_page_dir, virt, frame, PAGE_WRITE) < 0) {
+            if (frame) pmm_free_pages(frame, 1);
+            unmap_stack(base, i);
+            flags = irq_save();
+            free_slots[free_slot_count++] = slot;
+            irq_restore(flags);
+            return 0;
+        }
+    }
+    return base + KSTACK_SLOT_SIZE;
+}
+
+void kstack_free(uint32_t stack_top) {
+    uint32_t flags = irq_save();
+    kstack_stats.frees++;
+    
+    if (kstack_stats.pool_size < KSTACK_POOL_MAX) {
+        *(uint32_t*)(stack_top - 4) = pool_head;
+        pool_head = stack_top;
+        kstack_stats.pool_size++;
+        irq_restore(flags);
+        return;
+    }
+    irq_restore(flags);
+    
+    uint32_t base = stack_top - KSTACK_SLOT_SIZE;
+    unmap_stack(base, KSTACK_PAGES);
+    
+    flags = irq_save();
+    free_slots[free_slot_count++] = (base - KERNEL_WINDOW_BASE) / KSTACK_SLOT_SIZE;
+    irq_restore(flags);
+}
+
+// Whether addr falls in the guard page below some kernel stack
+int kstack_is_guard(uint32_t addr) {
+    if (addr < KERNEL_WINDOW_BASE || addr >= slot_base(next_slot)) {
+        return 0;
+    }
+    return (addr - KERNEL_WINDOW_BASE) % KSTACK_SLOT_SIZE < KSTACK_GUARD_PAGES * PAGE_SIZE;
+}
+
+void kstack_print_stats(void) {
+    print_string("Kernel stacks: ");
+    print_int(kstack_stats.allocs);
+    print_string(" allocs (");
+    print_int(kstack_stats.pool_hits);
+    print_string(" from pool), ");
+    print_int(kstack_stats.frees);
+    print_string(" frees, ");
+    print_int(kstack_stats.pool_size);
+    print_string(" pooled, ");
+    print_int(kstack_stats.overflows);
+    print_string(" overflows\n");
+}
@@ -0,0 +1,32 @@
+#ifndef KSTACK_H
+#define KSTACK_H
+
+#include <stdint.h>
+#include "process.h"
+#include "paging.h"
+
+// Kernel stacks live in the shared kernel window. Each slot is an
+// unmapped guard page followed by the stack, so running off the bottom
+// of a stack faults instead of overwriting its neighbour.
+#define KSTACK_GUARD_PAGES 1
+#define KSTACK_PAGES (STACK_SIZE / PAGE_SIZE)
+#define KSTACK_SLOT_SIZE ((KSTACK_GUARD_PAGES + KSTACK_PAGES) * PAGE_SIZE)
+#define KSTACK_SLOTS (KERNEL_WINDOW_SIZE / KSTACK_SLOT_SIZE)
+#define KSTACK_POOL_MAX 64 // free stacks kept mapped for reuse
+
+typedef struct {
+    uint32_t allocs;
+    uint32_t pool_hits;
+    uint32_t frees;
+    uint32_t pool_size;
+    uint32_t overflows;
+} kstack_stats_t;
+
+extern kstack_stats_t kstack_stats;
+
+uint32_t kstack_alloc(void);
+void kstack_free(uint32_t stack_top);
+int kstack_is_guard(uint32_t addr);
+void kstack_print_stats(void);
+
+#endif
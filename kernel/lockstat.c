@@ -0,0 +1,80 @@
+// kernel/lockstat.c - Lock contention profiler behind the locks command
+#include "lockstat.h"
+#include "kernel.h"
+#include "cpu.h"
+#include "timer.h"
+#include "string.h"
+#include <stddef.h>
+
+// Every profiled lock that has been taken at least once. Locks are never
+// removed, so the list is only ever pushed to.
+static lock_stats_t* volatile lock_registry;
+
+// Lock-free, because the registering lock may be the kernel lock itself
+void lock_stats_register(lock_stats_t* stats) {
+    if (__sync_lock_test_and_set(&stats->registered, 1)) return;
+    
+    lock_stats_t* head;
+    do {
+        head = lock_registry;
+        stats->next = head;
+    } while (!__sync_bool_compare_and_swap(&lock_registry, head, stats));
+}
+
+// The counters are cleared without their locks, so an acquire racing
+// with the reset may survive it
+void lock_stats_reset(void) {
+    for (lock_stats_t* s = lock_registry; s != NULL; s = s->next) {
+        s->acquires = 0;
+        s->contended = 0;
+        s->wait_cycles = 0;
+        s->max_wait_cycles = 0;
+    }
+}
+
+static uint32_t cycles_to_us(uint64_t cycles) {
+    uint32_t khz = timer_tsc_khz();
+    uint64_t us = div64_u32(cycles * 1000, khz ? khz : 1000000);
+    return us > 0xFFFFFFFFu ? 0xFFFFFFFFu : (uint32_t)us;
+}
+
+static int hotter(const lock_stats_t* a, const lock_stats_t* b) {
+    if (a->wait_cycles != b->wait_cycles) return a->wait_cycles > b->wait_cycles;
+    if (a->contended != b->contended) return a->contended > b->contended;
+    return a->acquires > b->acquires;
+}
+
+// The locks with the most time spent waiting for them. Counters are read
+// without their locks, which at worst mixes two acquires in one row.
+void lock_stats_print(void) {
+    lock_stats_t* rows[LOCKSTAT_ROWS];
+    int count = 0;
+    
+    for (lock_stats_t* s = lock_registry; s != NULL; s = s->next) {
+        int i = count < LOCKSTAT_ROWS ? count++ : LOCKSTAT_ROWS;
+        while (i > 0 && hotter(s, rows[i - 1])) {
+            if (i < LOCKSTAT_ROWS) rows[i] = rows[i - 1];
+            i--;
+        }
+        if (i < LOCKSTAT_ROWS) rows[i] = s;
+    }
+    
+    print_string("Lock         Acquires  Contended Cont%  Wait us   Avg cyc  Max us\n");
+    for (int i = 0; i < count; i++) {
+        lock_stats_t* s = rows[i];
+        print_string(s->name);
+        for (int len = strlen(s->name); len < 13; len++) {
+            print_char(' ');
+        }
+        print_col(s->acquires, 10);
+        print_col(s->contended, 10);
+        print_col(s->acquires ? (uint32_t)div64_u32((uint64_t)s->contended * 100, s->acquires) : 0, 7);
+        print_col(cycles_to_us(s->wait_cycles), 10);
+        print_col(s->contended ? (uint32_t)div64_u32(s->wait_cycles, s->contended) : 0, 9);
+        print_col(cycles_to_us(s->max_wait_cycles), 0);
+        print_string("\n");
+    }
+    if (count == 0) {
+        print_string("No profiled lock has been taken yet\n");
+    }
+}
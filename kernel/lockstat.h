@@ -0,0 +1,40 @@
+#ifndef LOCKSTAT_H
+#define LOCKSTAT_H
+
+#include <stdint.h>
+
+// Locks listed by the locks command, most waited on first
+#define LOCKSTAT_ROWS 10
+
+// Contention counters of one lock. A lock points at its counters, or at
+// NULL to skip the bookkeeping. They are updated while the lock is held,
+// so they need no lock of their own.
+typedef struct lock_stats {
+    const char* name;
+    uint32_t acquires;
+    uint32_t contended;         // acquires that had to wait
+    uint64_t wait_cycles;       // TSC cycles spent waiting, in total
+    uint64_t max_wait_cycles;
+    volatile uint32_t registered;
+    struct lock_stats* next;    // registry, see lockstat.c
+} lock_stats_t;
+
+#define LOCK_STATS_INIT(name) { (name), 0, 0, 0, 0, 0, NULL }
+
+void lock_stats_register(lock_stats_t* stats);
+void lock_stats_reset(void);
+void lock_stats_print(void);
+
+// Called by the lock implementations right after they got the lock.
+// A lock shows up in the registry on its first acquire.
+static inline void lock_stats_acquired(lock_stats_t* stats, int contended, uint64_t wait) {
+    if (!stats->registered) lock_stats_register(stats);
+    stats->acquires++;
+    if (contended) {
+        stats->contended++;
+        stats->wait_cycles += wait;
+        if (wait > stats->max_wait_cycles) stats->max_wait_cycles = wait;
+    }
+}
+
+#endif
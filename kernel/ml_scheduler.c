@@ -1,216 +1,266 @@
 #include "process.h"
 #include "kernel.h"
 #include "string.h"
+#include "ml_scheduler.h"
+#include "ml_forest.h"
+#include "cpu.h"
+#include "klog.h"
+#include "kmalloc.h"
+#include "smp.h"
+#include "spinlock.h"
 #include <stddef.h>
 
-typedef struct {
-    int pid;
-    int process_type;
-    int predicted_burst;
-    float priority_score;
-} ml_process_info_t;
+static int ml_scheduler_active = 0;
 
-#define MAX_ML_PROCESSES 16
+// Inference cost on the scheduling path. Processes are created on every
+// CPU, so the counters have a lock of their own.
+static lock_stats_t ml_predict_lock_stats = LOCK_STATS_INIT("ml_predict");
+static spinlock_t ml_predict_lock = SPINLOCK_INIT_STATS(&ml_predict_lock_stats);
+static uint64_t ml_predict_cycles = 0;
+static uint32_t ml_predict_count = 0;
+static uint32_t ml_predict_last = 0;
+static uint32_t ml_predict_max = 0;
 
-static ml_process_info_t ml_process_data[MAX_ML_PROCESSES];
-static int ml_scheduler_active = 0;
+// Nominal burst estimates for the declared process types (CPU, IO, ML)
+static const int32_t type_cpu_burst_est[3] = { 8, 4, 6 };
+static const int32_t type_io_burst_est[3] = { 0, 6, 2 };
 
-static void delay(int cycles) {
-    for(int i = 0; i < cycles; i++) { 
-        asm volatile ("nop"); 
+// Tick counts in fixed point, clamped so the shift cannot overflow. Every
+// threshold in the forest is far below the clamp.
+#define ML_TICKS_MAX ((uint32_t)INT32_MAX >> ML_FIXED_SHIFT)
+
+static int32_t ml_fixed_ticks(uint32_t ticks) {
+    if (ticks > ML_TICKS_MAX) ticks = ML_TICKS_MAX;
+    return (int32_t)ticks << ML_FIXED_SHIFT;
+}
+
+// Fixed-point feature vector in the order of ML_FEATURE_* (the same order
+// as MLRoundRobinScheduler.features in making_prediction.py)
+static void ml_build_features(const pcb_t* pcb, int32_t x[ML_FOREST_FEATURES]) {
+    int type = pcb->process_type;
+    
+    x[ML_FEATURE_PRIORITY] = pcb->priority << ML_FIXED_SHIFT;
+    x[ML_FEATURE_CPU_BURST_EST] = type_cpu_burst_est[type] << ML_FIXED_SHIFT;
+    x[ML_FEATURE_IO_BURST_EST] = type_io_burst_est[type] << ML_FIXED_SHIFT;
+    x[ML_FEATURE_ARRIVAL_TIME] = ml_fixed_ticks(pcb->arrival_tick);
+    x[ML_FEATURE_MEMORY_REQ] = (STACK_SIZE / 1024) << ML_FIXED_SHIFT;
+    x[ML_FEATURE_TOTAL_CPU_USED] = ml_fixed_ticks(pcb->cpu_ticks);
+    x[ML_FEATURE_WAITING_TIME] = 0;
+    x[ML_FEATURE_TURNAROUND_TIME] = 0;
+}
+
+// Average of all trees, integer compares only. The child index is
+// computed arithmetically so the walk has no data-dependent branches
+// besides the loop exit at a leaf.
+static int32_t ml_forest_eval(const int32_t x[ML_FOREST_FEATURES]) {
+    int32_t sum = 0;
+    for (int t = 0; t < ML_FOREST_TREES; t++) {
+        const ml_tree_node_t* tree = &ml_forest_nodes[ml_forest_roots[t]];
+        uint32_t n = 0;
+        while (tree[n].feature >= 0) {
+            uint32_t go_right = x[tree[n].feature] > tree[n].threshold;
+            n += 1 + go_right * (tree[n].right - 1);
+        }
+        sum += tree[n].threshold;
     }
+    return sum / ML_FOREST_TREES;
 }
 
-int ml_predict_time_slice(int process_type) {
-    if (process_type < 0 || process_type > 2) {
-        print_string("[ML WARNING] Invalid process type: ");
-        print_int(process_type);
-        print_string("\n");
-        delay(5000000);
+int ml_predict_time_slice(const pcb_t* pcb) {
+    if (pcb->process_type < 0 || pcb->process_type > 2) {
+        klog(KLOG_WARN, KLOG_ML, "Invalid process type: %d", pcb->process_type);
         return 5;
     }
     
-    int burst;
-    switch(process_type) {
-        case 0: burst = 8; break;
-        case 1: burst = 4; break;  
-        case 2: burst = 6; break;
-        default: burst = 5; break;
-    }
+    int32_t features[ML_FOREST_FEATURES];
+    uint64_t start = rdtsc();
+    ml_build_features(pcb, features);
+    int32_t prediction = ml_forest_eval(features);
+    uint32_t cycles = (uint32_t)(rdtsc() - start);
+    
+    uint32_t flags = spin_lock_irqsave(&ml_predict_lock);
+    ml_predict_cycles += cycles;
+    ml_predict_count++;
+    ml_predict_last = cycles;
+    if (cycles > ml_predict_max) ml_predict_max = cycles;
+    spin_unlock_irqrestore(&ml_predict_lock, flags);
+    
+    // Round to whole ticks, a quantum is at least one tick
+    int burst = (prediction + (1 << (ML_FIXED_SHIFT - 1))) >> ML_FIXED_SHIFT;
+    if (burst < 1) burst = 1;
     
-    print_string("[ML DEBUG] Predict - Type: ");
-    delay(5000000);
-    print_int(process_type);
-    delay(5000000);
-    print_string(" -> Burst: ");
-    delay(5000000);
-    print_int(burst);
-    delay(5000000);
-    print_string("\n");
-    delay(5000000);
+    klog(KLOG_DEBUG, KLOG_ML, "Predict - Type: %d -> Burst: %d (%u cycles)",
+         pcb->process_type, burst, cycles);
     
     return burst;
 }
 
 void ml_scheduler_init(void) {
-    print_string("[ML] Initializing Random Forest Scheduler\n");
-    delay(5000000);
-    for(int i = 0; i < MAX_ML_PROCESSES; i++) {
-        ml_process_data[i].pid = 0;
-        ml_process_data[i].process_type = -1;
-        ml_process_data[i].predicted_burst = 0;
-        ml_process_data[i].priority_score = 0.0f;
+    klog(KLOG_INFO, KLOG_ML, "Initializing Random Forest Scheduler");
+    // One heap per CPU, each able to hold every process
+    int capacity = process_capacity();
+    for (int i = 0; i < cpu_count; i++) {
+        ml_heap_init(&cpus[i].ml_heap, kmalloc(capacity * sizeof(pcb_t*)), capacity);
     }
     ml_scheduler_active = 1;
 }
 
-void ml_update_process_features(int pid, int process_type) {
+void ml_update_process_features(pcb_t* pcb, int process_type) {
+    int pid = pcb->pid;
     if (pid <= 0) {
-        print_string("[ML ERROR] Invalid PID: ");
-        delay(5000000);
-        print_int(pid);
-        delay(5000000);
-        print_string("\n");
-        delay(5000000);
+        klog(KLOG_ERR, KLOG_ML, "Invalid PID: %d", pid);
         return;
     }
     
     if (process_type < 0 || process_type > 2) {
-        print_string("[ML ERROR] Invalid process type for PID ");
-        delay(5000000);
-        print_int(pid);
-        delay(5000000);
-        print_string(": ");
-        delay(5000000);
-        print_int(process_type);
-        delay(5000000);
-        print_string("\n");
-        delay(5000000);
+        klog(KLOG_ERR, KLOG_ML, "Invalid process type for PID %d: %d", pid, process_type);
         return;
     }
     
-    for (int i = 0; i < MAX_ML_PROCESSES; i++) {
-        if (ml_process_data[i].pid == 0) {
-            ml_process_data[i].pid = pid;
-            ml_process_data[i].process_type = process_type;
-            ml_process_data[i].predicted_burst = ml_predict_time_slice(process_type);
-            
-            if (ml_process_data[i].predicted_burst == 0) {
-                print_string("[ML WARNING] Zero burst detected for PID ");
-                delay(5000000);
-                print_int(pid);
-                delay(5000000);
-                print_string(", using default priority\n");
-                delay(5000000);
-                ml_process_data[i].priority_score = 0.1f;
-            } else {
-                ml_process_data[i].priority_score = 1.0f / ml_process_data[i].predicted_burst;
-            }
-            
-            print_string("[ML] Process ");
-            delay(5000000);
-            print_int(pid);
-            delay(5000000);
-            print_string(": Type=");
-            delay(5000000);
-            print_int(process_type);
-            delay(5000000);
-            print_string(", Predicted burst=");
-            delay(5000000);
-            print_int(ml_process_data[i].predicted_burst);
-            delay(5000000);
-            print_string(", Priority=");
-            delay(5000000);
-            print_float(ml_process_data[i].priority_score);
-            delay(5000000);
-            print_string("\n");
-            delay(5000000);
-            break;
+    pcb->process_type = process_type;
+    pcb->predicted_burst = ml_predict_time_slice(pcb);
+    
+    if (pcb->predicted_burst == 0) {
+        klog(KLOG_WARN, KLOG_ML, "Zero burst detected for PID %d, using default priority", pid);
+        pcb->priority_score = 0.1f;
+    } else {
+        pcb->priority_score = 1.0f / pcb->predicted_burst;
+    }
+    
+    int centi = (int)(pcb->priority_score * 100.0f);
+    klog(KLOG_INFO, KLOG_ML, "Process %d: Type=%d, Predicted burst=%d, Priority=%d.%02d",
+         pid, process_type, pcb->predicted_burst, centi / 100, centi % 100);
+}
+
+// Binary max-heap of READY processes ordered by priority_score. Equal
+// scores are served in the order they became ready. Each PCB remembers
+// its slot in heap_index so it can be removed without searching.
+static int ml_heap_before(const pcb_t* a, const pcb_t* b) {
+    if (a->priority_score != b->priority_score) {
+        return a->priority_score > b->priority_score;
+    }
+    return (int32_t)(a->ready_seq - b->ready_seq) < 0;
+}
+
+static void ml_heap_place(ml_heap_t* heap, int index, pcb_t* pcb) {
+    heap->nodes[index] = pcb;
+    pcb->heap_index = index;
+}
+
+static void ml_heap_sift_up(ml_heap_t* heap, int index) {
+    pcb_t* pcb = heap->nodes[index];
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (!ml_heap_before(pcb, heap->nodes[parent])) break;
+        ml_heap_place(heap, index, heap->nodes[parent]);
+        index = parent;
+    }
+    ml_heap_place(heap, index, pcb);
+}
+
+static void ml_heap_sift_down(ml_heap_t* heap, int index) {
+    pcb_t* pcb = heap->nodes[index];
+    while (1) {
+        int child = 2 * index + 1;
+        if (child >= heap->size) break;
+        if (child + 1 < heap->size && 
+            ml_heap_before(heap->nodes[child + 1], heap->nodes[child])) {
+            child++;
         }
+        if (!ml_heap_before(heap->nodes[child], pcb)) break;
+        ml_heap_place(heap, index, heap->nodes[child]);
+        index = child;
+    }
+    ml_heap_place(heap, index, pcb);
+}
+
+void ml_heap_init(ml_heap_t* heap, pcb_t** nodes, int capacity) {
+    heap->nodes = nodes;
+    heap->size = 0;
+    heap->capacity = capacity;
+    heap->next_seq = 0;
+}
+
+void ml_heap_push(ml_heap_t* heap, pcb_t* pcb) {
+    if (heap->size >= heap->capacity) return;
+    pcb->ready_seq = heap->next_seq++;
+    heap->nodes[heap->size] = pcb;
+    ml_heap_sift_up(heap, heap->size++);
+}
+
+void ml_heap_remove(ml_heap_t* heap, pcb_t* pcb) {
+    int index = pcb->heap_index;
+    pcb_t* last = heap->nodes[--heap->size];
+    pcb->heap_index = -1;
+    if (last == pcb) return;
+    
+    ml_heap_place(heap, index, last);
+    if (index > 0 && ml_heap_before(last, heap->nodes[(index - 1) / 2])) {
+        ml_heap_sift_up(heap, index);
+    } else {
+        ml_heap_sift_down(heap, index);
     }
 }
 
+pcb_t* ml_heap_top(ml_heap_t* heap) {
+    return heap->size > 0 ? heap->nodes[0] : NULL;
+}
+
 void ml_schedule(void) {
-    if (!ml_scheduler_active || ready_queue == NULL) return;
-    
-    float highest_priority = -1.0f;
-    pcb_t* next_process = NULL;
-    
-    pcb_t* current = ready_queue;
-    do {
-        for (int i = 0; i < MAX_ML_PROCESSES; i++) {
-            if (ml_process_data[i].pid == (int)current->pid && current->state == PROCESS_READY) {
-                if (ml_process_data[i].priority_score > highest_priority) {
-                    highest_priority = ml_process_data[i].priority_score;
-                    next_process = current;
-                }
-                break;
-            }
-        }
-        current = current->next;
-    } while (current != ready_queue);
-    
-    if (next_process != NULL && next_process != current_process) {
-        current_process->state = PROCESS_READY;
-        next_process->state = PROCESS_RUNNING;
-        current_process = next_process;
-        
-        for (int i = 0; i < MAX_ML_PROCESSES; i++) {
-            if (ml_process_data[i].pid == (int)current_process->pid) {
-                print_string("[ML] Selected: ");
-                delay(5000000);
-                print_string(current_process->name);
-                delay(5000000);
-                print_string(" (Burst=");
-                delay(5000000);
-                print_int(ml_process_data[i].predicted_burst);
-                delay(5000000);
-                print_string(", Priority=");
-                delay(5000000);
-                print_float(ml_process_data[i].priority_score);
-                delay(5000000);
-                print_string(")\n");
-                delay(5000000);
-                break;
-            }
-        }
+    if (!ml_scheduler_active) return;
+    
+    pcb_t* next_process = ml_heap_top(&this_cpu()->ml_heap);
+    if (next_process == NULL) {
+        next_process = process_steal();
+    }
+    
+    if (next_process != NULL && next_process != get_current_process()) {
+        klog(KLOG_DEBUG, KLOG_SCHED, "ML selected: %s (Burst=%d)",
+             next_process->name, next_process->predicted_burst);
     }
+    
+    process_switch(next_process);
 }
 
 void print_ml_scheduler_stats(void) {
     print_string("\n=== ML Scheduler Stats ===\n");
-    delay(5000000);
     print_string("PID Type Prediction Priority\n");
-    delay(5000000);
     
-    for (int i = 0; i < MAX_ML_PROCESSES; i++) {
-        if (ml_process_data[i].pid != 0) {
-            print_int(ml_process_data[i].pid);
-            delay(5000000);
+    for (int i = 1; i < process_capacity(); i++) {
+        pcb_t* pcb = process_get(i);
+        if (pcb != NULL) {
+            print_int(pcb->pid);
             print_string(" ");
-            delay(5000000);
             
-            switch(ml_process_data[i].process_type) {
+            switch(pcb->process_type) {
                 case 0: print_string("CPU "); break;
                 case 1: print_string("IO  "); break;
                 case 2: print_string("ML  "); break;
                 default: print_string("UNK "); break;
             }
-            delay(5000000);
             print_string(" ");
-            delay(5000000);
             
-            print_int(ml_process_data[i].predicted_burst);
-            delay(5000000);
+            print_int(pcb->predicted_burst);
             print_string(" ");
-            delay(5000000);
             
-            print_float(ml_process_data[i].priority_score);
-            delay(5000000);
+            print_float(pcb->priority_score);
             print_string("\n");
-            delay(5000000);
         }
     }
+    
+    print_string("Forest: ");
+    print_int(ML_FOREST_TREES);
+    print_string(" trees, ");
+    print_int(ML_FOREST_NODES);
+    print_string(" nodes\n");
+    print_string("Inference: ");
+    print_int(ml_predict_count);
+    print_string(" predictions, avg ");
+    print_int(ml_predict_count ? (int)div64_u32(ml_predict_cycles, ml_predict_count) : 0);
+    print_string(" / last ");
+    print_int(ml_predict_last);
+    print_string(" / max ");
+    print_int(ml_predict_max);
+    print_string(" cycles\n");
     print_string("==========================\n");
-    delay(5000000);
 }
\ No newline at end of file
@@ -0,0 +1,19 @@
+#ifndef ML_SCHEDULER_H
+#define ML_SCHEDULER_H
+
+#include "process.h"
+
+// Priority heap of READY processes used by ml_schedule(), one per CPU
+typedef struct {
+    pcb_t** nodes;
+    int size;
+    int capacity;
+    uint32_t next_seq;
+} ml_heap_t;
+
+void ml_heap_init(ml_heap_t* heap, pcb_t** nodes, int capacity);
+void ml_heap_push(ml_heap_t* heap, pcb_t* pcb);
+void ml_heap_remove(ml_heap_t* heap, pcb_t* pcb);
+pcb_t* ml_heap_top(ml_heap_t* heap);
+
+#endif
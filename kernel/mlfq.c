@@ -0,0 +1,109 @@
+// kernel/mlfq.c - Multilevel feedback queue driven by measured CPU bursts
+#include "mlfq.h"
+#include "kernel.h"
+#include "cpu.h"
+#include "timer.h"
+#include <stddef.h>
+
+mlfq_stats_t mlfq_stats;
+
+static uint32_t boost_tick;
+
+int mlfq_quantum(int level) {
+    return MLFQ_BASE_QUANTUM << level;
+}
+
+static uint32_t cycles_per_tick(void) {
+    uint32_t khz = timer_tsc_khz();
+    return (uint32_t)div64_u32((uint64_t)(khz ? khz : 1000000) * 1000, timer_get_frequency());
+}
+
+// Called from process_switch() for every process that stops running
+// without exiting. A burst lasts until the process blocks or yields, so
+// a preempted process carries its run so far into the next dispatch.
+// With relevel set the burst estimate replaces predicted_burst and
+// priority_score and picks the process's level.
+void mlfq_account_burst(pcb_t* pcb, uint64_t ran, int preempted, int relevel) {
+    pcb->burst_cycles += ran;
+    if (!preempted) {
+        uint64_t burst = pcb->burst_cycles;
+        if (pcb->bursts++ == 0) {
+            pcb->burst_ewma = burst;
+        } else if (burst > pcb->burst_ewma) {
+            pcb->burst_ewma += (burst - pcb->burst_ewma) >> MLFQ_EWMA_SHIFT;
+        } else {
+            pcb->burst_ewma -= (pcb->burst_ewma - burst) >> MLFQ_EWMA_SHIFT;
+        }
+        pcb->burst_cycles = 0;
+    }
+    if (!relevel) return;
+    
+    // A burst still running that is already longer than the average counts
+    uint64_t estimate = pcb->burst_ewma;
+    if (pcb->burst_cycles > estimate) estimate = pcb->burst_cycles;
+    uint32_t tick = cycles_per_tick();
+    uint64_t ticks = div64_u32(estimate + tick / 2, tick);
+    int burst = ticks < 1 ? 1 : ticks > 1000 ? 1000 : (int)ticks;
+    pcb->predicted_burst = burst;
+    pcb->priority_score = 1.0f / burst;
+    
+    int level = 0;
+    while (level < MLFQ_LEVELS - 1 && burst > mlfq_quantum(level)) {
+        level++;
+    }
+    // Using up the quantum always costs a level
+    if (preempted && level <= pcb->mlfq_level) {
+        level = pcb->mlfq_level < MLFQ_LEVELS - 1 ? pcb->mlfq_level + 1 : pcb->mlfq_level;
+    }
+    if (level > pcb->mlfq_level) mlfq_stats.demotions++;
+    if (level < pcb->mlfq_level) mlfq_stats.promotions++;
+    pcb->mlfq_level = level;
+}
+
+// Called from CPU 0's timer interrupt while the MLFQ policy is active.
+// Returns 1 when every run queue is due for mlfq_boost().
+int mlfq_boost_due(void) {
+    if (timer_ticks - boost_tick < timer_get_frequency() * MLFQ_BOOST_MS / 1000) return 0;
+    boost_tick = timer_ticks;
+    mlfq_stats.boosts++;
+    return 1;
+}
+    
+void mlfq_boost(runqueue_t* rq) {
+    for (int level = 1; level < MLFQ_LEVELS; level++) {
+        pcb_t* pcb;
+        while ((pcb = rq->head[level]) != NULL) {
+            rq_dequeue(rq, pcb);
+            pcb->mlfq_level = 0;
+            rq_enqueue_at(rq, pcb, 0);
+        }
+    }
+}
+
+void mlfq_print_stats(void) {
+    uint32_t queued[MLFQ_LEVELS] = { 0 };
+    
+    uint32_t flags = irq_save();
+    for (int i = 1; i < process_capacity(); i++) {
+        pcb_t* pcb = process_get(i);
+        if (pcb != NULL && pcb->mlfq_level >= 0 && pcb->mlfq_level < MLFQ_LEVELS) {
+            queued[pcb->mlfq_level]++;
+        }
+    }
+    irq_restore(flags);
+    
+    print_string("MLFQ levels (quantum ticks: processes):");
+    for (int level = 0; level < MLFQ_LEVELS; level++) {
+        print_string(" ");
+        print_int(mlfq_quantum(level));
+        print_string(": ");
+        print_int(queued[level]);
+    }
+    print_string("\nMLFQ: ");
+    print_int(mlfq_stats.promotions);
+    print_string(" promotions, ");
+    print_int(mlfq_stats.demotions);
+    print_string(" demotions, ");
+    print_int(mlfq_stats.boosts);
+    print_string(" boosts\n");
+}
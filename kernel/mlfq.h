@@ -0,0 +1,37 @@
+#ifndef MLFQ_H
+#define MLFQ_H
+
+#include <stdint.h>
+#include "process.h"
+#include "runqueue.h"
+
+// Multilevel feedback queue. Its levels are the low levels of each
+// CPU's run queue; level 0 is served first and has the shortest quantum,
+// each level below doubles it. A process is filed by the average length
+// of its measured CPU bursts, not by the type it declared: one that
+// keeps using up its quantum sinks, one that blocks early rises.
+#define MLFQ_LEVELS 4
+#define MLFQ_BASE_QUANTUM 1 // ticks at level 0
+
+// A finished burst moves the average 1/2^MLFQ_EWMA_SHIFT of the way
+#define MLFQ_EWMA_SHIFT 2
+
+// Queued processes all go back to level 0 this often, so the lowest
+// level cannot starve
+#define MLFQ_BOOST_MS 1000
+
+typedef struct {
+    uint32_t promotions;
+    uint32_t demotions;
+    uint32_t boosts;
+} mlfq_stats_t;
+
+extern mlfq_stats_t mlfq_stats;
+
+int mlfq_quantum(int level);
+void mlfq_account_burst(pcb_t* pcb, uint64_t ran, int preempted, int relevel);
+int mlfq_boost_due(void);
+void mlfq_boost(runqueue_t* rq);
+void mlfq_print_stats(void);
+
+#endif
@@ -0,0 +1,56 @@
+// kernel/mutex.c - Sleeping mutexes built on wait queues
+#include "mutex.h"
+#include "kernel.h"
+#include "cpu.h"
+
+// The state is changed under the kernel lock, the same one process_block()
+// and process_wake_one() take, so an unlock cannot slip in between a
+// waiter finding the mutex taken and going to sleep.
+void mutex_lock(mutex_t* mutex) {
+    uint32_t flags = irq_save();
+    pcb_t* self = get_current_process();
+    if (mutex->locked && mutex->owner == self) {
+        kernel_panic("mutex locked twice by the same process");
+    }
+    
+    int contended = mutex->locked;
+    uint64_t start = contended && mutex->stats ? rdtsc() : 0;
+    while (mutex->locked) {
+        if (process_can_block()) {
+            process_block(&mutex->waiters);
+        } else {
+            // Let the owner run; it may be queued on this very CPU
+            irq_restore(flags);
+            process_yield();
+            flags = irq_save();
+        }
+    }
+    
+    mutex->locked = 1;
+    mutex->owner = self;
+    if (mutex->stats) lock_stats_acquired(mutex->stats, contended, contended ? rdtsc() - start : 0);
+    irq_restore(flags);
+}
+
+// Returns 1 with the mutex held, or 0 if another process holds it
+int mutex_trylock(mutex_t* mutex) {
+    uint32_t flags = irq_save();
+    int taken = !mutex->locked;
+    if (taken) {
+        mutex->locked = 1;
+        mutex->owner = get_current_process();
+        if (mutex->stats) lock_stats_acquired(mutex->stats, 0, 0);
+    }
+    irq_restore(flags);
+    return taken;
+}
+
+// A woken waiter tries again, so a process that comes along in between
+// may take the mutex first
+void mutex_unlock(mutex_t* mutex) {
+    uint32_t flags = irq_save();
+    mutex->locked = 0;
+    mutex->owner = NULL;
+    process_wake_one(&mutex->waiters);
+    irq_restore(flags);
+}
@@ -0,0 +1,26 @@
+#ifndef MUTEX_H
+#define MUTEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "process.h"
+#include "lockstat.h"
+
+// Sleeping lock for sections that may block, such as file system calls
+// waiting on the disk. Waiters sleep on a wait queue instead of spinning;
+// the idle context cannot sleep and yields until the mutex is free.
+typedef struct {
+    volatile int locked;
+    pcb_t* owner;
+    wait_queue_t waiters;
+    lock_stats_t* stats;        // NULL when not profiled
+} mutex_t;
+
+#define MUTEX_INIT { 0, NULL, { NULL, NULL }, NULL }
+#define MUTEX_INIT_STATS(stats) { 0, NULL, { NULL, NULL }, (stats) }
+
+void mutex_lock(mutex_t* mutex);
+int mutex_trylock(mutex_t* mutex);
+void mutex_unlock(mutex_t* mutex);
+
+#endif
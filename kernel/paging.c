@@ -0,0 +1,378 @@
+// kernel/paging.c - Page directories, 4 MB kernel mappings and demand paging
+#include "paging.h"
+#include "kernel.h"
+#include "kstack.h"
+#include "gdt.h"
+#include "idt.h"
+#include "string.h"
+#include "cpu.h"
+#include "klog.h"
+#include "smp.h"
+
+#define EXC_PAGE_FAULT 14
+#define PF_PRESENT 0x1 // error code: protection fault on a present page
+#define PF_WRITE 0x2
+
+paging_stats_t paging_stats;
+uint32_t kernel_page_dir;
+
+// Each CPU has its own directory loaded, see cpu_t.page_dir
+#define current_dir (this_cpu()->page_dir)
+
+static uint32_t global_flag; // PAGE_GLOBAL when the CPU supports it
+
+// Bumped whenever a kernel window mapping is removed or replaced. The
+// invlpg only reaches this CPU's TLB, so every other CPU drops its global
+// entries at its next context switch, before it can run on a stack that
+// was unmapped and reused.
+static volatile uint32_t window_gen;
+
+// Address spaces mapping each user frame. A frame is shared by at most
+// PROCESS_LIMIT processes, so 16 bits cannot overflow.
+static uint16_t* frame_refs;
+
+// Directories and tables live in identity-mapped RAM, so their physical
+// address is also a usable pointer
+static uint32_t alloc_table(void) {
+    uint32_t page = pmm_alloc_page();
+    if (page) {
+        memset((void*)page, 0, PAGE_SIZE);
+    }
+    return page;
+}
+
+// Kernel window entries are global, so a CR3 load would not drop them
+static void flush_page(uint32_t dir, uint32_t virt) {
+    if (virt >= KERNEL_WINDOW_BASE) {
+        __sync_fetch_and_add(&window_gen, 1);
+    }
+    if (dir == current_dir || virt >= KERNEL_WINDOW_BASE) {
+        invlpg(virt);
+        paging_stats.invlpgs++;
+    }
+}
+
+// Drop every TLB entry, global ones included
+static void flush_all(void) {
+    if (global_flag) {
+        uint32_t cr4 = read_cr4();
+        write_cr4(cr4 & ~CR4_PGE);
+        write_cr4(cr4);
+    } else {
+        write_cr3(read_cr3());
+    }
+    paging_stats.tlb_flushes++;
+}
+
+// Drop one reference to a user frame, freeing it with the last one
+static void frame_put(uint32_t frame) {
+    if (--frame_refs[frame / PAGE_SIZE] == 0) {
+        pmm_free_pages(frame, 1);
+        paging_stats.user_pages--;
+    }
+}
+
+static uint32_t* lookup_pte(uint32_t dir, uint32_t virt) {
+    uint32_t pde = ((uint32_t*)dir)[PD_INDEX(virt)];
+    if (!(pde & PAGE_PRESENT) || (pde & PAGE_LARGE)) {
+        return 0;
+    }
+    return &((uint32_t*)(pde & PAGE_FRAME))[PT_INDEX(virt)];
+}
+
+// Write to a shared page: copy it, or take it back if no one else maps it
+static int cow_fault(uint32_t addr) {
+    uint32_t* pte = lookup_pte(current_dir, addr);
+    if (pte == 0 || !(*pte & PAGE_COW)) {
+        return -1;
+    }
+    
+    uint32_t frame = *pte & PAGE_FRAME;
+    uint32_t flags = (*pte & ~(PAGE_FRAME | PAGE_COW)) | PAGE_WRITE;
+    
+    if (frame_refs[frame / PAGE_SIZE] == 1) {
+        paging_stats.cow_reuses++;
+    } else {
+        uint32_t copy = pmm_alloc_page();
+        if (!copy) {
+            kernel_panic("Out of memory in copy-on-write fault");
+        }
+        memcpy((void*)copy, (void*)frame, PAGE_SIZE);
+        frame_refs[copy / PAGE_SIZE] = 1;
+        frame_refs[frame / PAGE_SIZE]--;
+        frame = copy;
+        paging_stats.user_pages++;
+        paging_stats.cow_copies++;
+    }
+    *pte = frame | flags;
+    invlpg(addr & PAGE_FRAME);
+    paging_stats.invlpgs++;
+    return 0;
+}
+
+static void page_fault_handler(interrupt_frame_t* frame) {
+    uint32_t addr = read_cr2();
+    
+    if (addr >= USER_BASE && addr < USER_TOP && current_dir != kernel_page_dir) {
+        // First touch of a user page: back it with a zeroed frame
+        if (!(frame->error_code & PF_PRESENT)) {
+            uint32_t page = alloc_table();
+            if (page && paging_map(current_dir, addr & PAGE_FRAME, page,
+                                   PAGE_WRITE | PAGE_USER) == 0) {
+                frame_refs[page / PAGE_SIZE] = 1;
+                paging_stats.page_faults++;
+                paging_stats.user_pages++;
+                return;
+            }
+            if (page) pmm_free_pages(page, 1);
+            kernel_panic("Out of memory in page fault");
+        }
+        if ((frame->error_code & PF_WRITE) && cow_fault(addr) == 0) {
+            return;
+        }
+    }
+    
+    if (kstack_is_guard(addr)) {
+        kstack_stats.overflows++;
+        kernel_panic("Kernel stack overflow");
+    }
+    klog(KLOG_ERR, KLOG_MEM, "Page fault at 0x%x, error %u, EIP 0x%x",
+         addr, frame->error_code, frame->eip);
+    klog_drain();
+    kernel_panic("Unhandled page fault");
+}
+
+void paging_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_EDX_PSE)) {
+        kernel_panic("Paging needs a CPU with 4 MB pages (PSE)");
+    }
+    global_flag = (edx & CPUID_EDX_PGE) ? PAGE_GLOBAL : 0;
+    
+    kernel_page_dir = alloc_table();
+    uint32_t* pd = (uint32_t*)kernel_page_dir;
+    
+    // One directory entry per 4 MB keeps the whole kernel in a few TLB slots
+    for (uint32_t addr = 0; addr < KERNEL_IDENTITY_END; addr += LARGE_PAGE_SIZE) {
+        pd[PD_INDEX(addr)] = addr | PAGE_PRESENT | PAGE_WRITE | PAGE_LARGE | global_flag;
+    }
+    
+    // Window tables exist from the start, so every directory copied from
+    // this one shares them and sees later window mappings
+    for (uint32_t addr = KERNEL_WINDOW_BASE;
+         addr < KERNEL_WINDOW_BASE + KERNEL_WINDOW_SIZE; addr += LARGE_PAGE_SIZE) {
+        pd[PD_INDEX(addr)] = alloc_table() | PAGE_PRESENT | PAGE_WRITE;
+    }
+    
+    uint32_t ref_pages = (pmm_page_limit() * sizeof(uint16_t) + PAGE_SIZE - 1) / PAGE_SIZE;
+    frame_refs = (uint16_t*)pmm_alloc_pages(ref_pages);
+    if (!frame_refs) {
+        kernel_panic("No memory for page reference counts");
+    }
+    memset(frame_refs, 0, ref_pages * PAGE_SIZE);
+    
+    idt_register_handler(EXC_PAGE_FAULT, page_fault_handler);
+    gdt_set_fault_cr3(kernel_page_dir);
+    
+    // WP makes read-only pages fault on kernel writes too, which
+    // copy-on-write relies on since processes run in ring 0
+    write_cr4(read_cr4() | CR4_PSE | (global_flag ? CR4_PGE : 0));
+    write_cr3(kernel_page_dir);
+    write_cr0(read_cr0() | CR0_PG | CR0_WP);
+    current_dir = kernel_page_dir;
+    paging_stats.directories = 1;
+    
+    klog(KLOG_INFO, KLOG_MEM, "Paging on: %u MB in 4 MB pages%s",
+         KERNEL_IDENTITY_END >> 20, global_flag ? ", global" : "");
+}
+
+// Identity-map the uncached 4 MB page holding a device's registers,
+// e.g. the local APIC. Only directories created afterwards inherit it.
+uint32_t paging_map_device(uint32_t phys) {
+    uint32_t base = phys & ~(LARGE_PAGE_SIZE - 1);
+    uint32_t* pd = (uint32_t*)kernel_page_dir;
+    
+    pd[PD_INDEX(base)] = base | PAGE_PRESENT | PAGE_WRITE | PAGE_LARGE |
+                         PAGE_PCD | PAGE_PWT | global_flag;
+    invlpg(phys);
+    return phys;
+}
+
+// New address space with the kernel mappings and an empty user range
+uint32_t paging_create_dir(void) {
+    uint32_t dir = pmm_alloc_page();
+    if (!dir) {
+        return 0;
+    }
+    memcpy((void*)dir, (void*)kernel_page_dir, PAGE_SIZE);
+    paging_stats.directories++;
+    return dir;
+}
+
+// Copy of parent's address space sharing every user page. Writable
+// pages become read-only in both and are copied on the first write.
+uint32_t paging_clone_dir(uint32_t parent) {
+    uint32_t dir = paging_create_dir();
+    if (!dir) {
+        return 0;
+    }
+    
+    uint32_t* ppd = (uint32_t*)parent;
+    uint32_t* cpd = (uint32_t*)dir;
+    int write_protected = 0;
+    
+    // Sharers of the same frames update its count from fault handlers
+    uint32_t flags = irq_save();
+    
+    for (uint32_t i = PD_INDEX(USER_BASE); i < PD_INDEX(USER_TOP); i++) {
+        if (!(ppd[i] & PAGE_PRESENT)) continue;
+        
+        uint32_t table = alloc_table();
+        if (!table) {
+            paging_destroy_dir(dir);
+            dir = 0;
+            break;
+        }
+        cpd[i] = table | (ppd[i] & ~PAGE_FRAME);
+        paging_stats.page_tables++;
+        
+        uint32_t* ppt = (uint32_t*)(ppd[i] & PAGE_FRAME);
+        uint32_t* cpt = (uint32_t*)table;
+        for (int j = 0; j < PAGE_ENTRIES; j++) {
+            uint32_t pte = ppt[j];
+            if (!(pte & PAGE_PRESENT)) continue;
+            
+            if (pte & PAGE_WRITE) {
+                pte = (pte & ~PAGE_WRITE) | PAGE_COW;
+                ppt[j] = pte;
+                write_protected = 1;
+            }
+            cpt[j] = pte;
+            frame_refs[pte / PAGE_SIZE]++;
+        }
+    }
+    
+    // The parent may still hold writable TLB entries for its pages
+    if (write_protected && parent == current_dir) {
+        write_cr3(parent);
+        paging_stats.tlb_flushes++;
+    }
+    irq_restore(flags);
+    return dir;
+}
+
+// Free the user pages, their tables and the directory itself. The
+// directory must not be the one loaded in CR3.
+void paging_destroy_dir(uint32_t dir) {
+    uint32_t* pd = (uint32_t*)dir;
+    
+    for (uint32_t i = PD_INDEX(USER_BASE); i < PD_INDEX(USER_TOP); i++) {
+        if (!(pd[i] & PAGE_PRESENT)) continue;
+        
+        uint32_t* pt = (uint32_t*)(pd[i] & PAGE_FRAME);
+        for (int j = 0; j < PAGE_ENTRIES; j++) {
+            if (pt[j] & PAGE_PRESENT) {
+                frame_put(pt[j] & PAGE_FRAME);
+            }
+        }
+        pmm_free_pages((uint32_t)pt, 1);
+        paging_stats.page_tables--;
+    }
+    pmm_free_pages(dir, 1);
+    paging_stats.directories--;
+}
+
+// Called on every context switch. Global kernel entries survive the
+// CR3 load; only the user range is flushed.
+void paging_switch(uint32_t dir) {
+    cpu_t* cpu = this_cpu();
+    if (cpu->window_gen != window_gen) {
+        cpu->window_gen = window_gen;
+        flush_all();
+    }
+    if (dir == current_dir) {
+        paging_stats.cr3_skips++;
+        return;
+    }
+    current_dir = dir;
+    write_cr3(dir);
+    paging_stats.cr3_loads++;
+}
+
+// Map one 4 KB page, allocating its page table if needed
+int paging_map(uint32_t dir, uint32_t virt, uint32_t phys, uint32_t flags) {
+    uint32_t* pd = (uint32_t*)dir;
+    uint32_t pde = pd[PD_INDEX(virt)];
+    
+    if (pde & PAGE_LARGE) {
+        return -1;
+    }
+    if (!(pde & PAGE_PRESENT)) {
+        uint32_t table = alloc_table();
+        if (!table) {
+            return -1;
+        }
+        pde = table | PAGE_PRESENT | PAGE_WRITE | PAGE_USER;
+        pd[PD_INDEX(virt)] = pde;
+        paging_stats.page_tables++;
+    }
+    
+    if (virt >= KERNEL_WINDOW_BASE) {
+        flags |= global_flag;
+    }
+    uint32_t* pt = (uint32_t*)(pde & PAGE_FRAME);
+    uint32_t old = pt[PT_INDEX(virt)];
+    pt[PT_INDEX(virt)] = (phys & PAGE_FRAME) | flags | PAGE_PRESENT;
+    if (old & PAGE_PRESENT) {
+        flush_page(dir, virt);
+    } else if (virt >= KERNEL_WINDOW_BASE) {
+        // This CPU may still cache a mapping another CPU removed
+        invlpg(virt);
+    }
+    return 0;
+}
+
+// Remove a 4 KB mapping and return the frame it pointed to, or 0
+uint32_t paging_unmap(uint32_t dir, uint32_t virt) {
+    uint32_t* pd = (uint32_t*)dir;
+    uint32_t pde = pd[PD_INDEX(virt)];
+    
+    if (!(pde & PAGE_PRESENT) || (pde & PAGE_LARGE)) {
+        return 0;
+    }
+    uint32_t* pt = (uint32_t*)(pde & PAGE_FRAME);
+    uint32_t pte = pt[PT_INDEX(virt)];
+    if (!(pte & PAGE_PRESENT)) {
+        return 0;
+    }
+    pt[PT_INDEX(virt)] = 0;
+    flush_page(dir, virt);
+    return pte & PAGE_FRAME;
+}
+
+void paging_print_stats(void) {
+    print_string("Paging: ");
+    print_int(paging_stats.directories);
+    print_string(" directories, ");
+    print_int(paging_stats.page_tables);
+    print_string(" user page tables, ");
+    print_int(paging_stats.user_pages);
+    print_string(" user pages, ");
+    print_int(paging_stats.page_faults);
+    print_string(" demand faults\n");
+    print_string("Copy-on-write: ");
+    print_int(paging_stats.cow_copies);
+    print_string(" copies, ");
+    print_int(paging_stats.cow_reuses);
+    print_string(" reuses\n");
+    print_string("TLB: ");
+    print_int(paging_stats.cr3_loads);
+    print_string(" CR3 loads, ");
+    print_int(paging_stats.cr3_skips);
+    print_string(" skipped, ");
+    print_int(paging_stats.invlpgs);
+    print_string(" invlpg, ");
+    print_int(paging_stats.tlb_flushes);
+    print_string(" other flushes\n");
+}
@@ -0,0 +1,56 @@
+#ifndef PAGING_H
+#define PAGING_H
+
+#include <stdint.h>
+#include "pmm.h"
+
+// Page directory and page table entry bits
+#define PAGE_PRESENT  0x001
+#define PAGE_WRITE    0x002
+#define PAGE_USER     0x004
+#define PAGE_PWT      0x008 // write-through
+#define PAGE_PCD      0x010 // not cached, for device registers
+#define PAGE_LARGE    0x080 // 4 MB page, directory entries only
+#define PAGE_GLOBAL   0x100 // kept in the TLB across CR3 loads
+#define PAGE_COW      0x200 // read-only share, copied on the first write
+#define PAGE_FRAME    0xFFFFF000
+
+#define LARGE_PAGE_SIZE (4u * 1024 * 1024)
+#define PAGE_ENTRIES 1024
+#define PD_INDEX(addr) ((addr) >> 22)
+#define PT_INDEX(addr) (((addr) >> 12) & 0x3FF)
+
+// Virtual layout, identical in every address space except the user range
+#define KERNEL_IDENTITY_END PMM_MAX_MEMORY   // all RAM, mapped 1:1 with 4 MB pages
+#define USER_BASE 0x40000000                 // per process, populated on first touch
+#define USER_TOP 0xC0000000
+#define KERNEL_WINDOW_BASE USER_TOP          // 4 KB kernel mappings, e.g. stacks
+#define KERNEL_WINDOW_SIZE (32u * 1024 * 1024)
+
+typedef struct {
+    uint32_t page_faults;   // user pages populated on demand
+    uint32_t cow_copies;    // shared pages copied on a write
+    uint32_t cow_reuses;    // last sharer made the page writable again
+    uint32_t cr3_loads;     // TLB flushes on context switch
+    uint32_t cr3_skips;     // switches that kept the same directory
+    uint32_t invlpgs;
+    uint32_t tlb_flushes;   // full flushes outside context switches
+    uint32_t directories;
+    uint32_t page_tables;   // user page tables in use
+    uint32_t user_pages;    // frames backing user mappings
+} paging_stats_t;
+
+extern paging_stats_t paging_stats;
+extern uint32_t kernel_page_dir;
+
+void paging_init(void);
+uint32_t paging_map_device(uint32_t phys);
+uint32_t paging_create_dir(void);
+uint32_t paging_clone_dir(uint32_t parent);
+void paging_destroy_dir(uint32_t dir);
+void paging_switch(uint32_t dir);
+int paging_map(uint32_t dir, uint32_t virt, uint32_t phys, uint32_t flags);
+uint32_t paging_unmap(uint32_t dir, uint32_t virt);
+void paging_print_stats(void);
+
+#endif
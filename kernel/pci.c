@@ -0,0 +1,57 @@
+// kernel/pci.c - PCI configuration space access (mechanism #1)
+#include "pci.h"
+#include "cpu.h"
+
+static uint32_t pci_read(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset) {
+    outl(PCI_CONFIG_ADDRESS, 0x80000000 | ((uint32_t)bus << 16) |
+         ((uint32_t)slot << 11) | ((uint32_t)function << 8) | (offset & 0xFC));
+    return inl(PCI_CONFIG_DATA);
+}
+
+uint32_t pci_config_read(const pci_device_t* dev, uint8_t offset) {
+    return pci_read(dev->bus, dev->slot, dev->function, offset);
+}
+
+void pci_config_write(const pci_device_t* dev, uint8_t offset, uint32_t value) {
+    outl(PCI_CONFIG_ADDRESS, 0x80000000 | ((uint32_t)dev->bus << 16) |
+         ((uint32_t)dev->slot << 11) | ((uint32_t)dev->function << 8) | (offset & 0xFC));
+    outl(PCI_CONFIG_DATA, value);
+}
+
+// First function with the given class, scanning every bus and slot
+int pci_find_class(uint8_t class_code, uint8_t subclass, pci_device_t* out) {
+    for (int bus = 0; bus < 256; bus++) {
+        for (int slot = 0; slot < 32; slot++) {
+            int functions = 1;
+            
+            for (int function = 0; function < functions; function++) {
+                uint32_t id = pci_read(bus, slot, function, PCI_VENDOR_ID);
+                if ((id & 0xFFFF) == 0xFFFF) {
+                    continue;
+                }
+                if (function == 0 && (pci_read(bus, slot, 0, PCI_HEADER_TYPE) & 0x800000)) {
+                    functions = 8;
+                }
+                
+                uint32_t class_reg = pci_read(bus, slot, function, PCI_CLASS);
+                if ((class_reg >> 24) == class_code && ((class_reg >> 16) & 0xFF) == subclass) {
+                    out->bus = bus;
+                    out->slot = slot;
+                    out->function = function;
+                    out->vendor = id & 0xFFFF;
+                    out->device = id >> 16;
+                    out->class_code = class_code;
+                    out->subclass = subclass;
+                    out->prog_if = (class_reg >> 8) & 0xFF;
+                    return 0;
+                }
+            }
+        }
+    }
+    return -1;
+}
+
+void pci_enable_bus_master(const pci_device_t* dev) {
+    uint32_t command = pci_config_read(dev, PCI_COMMAND);
+    pci_config_write(dev, PCI_COMMAND, command | PCI_COMMAND_IO | PCI_COMMAND_BUS_MASTER);
+}
@@ -0,0 +1,187 @@
+// kernel/pmm.c - Physical page allocator built from the Multiboot memory map
+#include "pmm.h"
+#include "kernel.h"
+#include "string.h"
+#include "cpu.h"
+#include "klog.h"
+
+extern char kernel_start[];
+extern char kernel_end[];
+
+// One bit per page, set while the page is in use or not RAM
+static uint32_t page_bitmap[PMM_MAX_PAGES / 32];
+static uint32_t page_limit;     // pages above this are never RAM
+static uint32_t next_free_word; // where single-page scans start
+
+pmm_stats_t pmm_stats;
+
+static void mark_pages(uint32_t first, uint32_t count, int used) {
+    for (uint32_t page = first; page < first + count && page < PMM_MAX_PAGES; page++) {
+        uint32_t bit = 1u << (page % 32);
+        if (used && !(page_bitmap[page / 32] & bit)) {
+            page_bitmap[page / 32] |= bit;
+            pmm_stats.free_pages--;
+        } else if (!used && (page_bitmap[page / 32] & bit)) {
+            page_bitmap[page / 32] &= ~bit;
+            pmm_stats.free_pages++;
+        }
+    }
+}
+
+// Release whole pages inside [addr, addr + len) to the allocator
+static void add_region(uint64_t addr, uint64_t len) {
+    uint64_t start = (addr + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint64_t end = (addr + len) / PAGE_SIZE;
+    
+    if (end > PMM_MAX_PAGES) end = PMM_MAX_PAGES;
+    if (start >= end) return;
+    
+    mark_pages(start, end - start, 0);
+    pmm_stats.total_pages += end - start;
+    if (end > page_limit) page_limit = end;
+}
+
+static void reserve_region(uint32_t addr, uint32_t len) {
+    uint32_t first = addr / PAGE_SIZE;
+    uint32_t last = (addr + len + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint32_t before = pmm_stats.free_pages;
+    
+    mark_pages(first, last - first, 1);
+    pmm_stats.reserved_pages += before - pmm_stats.free_pages;
+}
+
+void pmm_init(uint32_t magic, const multiboot_info_t* mbi) {
+    memset(page_bitmap, 0xFF, sizeof(page_bitmap));
+    memset(&pmm_stats, 0, sizeof(pmm_stats));
+    page_limit = 0;
+    
+    if (magic == MULTIBOOT_BOOTLOADER_MAGIC && (mbi->flags & MULTIBOOT_INFO_MEM_MAP)) {
+        uint32_t p = mbi->mmap_addr;
+        while (p < mbi->mmap_addr + mbi->mmap_length) {
+            const multiboot_mmap_entry_t* e = (const multiboot_mmap_entry_t*)p;
+            if (e->type == MULTIBOOT_MEMORY_AVAILABLE) {
+                add_region(e->addr, e->len);
+            }
+            p += e->size + 4;
+        }
+    } else if (magic == MULTIBOOT_BOOTLOADER_MAGIC && (mbi->flags & MULTIBOOT_INFO_MEMORY)) {
+        add_region(0x100000, (uint64_t)mbi->mem_upper * 1024);
+    } else {
+        klog(KLOG_WARN, KLOG_MEM, "No memory info from the loader, assuming %u MB",
+             PMM_FALLBACK_MEMORY >> 20);
+        add_region(0x100000, PMM_FALLBACK_MEMORY - 0x100000);
+    }
+    
+    // Low memory holds the BIOS data, the VGA buffer and the boot info
+    reserve_region(0, 0x100000);
+    reserve_region((uint32_t)kernel_start, kernel_end - kernel_start);
+    if (magic == MULTIBOOT_BOOTLOADER_MAGIC) {
+        reserve_region((uint32_t)mbi, sizeof(*mbi));
+        if (mbi->flags & MULTIBOOT_INFO_MEM_MAP) {
+            reserve_region(mbi->mmap_addr, mbi->mmap_length);
+        }
+    }
+    next_free_word = 0;
+    
+    klog(KLOG_INFO, KLOG_MEM, "RAM: %u KB usable, %u KB free after the kernel",
+         pmm_stats.total_pages * 4, pmm_stats.free_pages * 4);
+}
+
+// Length of the free run starting at page, capped at max
+static uint32_t free_run_length(uint32_t page, uint32_t max) {
+    uint32_t len = 0;
+    
+    while (len < max && page < page_limit) {
+        uint32_t bit = page % 32;
+        uint32_t used = page_bitmap[page / 32] >> bit;
+        uint32_t avail = used ? (uint32_t)bit_scan_forward(used) : 32 - bit;
+        
+        len += avail;
+        page += avail;
+        if (avail < 32 - bit) {
+            break;
+        }
+    }
+    return len < max ? len : max;
+}
+
+uint32_t pmm_alloc_page(void) {
+    uint32_t words = (page_limit + 31) / 32;
+    uint32_t flags = irq_save();
+    
+    for (uint32_t i = 0; i < words; i++) {
+        uint32_t word = (next_free_word + i) % words;
+        if (page_bitmap[word] != 0xFFFFFFFF) {
+            uint32_t page = word * 32 + bit_scan_forward(~page_bitmap[word]);
+            mark_pages(page, 1, 1);
+            next_free_word = word;
+            pmm_stats.allocs++;
+            irq_restore(flags);
+            return page * PAGE_SIZE;
+        }
+    }
+    
+    irq_restore(flags);
+    klog(KLOG_ERR, KLOG_MEM, "Out of physical memory");
+    return 0;
+}
+
+// First fit over the bitmap, skipping fully used words
+uint32_t pmm_alloc_pages(uint32_t count) {
+    if (count == 1) {
+        return pmm_alloc_page();
+    }
+    
+    uint32_t flags = irq_save();
+    uint32_t page = 0;
+    
+    while (page < page_limit) {
+        uint32_t word = page / 32;
+        uint32_t free = ~page_bitmap[word] & (0xFFFFFFFF << (page % 32));
+        if (!free) {
+            page = (word + 1) * 32;
+            continue;
+        }
+        
+        uint32_t start = word * 32 + bit_scan_forward(free);
+        uint32_t len = free_run_length(start, count);
+        if (len >= count) {
+            mark_pages(start, count, 1);
+            pmm_stats.allocs++;
+            irq_restore(flags);
+            return start * PAGE_SIZE;
+        }
+        page = start + len;
+    }
+    
+    irq_restore(flags);
+    klog(KLOG_ERR, KLOG_MEM, "No %u contiguous free pages", count);
+    return 0;
+}
+
+void pmm_free_pages(uint32_t addr, uint32_t count) {
+    uint32_t flags = irq_save();
+    mark_pages(addr / PAGE_SIZE, count, 0);
+    pmm_stats.frees++;
+    irq_restore(flags);
+}
+
+// One past the highest page that can be RAM
+uint32_t pmm_page_limit(void) {
+    return page_limit;
+}
+
+void pmm_print_stats(void) {
+    print_string("Physical memory: ");
+    print_int(pmm_stats.total_pages * 4);
+    print_string(" KB usable, ");
+    print_int(pmm_stats.free_pages * 4);
+    print_string(" KB free, ");
+    print_int(pmm_stats.reserved_pages * 4);
+    print_string(" KB reserved\n");
+    print_string("Page allocs: ");
+    print_int(pmm_stats.allocs);
+    print_string(", frees: ");
+    print_int(pmm_stats.frees);
+    print_string("\n");
+}
@@ -0,0 +1,29 @@
+#ifndef PMM_H
+#define PMM_H
+
+#include <stdint.h>
+#include "multiboot.h"
+
+#define PAGE_SIZE 4096
+#define PMM_MAX_MEMORY (1024u * 1024 * 1024) // RAM above 1 GB is not used
+#define PMM_MAX_PAGES (PMM_MAX_MEMORY / PAGE_SIZE)
+#define PMM_FALLBACK_MEMORY (32u * 1024 * 1024) // assumed without boot info
+
+typedef struct {
+    uint32_t total_pages; // usable RAM reported by the loader
+    uint32_t free_pages;
+    uint32_t reserved_pages; // kernel image, boot data, low memory
+    uint32_t allocs;
+    uint32_t frees;
+} pmm_stats_t;
+
+extern pmm_stats_t pmm_stats;
+
+void pmm_init(uint32_t magic, const multiboot_info_t* mbi);
+uint32_t pmm_alloc_page(void);
+uint32_t pmm_alloc_pages(uint32_t count);
+void pmm_free_pages(uint32_t addr, uint32_t count);
+uint32_t pmm_page_limit(void);
+void pmm_print_stats(void);
+
+#endif
@@ -1,74 +1,350 @@
 #include "process.h"
 #include "kernel.h"
+#include "cpu.h"
+#include "runqueue.h"
+#include "ml_scheduler.h"
+#include "timer.h"
+#include "klog.h"
+#include "kmalloc.h"
+#include "pmm.h"
+#include "string.h"
+#include "kstack.h"
+#include "paging.h"
+#include "trace.h"
+#include "stats.h"
+#include "mlfq.h"
+#include "smp.h"
 
 #ifndef NULL
 #define NULL ((void*)0)
 #endif
 
-static pcb_t process_table[MAX_PROCESSES];
+// Slots are sized from installed RAM at boot. Each process gets a PCB
+// from pcb_cache and a pooled stack, both returned when it is reaped.
+static pcb_t** process_table;
+static int process_max;
+static int* free_slots;
+static int free_slot_count;
+static kmem_cache_t* pcb_cache;
 
-pcb_t* current_process = NULL;
-pcb_t* ready_queue = NULL;
+// The running process, the idle context, the ready queues and the exited
+// process whose stack is still in use until the next switch lands are
+// all per CPU, see cpu_t
+#define current_process (this_cpu()->current)
 
 static int next_pid = 1;
 static scheduler_type_t current_scheduler = SCHEDULER_ROUND_ROBIN;
 
-static void delay(int cycles) {
-    for(int i = 0; i < cycles; i++) { 
-        asm volatile ("nop"); 
+// New processes are spread over the first cpu_limit CPUs
+static int cpu_limit = MAX_CPUS;
+
+static const char* scheduler_names[] = { "Round Robin", "ML Based", "MLFQ" };
+
+// Free the PCB and stack of the process that just exited. Runs on the
+// next process's stack, with interrupts disabled.
+static void process_reap(void) {
+    cpu_t* cpu = this_cpu();
+    pcb_t* pcb = cpu->zombie;
+    if (pcb == NULL) return;
+    
+    cpu->zombie = NULL;
+    
+    paging_destroy_dir(pcb->page_dir);
+    kstack_free(pcb->stack_top);
+    process_table[pcb->slot] = NULL;
+    free_slots[free_slot_count++] = pcb->slot;
+    kmem_cache_free(pcb_cache, pcb);
+}
+
+// First code run on a new process stack: enter the process and clean up
+// if its entry point ever returns.
+static void process_trampoline(void) {
+    process_reap();
+    void (*entry)(void) = (void (*)(void))current_process->eip;
+    // Leave the kernel lock section process_switch() was called in
+    irq_restore(EFLAGS_IF);
+    entry();
+    process_exit();
+}
+
+uint32_t context_init_stack(uint32_t stack_top, void (*first_run)(void)) {
+    uint32_t* sp = (uint32_t*)stack_top;
+    *--sp = 0;                      // return address for first_run
+    *--sp = (uint32_t)first_run;    // popped by ret in context_switch
+    *--sp = 0;                      // ebp
+    *--sp = 0;                      // ebx
+    *--sp = 0;                      // esi
+    *--sp = 0;                      // edi
+    return (uint32_t)sp;
+}
+
+// Ticks a process may run before the timer preempts it
+static int process_quantum(pcb_t* pcb) {
+    if (current_scheduler == SCHEDULER_ML_BASED && pcb->predicted_burst > 0) {
+        return pcb->predicted_burst;
     }
+    if (current_scheduler == SCHEDULER_MLFQ) {
+        return mlfq_quantum(pcb->mlfq_level);
+    }
+    return pcb->time_slice;
 }
 
-void process_init(void) {
-    print_string("[PROCESS] Initializing Process Manager...\n");
-    delay(5000000);
+// Run queue level of a process under round robin or MLFQ
+static int sched_level(pcb_t* pcb) {
+    if (current_scheduler == SCHEDULER_MLFQ) {
+        return pcb->mlfq_level;
+    }
+    return rq_level(pcb->priority);
+}
+
+// READY processes live in the structure of the active scheduler, on
+// the CPU given by pcb->cpu
+static void sched_enqueue(pcb_t* pcb) {
+    cpu_t* cpu = &cpus[pcb->cpu];
+    if (current_scheduler == SCHEDULER_ML_BASED) {
+        ml_heap_push(&cpu->ml_heap, pcb);
+    } else {
+        rq_enqueue_at(&cpu->rq, pcb, sched_level(pcb));
+    }
+}
+
+static void sched_dequeue(pcb_t* pcb) {
+    cpu_t* cpu = &cpus[pcb->cpu];
+    if (current_scheduler == SCHEDULER_ML_BASED) {
+        ml_heap_remove(&cpu->ml_heap, pcb);
+    } else {
+        rq_dequeue(&cpu->rq, pcb);
+    }
+}
+
+static pcb_t* sched_peek(cpu_t* cpu) {
+    if (current_scheduler == SCHEDULER_ML_BASED) {
+        return ml_heap_top(&cpu->ml_heap);
+    }
+    return rq_pick_next(&cpu->rq);
+}
+
+static int sched_queued(cpu_t* cpu) {
+    return current_scheduler == SCHEDULER_ML_BASED ? cpu->ml_heap.size : cpu->rq.count;
+}
+
+// Whether pcb should run before cur under the active policy
+static int sched_preempts(pcb_t* pcb, pcb_t* cur) {
+    if (current_scheduler == SCHEDULER_ML_BASED) {
+        return pcb->priority_score > cur->priority_score;
+    }
+    return sched_level(pcb) < sched_level(cur);
+}
+
+// Least loaded CPU for a new process, counting the one it runs
+static int sched_pick_cpu(void) {
+    int best = -1;
+    int best_load = 0;
+    for (int i = 0; i < cpu_count && i < cpu_limit; i++) {
+        cpu_t* cpu = &cpus[i];
+        if (!cpu->online) continue;
+        
+        int load = sched_queued(cpu) + (cpu->current != cpu->idle);
+        if (best < 0 || load < best_load) {
+            best = i;
+            best_load = load;
+        }
+    }
+    return best < 0 ? 0 : best;
+}
+
+// pcb was just queued on its CPU. Ask that CPU to reschedule if pcb
+// should run before what it is running. This CPU notices on the way out
+// of the current interrupt or at its next yield; another one is sent an
+// IPI, which also wakes it from hlt when it is idle.
+static void sched_notify(pcb_t* pcb) {
+    cpu_t* cpu = &cpus[pcb->cpu];
+    int idle = cpu->current == cpu->idle;
+    
+    if (cpu == this_cpu()) {
+        if (!idle && sched_preempts(pcb, cpu->current)) {
+            cpu->need_resched = 1;
+        }
+    } else if (idle || sched_preempts(pcb, cpu->current)) {
+        cpu->need_resched = 1;
+        smp_send_resched(cpu->id);
+    }
+}
+
+// Called with this CPU's queue empty: take the next process of the CPU
+// with the most queued and run it here. Returns NULL if this CPU still
+// has a process to run, or nothing is queued anywhere.
+pcb_t* process_steal(void) {
+    cpu_t* self = this_cpu();
+    if (self->id >= cpu_limit ||
+        (self->current != self->idle && self->current->state == PROCESS_RUNNING)) {
+        return NULL;
+    }
+    
+    cpu_t* victim = NULL;
+    int most = 0;
+    for (int i = 0; i < cpu_count; i++) {
+        int queued = sched_queued(&cpus[i]);
+        if (&cpus[i] != self && queued > most) {
+            victim = &cpus[i];
+            most = queued;
+        }
+    }
+    if (victim == NULL) return NULL;
+    
+    pcb_t* pcb = sched_peek(victim);
+    sched_dequeue(pcb);
+    pcb->cpu = self->id;
+    sched_enqueue(pcb);
+    self->steals++;
+    return pcb;
+}
+
+void process_switch(pcb_t* next) {
+    cpu_t* cpu = this_cpu();
+    pcb_t* prev = cpu->current;
+    if (next == NULL) {
+        if (prev->state == PROCESS_RUNNING) return;
+        next = cpu->idle;
+    }
+    if (next == prev) return;
     
-    for(int i = 0; i < MAX_PROCESSES; i++) {
-        process_table[i].state = PROCESS_NEW;
-        process_table[i].pid = 0;
-        process_table[i].next = NULL;
+    trace_reason_t reason = TRACE_REASON_YIELD;
+    if (prev->state == PROCESS_TERMINATED) {
+        cpu->zombie = prev;
+        reason = TRACE_REASON_EXIT;
+    } else if (prev->state == PROCESS_BLOCKED) {
+        reason = TRACE_REASON_BLOCK;
+    } else if (prev != cpu->idle && prev->ticks_left <= 0) {
+        reason = TRACE_REASON_PREEMPT;
+    }
+    // Charge the run before prev is queued, its level may change
+    uint64_t ran = stats_switch(prev, next);
+    if (prev != cpu->idle && prev->state != PROCESS_TERMINATED) {
+        mlfq_account_burst(prev, ran, reason == TRACE_REASON_PREEMPT,
+                           current_scheduler == SCHEDULER_MLFQ);
+    }
+    if (prev->state == PROCESS_RUNNING) {
+        prev->state = PROCESS_READY;
+        if (prev != cpu->idle) {
+            sched_enqueue(prev);
+            trace_event(TRACE_READY, prev->pid, reason, 0);
+        }
     }
+    if (next != cpu->idle) {
+        sched_dequeue(next);
+    }
+    next->state = PROCESS_RUNNING;
+    next->ticks_left = process_quantum(next);
+    cpu->current = next;
+    cpu->dispatches++;
+    trace_event(TRACE_SWITCH, next->pid, reason, prev->pid);
+    
+    paging_switch(next->page_dir);
+    // This CPU keeps the kernel lock; each process resumes at the depth
+    // it had when it switched out
+    prev->lock_depth = cpu->lock_depth;
+    cpu->lock_depth = next->lock_depth;
+    context_switch(&prev->esp, next->esp);
+    // Possibly on another CPU now: cpu is stale
+    process_reap();
+}
+
+void process_init(void) {
+    klog(KLOG_INFO, KLOG_PROC, "Initializing Process Manager...");
+    
+    process_max = pmm_stats.free_pages / (PROCESS_RAM_PER_SLOT / PAGE_SIZE);
+    if (process_max < PROCESS_MIN) process_max = PROCESS_MIN;
+    if (process_max > PROCESS_LIMIT) process_max = PROCESS_LIMIT;
     
-    process_table[0].pid = 0;
-    process_table[0].state = PROCESS_READY;
-    process_table[0].priority = 0;
+    process_table = kzalloc(process_max * sizeof(pcb_t*));
+    free_slots = kmalloc(process_max * sizeof(int));
+    free_slot_count = 0;
+    for (int i = process_max - 1; i >= 1; i--) {
+        free_slots[free_slot_count++] = i;
+    }
+    pcb_cache = kmem_cache_create("pcb", sizeof(pcb_t));
+    for (int i = 0; i < MAX_CPUS; i++) {
+        rq_init(&cpus[i].rq);
+    }
     
-    const char* idle_name = "idle";
-    int i = 0;
-    while (idle_name[i] != '\0' && i < 31) {
-        process_table[0].name[i] = idle_name[i];
-        i++;
+    if (process_init_cpu(0) < 0) {
+        kernel_panic("No memory for the idle process");
     }
-    process_table[0].name[i] = '\0';
+    process_table[0] = cpus[0].idle;
     
-    current_process = &process_table[0];
-    ready_queue = &process_table[0];
-    ready_queue->next = ready_queue;
+    reset_stats();
     
-    print_string("[PROCESS] Process Manager Ready\n");
-    delay(5000000);
+    klog(KLOG_INFO, KLOG_PROC, "Process Manager Ready (%d slots)", process_max);
+}
+
+// The code that brought a CPU up becomes its idle process. It is never
+// queued and runs when the CPU has nothing else; only CPU 0's is in the
+// process table.
+int process_init_cpu(int id) {
+    pcb_t* idle = kmem_cache_alloc(pcb_cache);
+    if (idle == NULL) return -1;
+    
+    memset(idle, 0, sizeof(pcb_t));
+    idle->pid = 0;
+    idle->state = PROCESS_RUNNING;
+    idle->priority = 0;
+    idle->process_type = -1;
+    idle->heap_index = -1;
+    idle->page_dir = kernel_page_dir;
+    idle->stat_tsc = rdtsc();
+    idle->cpu = id;
+    strcpy(idle->name, "idle");
+    cpus[id].idle = idle;
+    cpus[id].current = idle;
+    cpus[id].page_dir = kernel_page_dir;
+    return 0;
 }
 
 int process_create(void (*entry_point)(void), const char* name, int process_type) {
-    int i;
-    for (i = 1; i < MAX_PROCESSES; i++) {
-        if (process_table[i].state == PROCESS_NEW || 
-            process_table[i].state == PROCESS_TERMINATED) {
-            break;
-        }
+    return process_create_priority(entry_point, name, process_type, 1);
+}
+
+// Start a process on the given address space, which it takes over
+static int process_start(void (*entry_point)(void), const char* name,
+                         int process_type, int priority, uint32_t dir) {
+    pcb_t* pcb = kmem_cache_alloc(pcb_cache);
+    uint32_t stack = kstack_alloc();
+    if (pcb == NULL || stack == 0 || dir == 0) {
+        if (pcb) kmem_cache_free(pcb_cache, pcb);
+        if (stack) kstack_free(stack);
+        if (dir) paging_destroy_dir(dir);
+        klog(KLOG_ERR, KLOG_PROC, "No memory for a new process");
+        return -1;
     }
     
-    if (i >= MAX_PROCESSES) {
-        print_string("[PROCESS] Error: Process table full\n");
-        delay(5000000);
+    uint32_t flags = irq_save();
+    if (free_slot_count == 0) {
+        irq_restore(flags);
+        kmem_cache_free(pcb_cache, pcb);
+        kstack_free(stack);
+        paging_destroy_dir(dir);
+        klog(KLOG_ERR, KLOG_PROC, "Process table full");
         return -1;
     }
+    int slot = free_slots[--free_slot_count];
+    int pid = next_pid++;
+    process_table[slot] = pcb;
+    irq_restore(flags);
     
-    pcb_t* pcb = &process_table[i];
-    pcb->pid = next_pid++;
+    memset(pcb, 0, sizeof(pcb_t));
+    pcb->slot = slot;
+    pcb->stack_top = stack;
+    pcb->page_dir = dir;
+    pcb->pid = pid;
     pcb->state = PROCESS_READY;
-    pcb->priority = 1;
+    pcb->priority = priority;
     pcb->time_slice = 10;
+    pcb->process_type = -1;
+    pcb->heap_index = -1;
+    pcb->arrival_tick = timer_ticks;
+    pcb->stat_tsc = rdtsc();
+    pcb->lock_depth = 1; // process_trampoline() starts inside process_switch()
     
     int j = 0;
     while (name[j] != '\0' && j < 31) {
@@ -78,53 +354,59 @@ int process_create(void (*entry_point)(void), const char* name, int process_type
     pcb->name[j] = '\0';
     
     pcb->eip = (uint32_t)entry_point;
+    pcb->esp = context_init_stack(pcb->stack_top, process_trampoline);
+    pcb->ebp = 0;
     
-    pcb_t* last = ready_queue;
-    while (last->next != ready_queue) {
-        last = last->next;
-    }
-    pcb->next = ready_queue;
-    last->next = pcb;
+    ml_update_process_features(pcb, process_type);
     
-    ml_update_process_features(pcb->pid, process_type);
+    flags = irq_save();
+    pcb->cpu = sched_pick_cpu();
+    sched_enqueue(pcb);
+    sched_notify(pcb);
+    trace_event(TRACE_CREATE, pcb->pid, TRACE_REASON_NEW, pcb->process_type);
+    trace_event(TRACE_READY, pcb->pid, TRACE_REASON_NEW, 0);
+    irq_restore(flags);
     
-    print_string("[PROCESS] Created process: ");
-    delay(5000000);
-    print_string(name);
-    delay(5000000);
-    print_string(" (PID: ");
-    delay(5000000);
-    print_int(pcb->pid);
-    delay(5000000);
-    print_string(")\n");
-    delay(5000000);
+    klog(KLOG_DEBUG, KLOG_PROC, "Created process: %s (PID: %u)", pcb->name, pcb->pid);
     
     return pcb->pid;
 }
 
+int process_create_priority(void (*entry_point)(void), const char* name,
+                            int process_type, int priority) {
+    return process_start(entry_point, name, process_type, priority, paging_create_dir());
+}
+
+// Start entry_point in a copy-on-write copy of the caller's address
+// space. Only page tables are copied; the pages stay shared until written.
+int process_clone(void (*entry_point)(void), const char* name) {
+    pcb_t* parent = current_process;
+    int type = parent->process_type >= 0 ? parent->process_type : 0;
+    
+    return process_start(entry_point, name, type, parent->priority,
+                         paging_clone_dir(parent->page_dir));
+}
+
 void process_schedule(void) {
-    if (ready_queue == NULL) return;
+    cpu_t* cpu = this_cpu();
+    pcb_t* next = rq_pick_next(&cpu->rq);
+    if (next == NULL) {
+        next = process_steal();
+    }
     
-    pcb_t* next = current_process->next;
-    while (next != current_process && next->state != PROCESS_READY) {
-        next = next->next;
+    // A running process keeps the CPU over less urgent ones
+    if (next != NULL && cpu->current->state == PROCESS_RUNNING &&
+        cpu->current != cpu->idle &&
+        sched_level(next) > sched_level(cpu->current)) {
+        next = NULL;
     }
     
-    if (next->state == PROCESS_READY && next != current_process) {
-        current_process->state = PROCESS_READY;
-        next->state = PROCESS_RUNNING;
-        current_process = next;
+    if (next != NULL) {
+        klog(KLOG_DEBUG, KLOG_SCHED, "RR switched to: %s (PID: %u)", next->name, next->pid);
         
-        print_string("[RR] Switched to: ");
-        delay(5000000);
-        print_string(current_process->name);
-        delay(5000000);
-        print_string(" (PID: ");
-        delay(5000000);
-        print_int(current_process->pid);
-        delay(5000000);
-        print_string(")\n");
-        delay(5000000);
+        process_switch(next);
+    } else {
+        process_switch(NULL);
     }
 }
 
@@ -132,73 +414,218 @@ pcb_t* get_current_process(void) {
     return current_process;
 }
 
+int process_capacity(void) {
+    return process_max;
+}
+
+pcb_t* process_get(int slot) {
+    if (slot < 0 || slot >= process_max || process_table[slot] == NULL ||
+        process_table[slot]->state == PROCESS_NEW) {
+        return NULL;
+    }
+    return process_table[slot];
+}
+
 void process_yield(void) {
+    uint32_t flags = irq_save();
+    this_cpu()->need_resched = 0;
     if(current_scheduler == SCHEDULER_ML_BASED) {
         ml_schedule();
     } else {
         process_schedule();
     }
+    if (current_process->ticks_left <= 0) {
+        current_process->ticks_left = process_quantum(current_process);
+    }
+    irq_restore(flags);
+}
+
+// Called from the timer interrupt of each CPU on every tick: the PIT on
+// CPU 0, the local APIC timer on the others
+void process_tick(void) {
+    cpu_t* cpu = this_cpu();
+    if (current_scheduler == SCHEDULER_MLFQ && cpu->id == 0 && mlfq_boost_due()) {
+        for (int i = 0; i < cpu_count; i++) {
+            mlfq_boost(&cpus[i].rq);
+        }
+    }
+    pcb_t* cur = cpu->current;
+    if (cur == cpu->idle) return;
+    
+    cur->cpu_ticks++;
+    if (--cur->ticks_left <= 0) {
+        cpu->need_resched = 1;
+    }
+}
+
+// Called on the way out of an IRQ handler, after the EOI
+void process_preempt(void) {
+    if (this_cpu()->need_resched) {
+        process_yield();
+    }
 }
 
 void process_exit(void) {
+    // Never restored: the switch hands the CPU and the lock to the next process
+    irq_save();
+    // The running process is not on the run queue, nothing to unlink
     current_process->state = PROCESS_TERMINATED;
+    trace_event(TRACE_EXIT, current_process->pid, TRACE_REASON_EXIT, 0);
     
-    pcb_t* prev = ready_queue;
-    while (prev->next != current_process) {
-        prev = prev->next;
-    }
-    prev->next = current_process->next;
+    klog(KLOG_DEBUG, KLOG_PROC, "Process terminated: %s", current_process->name);
     
-    if (current_process == ready_queue) {
-        ready_queue = current_process->next;
+    process_yield();
+}
+
+// The running process gives up the CPU until process_wake(). It is on
+// neither the run queue nor the ML heap, so no policy can pick it.
+static void block_current(void) {
+    current_process->state = PROCESS_BLOCKED;
+    trace_event(TRACE_BLOCK, current_process->pid, TRACE_REASON_BLOCK, 0);
+    process_yield();
+}
+
+// Only real processes can block; the idle context must stay runnable
+int process_can_block(void) {
+    return current_process != this_cpu()->idle;
+}
+
+// Wait on wq until woken. Check the condition being waited for and call
+// this with interrupts disabled, so a wakeup cannot slip in between.
+void process_block(wait_queue_t* wq) {
+    uint32_t flags = irq_save();
+    pcb_t* pcb = current_process;
+    if (pcb == this_cpu()->idle) {
+        kernel_panic("idle process tried to block");
     }
     
-    print_string("[PROCESS] Process terminated: ");
-    delay(5000000);
-    print_string(current_process->name);
-    delay(5000000);
-    print_string("\n");
-    delay(5000000);
+    pcb->wait_next = NULL;
+    if (wq->tail) {
+        wq->tail->wait_next = pcb;
+    } else {
+        wq->head = pcb;
+    }
+    wq->tail = pcb;
+    block_current();
+    irq_restore(flags);
+}
+
+// Make a blocked process ready again, on the CPU it last ran on. Safe
+// from interrupt handlers; the switch happens on the way out of the
+// interrupt if the woken process is more urgent than the one running.
+void process_wake(pcb_t* pcb) {
+    uint32_t flags = irq_save();
+    if (pcb->state == PROCESS_BLOCKED) {
+        pcb->state = PROCESS_READY;
+        pcb->stat_tsc = rdtsc();
+        sched_enqueue(pcb);
+        trace_event(TRACE_READY, pcb->pid, TRACE_REASON_WAKE, 0);
+        sched_notify(pcb);
+    }
+    irq_restore(flags);
+}
+
+int process_wake_one(wait_queue_t* wq) {
+    uint32_t flags = irq_save();
+    pcb_t* pcb = wq->head;
+    if (pcb) {
+        wq->head = pcb->wait_next;
+        if (wq->head == NULL) wq->tail = NULL;
+        process_wake(pcb);
+    }
+    irq_restore(flags);
+    return pcb != NULL;
+}
+
+int process_wake_all(wait_queue_t* wq) {
+    int woken = 0;
+    while (process_wake_one(wq)) {
+        woken++;
+    }
+    return woken;
+}
+
+static void sleep_expired(void* arg) {
+    process_wake((pcb_t*)arg);
+}
+
+// Block until ticks more timer interrupts have fired. The idle context
+// cannot block, so it keeps running other processes until the time is
+// up and must have interrupts enabled.
+void sleep_ticks(uint32_t ticks) {
+    if (current_process == this_cpu()->idle) {
+        uint32_t start = timer_ticks;
+        while (timer_ticks - start < ticks) {
+            process_yield();
+            asm volatile ("hlt");
+        }
+        return;
+    }
     
-    process_yield();
+    uint32_t flags = irq_save();
+    pcb_t* pcb = current_process;
+    timer_wheel_add(&pcb->sleep_timer, timer_ticks + ticks, sleep_expired, pcb);
+    block_current();
+    irq_restore(flags);
 }
 
 void set_scheduler_type(scheduler_type_t type) {
-    current_scheduler = type;
-    print_string("[PROCESS] Scheduler set to: ");
-    delay(5000000);
-    print_string(type == SCHEDULER_ROUND_ROBIN ? "Round Robin" : "ML Based");
-    delay(5000000);
-    print_string("\n");
-    delay(5000000);
+    uint32_t flags = irq_save();
+    if (type != current_scheduler) {
+        // Move every READY process over to the new policy's structure,
+        // in the order the old one would have run them
+        pcb_t* moved = NULL;
+        pcb_t** tail = &moved;
+        pcb_t* pcb;
+        for (int i = 0; i < cpu_count; i++) {
+            while ((pcb = sched_peek(&cpus[i])) != NULL) {
+                sched_dequeue(pcb);
+                *tail = pcb;
+                tail = &pcb->next;
+            }
+        }
+        *tail = NULL;
+        current_scheduler = type;
+        while ((pcb = moved) != NULL) {
+            moved = pcb->next;
+            sched_enqueue(pcb);
+        }
+    }
+    irq_restore(flags);
+    
+    klog(KLOG_INFO, KLOG_SCHED, "Scheduler set to: %s", scheduler_name(type));
+}
+
+// Keep new processes and stealing on CPUs below limit, for measuring
+// how throughput scales. Processes already queued stay where they are.
+void process_set_cpu_limit(int limit) {
+    cpu_limit = limit < 1 ? 1 : limit;
+}
+
+scheduler_type_t get_scheduler_type(void) {
+    return current_scheduler;
+}
+
+const char* scheduler_name(scheduler_type_t type) {
+    return type <= SCHEDULER_MLFQ ? scheduler_names[type] : "?";
 }
 
 void print_process_table(void) {
     print_string("\n=== Process Table ===\n");
-    delay(5000000);
     print_string("Slot PID State Name\n");
-    delay(5000000);
     
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        if (process_table[i].state != PROCESS_NEW) {
+    for (int i = 0; i < process_max; i++) {
+        pcb_t* pcb = process_get(i);
+        if (pcb != NULL) {
             print_int(i);
-            delay(5000000);
             print_string(" ");
-            delay(5000000);
-            print_int(process_table[i].pid);
-            delay(5000000);
+            print_int(pcb->pid);
             print_string(" ");
-            delay(5000000);
-            print_int(process_table[i].state);
-            delay(5000000);
+            print_int(pcb->state);
             print_string(" ");
-            delay(5000000);
-            print_string(process_table[i].name);
-            delay(5000000);
+            print_string(pcb->name);
             print_string("\n");
-            delay(5000000);
         }
     }
     print_string("====================\n");
-    delay(5000000);
 }
\ No newline at end of file
@@ -2,14 +2,21 @@
 #define PROCESS_H
 
 #include <stdint.h>
+#include "timer_wheel.h"
 
-#define MAX_PROCESSES 16
+// Process slots scale with RAM: one per PROCESS_RAM_PER_SLOT, clamped
+#define PROCESS_MIN 16
+#ifndef PROCESS_LIMIT
+#define PROCESS_LIMIT 4096
+#endif
+#define PROCESS_RAM_PER_SLOT (256 * 1024)
 #define STACK_SIZE 4096
 
 // Scheduler types
 typedef enum {
     SCHEDULER_ROUND_ROBIN,
-    SCHEDULER_ML_BASED
+    SCHEDULER_ML_BASED,
+    SCHEDULER_MLFQ
 } scheduler_type_t;
 
 // Process states
@@ -24,6 +31,7 @@ typedef enum {
 // Process Control Block
 typedef struct process_control_block {
     uint32_t pid;
+    int slot;
     process_state_t state;
     uint32_t esp;
     uint32_t ebp;
@@ -32,26 +40,77 @@ typedef struct process_control_block {
     uint32_t stack_top;
     int priority;
     int time_slice;
+    int ticks_left;
+    // ML scheduler features
+    int process_type;
+    int predicted_burst;
+    float priority_score;
+    int heap_index;
+    uint32_t ready_seq;
+    uint32_t arrival_tick;
+    uint32_t cpu_ticks;
+    // Measured CPU bursts, see mlfq.c
+    uint64_t burst_cycles;  // run so far in the current burst
+    uint64_t burst_ewma;    // moving average of completed bursts
+    uint32_t bursts;
+    int mlfq_level;
+    // CPU accounting, see stats.c. stat_tsc is when the process last
+    // started running, stopped running or became ready.
+    uint64_t stat_tsc;
+    uint64_t run_cycles;
+    uint64_t wait_cycles;
+    uint64_t top_run_cycles;
+    uint32_t dispatches;
+    ktimer_t sleep_timer;
+    struct process_control_block *wait_next; // wait queue link
     char name[32];
-    struct process_control_block *next;
+    struct process_control_block *next;     // run queue links
+    struct process_control_block *prev;
+    int queue_level;                        // run queue level while queued
+    int cpu;                                // whose queue holds it, or running it
+    int lock_depth;                         // kernel lock nesting while switched out
 } pcb_t;
 
-// Global variables
-extern pcb_t* ready_queue;
-extern pcb_t* current_process;
+// Processes blocked on one event, woken in FIFO order
+typedef struct {
+    pcb_t* head;
+    pcb_t* tail;
+} wait_queue_t;
 
 // Function declarations
 void process_init(void);
+int process_init_cpu(int cpu);
 int process_create(void (*entry_point)(void), const char* name, int process_type);
+int process_create_priority(void (*entry_point)(void), const char* name,
+                            int process_type, int priority);
+int process_clone(void (*entry_point)(void), const char* name);
 void process_schedule(void);
+pcb_t* process_steal(void);
+void process_set_cpu_limit(int limit);
 void ml_schedule(void);
 pcb_t* get_current_process(void);
+int process_capacity(void);
+pcb_t* process_get(int slot);
 void process_yield(void);
 void process_exit(void);
+void process_block(wait_queue_t* wq);
+void process_wake(pcb_t* pcb);
+int process_wake_one(wait_queue_t* wq);
+int process_wake_all(wait_queue_t* wq);
+int process_can_block(void);
+void sleep_ticks(uint32_t ticks);
+void process_switch(pcb_t* next);
+void process_tick(void);
+void process_preempt(void);
+uint32_t context_init_stack(uint32_t stack_top, void (*first_run)(void));
+void context_switch(uint32_t* old_esp, uint32_t new_esp);
 void set_scheduler_type(scheduler_type_t type);
+scheduler_type_t get_scheduler_type(void);
+const char* scheduler_name(scheduler_type_t type);
 void print_process_table(void);
 void ml_scheduler_init(void);
-void ml_update_process_features(int pid, int process_type);
+void ml_update_process_features(pcb_t* pcb, int process_type);
+int ml_predict_time_slice(const pcb_t* pcb);
 void print_ml_scheduler_stats(void);
 void cpu_process(void);
 void io_process(void); 
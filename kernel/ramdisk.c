@@ -0,0 +1,29 @@
+// kernel/ramdisk.c - Volatile block device backed by .bss
+#include "ramdisk.h"
+#include "string.h"
+
+static uint8_t ramdisk_data[RAMDISK_BLOCKS][BLOCK_SIZE];
+
+static int ramdisk_read(uint32_t block, uint32_t count, void* buf) {
+    if (block + count > RAMDISK_BLOCKS) {
+        return -1;
+    }
+    memcpy(buf, ramdisk_data[block], count * BLOCK_SIZE);
+    return 0;
+}
+
+static int ramdisk_write(uint32_t block, uint32_t count, const void* buf) {
+    if (block + count > RAMDISK_BLOCKS) {
+        return -1;
+    }
+    memcpy(ramdisk_data[block], buf, count * BLOCK_SIZE);
+    return 0;
+}
+
+static block_device_t ramdisk_device = {
+    "ram0", RAMDISK_BLOCKS, ramdisk_read, ramdisk_write, 0, 0
+};
+
+block_device_t* ramdisk_init(void) {
+    return &ramdisk_device;
+}
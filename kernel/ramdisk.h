@@ -0,0 +1,13 @@
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+#include "blockdev.h"
+
+// 2 MB, used when no ATA drive is attached
+#ifndef RAMDISK_BLOCKS
+#define RAMDISK_BLOCKS 4096
+#endif
+
+block_device_t* ramdisk_init(void);
+
+#endif
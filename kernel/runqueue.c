@@ -0,0 +1,68 @@
+// kernel/runqueue.c - O(1) priority run queue
+#include "runqueue.h"
+#include "cpu.h"
+
+#ifndef NULL
+#define NULL ((void*)0)
+#endif
+
+int rq_level(int priority) {
+    if (priority < 0) return 0;
+    if (priority >= RQ_PRIORITIES) return RQ_PRIORITIES - 1;
+    return priority;
+}
+
+void rq_init(runqueue_t* rq) {
+    for (int i = 0; i < RQ_PRIORITIES; i++) {
+        rq->head[i] = NULL;
+        rq->tail[i] = NULL;
+    }
+    rq->bitmap = 0;
+    rq->count = 0;
+}
+
+void rq_enqueue(runqueue_t* rq, pcb_t* pcb) {
+    rq_enqueue_at(rq, pcb, rq_level(pcb->priority));
+}
+
+// Queue at an explicit level; the PCB remembers it for rq_dequeue()
+void rq_enqueue_at(runqueue_t* rq, pcb_t* pcb, int level) {
+    pcb->queue_level = level;
+    pcb->next = NULL;
+    pcb->prev = rq->tail[level];
+    if (rq->tail[level] != NULL) {
+        rq->tail[level]->next = pcb;
+    } else {
+        rq->head[level] = pcb;
+        rq->bitmap |= (1u << level);
+    }
+    rq->tail[level] = pcb;
+    rq->count++;
+}
+
+void rq_dequeue(runqueue_t* rq, pcb_t* pcb) {
+    int level = pcb->queue_level;
+    
+    if (pcb->prev != NULL) {
+        pcb->prev->next = pcb->next;
+    } else {
+        rq->head[level] = pcb->next;
+    }
+    if (pcb->next != NULL) {
+        pcb->next->prev = pcb->prev;
+    } else {
+        rq->tail[level] = pcb->prev;
+    }
+    if (rq->head[level] == NULL) {
+        rq->bitmap &= ~(1u << level);
+    }
+    
+    pcb->next = NULL;
+    pcb->prev = NULL;
+    rq->count--;
+}
+
+pcb_t* rq_pick_next(runqueue_t* rq) {
+    if (rq->bitmap == 0) return NULL;
+    return rq->head[bit_scan_forward(rq->bitmap)];
+}
@@ -0,0 +1,27 @@
+#ifndef RUNQUEUE_H
+#define RUNQUEUE_H
+
+#include <stdint.h>
+#include "process.h"
+
+// Priority 0 is the most urgent level
+#define RQ_PRIORITIES 32
+
+// Ready processes kept in one doubly-linked FIFO per priority level. Bit n
+// of the bitmap is set while level n is non-empty, so the next process is
+// found with a single bsf instead of walking every PCB.
+typedef struct {
+    pcb_t* head[RQ_PRIORITIES];
+    pcb_t* tail[RQ_PRIORITIES];
+    uint32_t bitmap;
+    int count;
+} runqueue_t;
+
+void rq_init(runqueue_t* rq);
+void rq_enqueue(runqueue_t* rq, pcb_t* pcb);
+void rq_enqueue_at(runqueue_t* rq, pcb_t* pcb, int level);
+void rq_dequeue(runqueue_t* rq, pcb_t* pcb);
+pcb_t* rq_pick_next(runqueue_t* rq);
+int rq_level(int priority);
+
+#endif
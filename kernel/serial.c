@@ -0,0 +1,181 @@
+// kernel/serial.c - Interrupt-driven 16550 UART on COM1
+#include "serial.h"
+#include "kernel.h"
+#include "idt.h"
+#include "cpu.h"
+#include "klog.h"
+
+#define UART_DATA      0  // DLAB=0: transmit/receive buffer
+#define UART_IER       1  // DLAB=0: interrupt enable
+#define UART_DLL       0  // DLAB=1: divisor low byte
+#define UART_DLM       1  // DLAB=1: divisor high byte
+#define UART_IIR       2  // read: interrupt identification
+#define UART_FCR       2  // write: FIFO control
+#define UART_LCR       3
+#define UART_MCR       4
+#define UART_LSR       5
+#define UART_SCRATCH   7
+
+#define UART_FIFO_SIZE 16
+#define IER_THR_EMPTY  0x02
+#define LCR_8N1        0x03
+#define LCR_DLAB       0x80
+#define FCR_ENABLE     0xC7  // enable and clear FIFOs, 14-byte threshold
+#define MCR_DTR_RTS    0x03
+#define MCR_OUT2       0x08  // gates the UART interrupt onto the IRQ line
+#define LSR_THR_EMPTY  0x20
+
+// Bytes waiting for the transmitter. The IRQ handler moves them into the
+// UART FIFO whenever it runs empty, so writers never wait on the line.
+static char tx_ring[SERIAL_TX_RING];
+static uint32_t tx_head;
+static uint32_t tx_tail;
+static uint8_t ier_shadow;
+static int serial_present = 0;
+
+serial_stats_t serial_stats;
+
+// Fill the UART FIFO from the ring without waiting. Interrupts must be
+// disabled.
+static void serial_tx_pump(void) {
+    while (tx_tail != tx_head && (inb(COM1_PORT + UART_LSR) & LSR_THR_EMPTY)) {
+        for (int i = 0; i < UART_FIFO_SIZE && tx_tail != tx_head; i++) {
+            outb(COM1_PORT + UART_DATA, tx_ring[tx_tail++ & (SERIAL_TX_RING - 1)]);
+            serial_stats.sent++;
+        }
+    }
+    
+    // Ask for an interrupt only while bytes are left
+    uint8_t ier = tx_tail != tx_head ? IER_THR_EMPTY : 0;
+    if (ier != ier_shadow) {
+        ier_shadow = ier;
+        outb(COM1_PORT + UART_IER, ier);
+    }
+}
+
+static void serial_irq_handler(interrupt_frame_t* frame) {
+    (void)frame;
+    serial_stats.irqs++;
+    inb(COM1_PORT + UART_IIR);
+    serial_tx_pump();
+}
+
+// Returns 0 when a UART answered on COM1
+int serial_init(void) {
+    // A missing port reads back 0xFF instead of the scratch value
+    outb(COM1_PORT + UART_SCRATCH, 0x5A);
+    if (inb(COM1_PORT + UART_SCRATCH) != 0x5A) {
+        klog(KLOG_WARN, KLOG_KERNEL, "No UART on COM1");
+        return -1;
+    }
+    
+    uint16_t divisor = 115200 / SERIAL_BAUD;
+    outb(COM1_PORT + UART_IER, 0x00);
+    outb(COM1_PORT + UART_LCR, LCR_DLAB);
+    outb(COM1_PORT + UART_DLL, divisor & 0xFF);
+    outb(COM1_PORT + UART_DLM, divisor >> 8);
+    outb(COM1_PORT + UART_LCR, LCR_8N1);
+    outb(COM1_PORT + UART_FCR, FCR_ENABLE);
+    outb(COM1_PORT + UART_MCR, MCR_DTR_RTS | MCR_OUT2);
+    
+    tx_head = tx_tail = 0;
+    ier_shadow = 0;
+    serial_present = 1;
+    irq_register_handler(IRQ_COM1, serial_irq_handler);
+    console_register_sink(CONSOLE_SINK_SERIAL, serial_console_write);
+    console_enable_sink(CONSOLE_SINK_SERIAL, 1);
+    
+    klog(KLOG_INFO, KLOG_KERNEL, "COM1 at %u baud", SERIAL_BAUD);
+    return 0;
+}
+
+// Console sink: terminals expect CRLF. When the ring is full the rest
+// of the text is dropped rather than waiting for the line.
+void serial_console_write(const char* str, uint32_t len) {
+    if (!serial_present) return;
+    
+    uint32_t flags = irq_save();
+    for (uint32_t i = 0; i < len; i++) {
+        uint32_t need = str[i] == '\n' ? 2 : 1;
+        if (tx_head - tx_tail + need > SERIAL_TX_RING) {
+            serial_stats.dropped += len - i;
+            break;
+        }
+        if (str[i] == '\n') {
+            tx_ring[tx_head++ & (SERIAL_TX_RING - 1)] = '\r';
+        }
+        tx_ring[tx_head++ & (SERIAL_TX_RING - 1)] = str[i];
+        serial_stats.queued += need;
+    }
+    serial_tx_pump();
+    irq_restore(flags);
+}
+
+// Raw bytes for bulk exports. Unlike the console sink nothing is
+// dropped: the caller waits while the ring is full.
+void serial_write(const void* data, uint32_t len) {
+    const char* p = (const char*)data;
+    if (!serial_present) return;
+    
+    while (len > 0) {
+        uint32_t flags = irq_save();
+        while (len > 0 && tx_head - tx_tail < SERIAL_TX_RING) {
+            tx_ring[tx_head++ & (SERIAL_TX_RING - 1)] = *p++;
+            serial_stats.queued++;
+            len--;
+        }
+        serial_tx_pump();
+        irq_restore(flags);
+        
+        if (len > 0) {
+            asm volatile ("pause");
+        }
+    }
+}
+
+// Wait until every queued byte is in the UART. Used where interrupts
+// may never come back, such as a panic.
+void serial_flush(void) {
+    if (!serial_present) return;
+    
+    uint32_t flags = irq_save();
+    while (tx_tail != tx_head) {
+        serial_tx_pump();
+        asm volatile ("pause");
+    }
+    irq_restore(flags);
+}
+
+static void serial_poll_putc(char c) {
+    while (!(inb(COM1_PORT + UART_LSR) & LSR_THR_EMPTY)) {
+        asm volatile ("pause");
+    }
+    outb(COM1_PORT + UART_DATA, c);
+}
+
+// Console sink once kernel_panic() has started. Sends what is still in
+// the ring, then str, by polling the UART instead of taking the kernel
+// lock.
+void serial_panic_write(const char* str, uint32_t len) {
+    if (!serial_present) return;
+    
+    while (tx_tail != tx_head) {
+        serial_poll_putc(tx_ring[tx_tail++ & (SERIAL_TX_RING - 1)]);
+    }
+    for (uint32_t i = 0; i < len; i++) {
+        if (str[i] == '\n') serial_poll_putc('\r');
+        serial_poll_putc(str[i]);
+    }
+}
+
+void serial_print_stats(void) {
+    print_string("Serial: ");
+    print_int(serial_stats.queued);
+    print_string(" bytes queued, ");
+    print_int(serial_stats.sent);
+    print_string(" sent, ");
+    print_int(serial_stats.dropped);
+    print_string(" dropped, ");
+    print_int(serial_stats.irqs);
+    print_string(" IRQs\n");
+}
@@ -0,0 +1,27 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <stdint.h>
+
+#define COM1_PORT 0x3F8
+#define IRQ_COM1 4
+#define SERIAL_BAUD 115200
+#define SERIAL_TX_RING 16384 // power of two
+
+typedef struct {
+    uint32_t queued;   // bytes accepted into the TX ring
+    uint32_t sent;
+    uint32_t dropped;  // console bytes lost to a full ring
+    uint32_t irqs;
+} serial_stats_t;
+
+extern serial_stats_t serial_stats;
+
+int serial_init(void);
+void serial_write(const void* data, uint32_t len);
+void serial_console_write(const char* str, uint32_t len);
+void serial_flush(void);
+void serial_panic_write(const char* str, uint32_t len);
+void serial_print_stats(void);
+
+#endif
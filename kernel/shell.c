@@ -4,157 +4,324 @@
 #include <stddef.h>
 #include "shell.h"
 #include "string.h"
+#include "bench.h"
+#include "timer.h"
+#include "klog.h"
+#include "bcache.h"
+#include "ata.h"
+#include "kmalloc.h"
+#include "kstack.h"
+#include "paging.h"
+#include "trace.h"
+#include "serial.h"
+#include "stats.h"
+#include "mlfq.h"
+#include "cpu.h"
+#include "smp.h"
+#include "lockstat.h"
 
 #define MAX_COMMAND_LENGTH 64
 #define MAX_ARGUMENTS 8
 
-static void delay(int cycles) {
-    for(int i = 0; i < cycles; i++) { 
-        asm volatile ("nop"); 
-    }
-}
-
 void shell_help(void) {
     print_string("\n=== Mini OS Shell Commands ===\n");
-    delay(5000000);
     
     print_string("help          - Show this help\n");
-    delay(5000000);
     print_string("ls            - List files\n");
-    delay(5000000);
     print_string("cat <file>    - Read file content\n");
-    delay(5000000);
     print_string("create <file> - Create new file\n");
-    delay(5000000);
     print_string("write <file> <text> - Write to file\n");
-    delay(5000000);
+    print_string("append <file> <text> - Append to file\n");
     print_string("delete <file> - Delete file\n");
-    delay(5000000);
     print_string("run <type>    - Run process (cpu/io/ml)\n");
-    delay(5000000);
     print_string("ps            - Show process table\n");
-    delay(5000000);
-    print_string("sched         - Show ML scheduler stats\n");
-    delay(5000000);
+    print_string("sched [policy] - Scheduler stats, or switch to rr/ml/mlfq\n");
+    print_string("top [n|reset] - Per-process CPU use, n refreshes\n");
+    print_string("cpus          - Show per-CPU scheduling stats\n");
+    print_string("locks [reset] - Show the most contended locks\n");
+    print_string("bench [name]  - Run one benchmark or all\n");
+    print_string("tick [hz]     - Show timer stats or set tick rate\n");
+    print_string("sync          - Write cached blocks to disk\n");
+    print_string("cache         - Show buffer cache stats\n");
+    print_string("mem           - Show memory and allocator stats\n");
+    print_string("dmesg         - Show kernel log\n");
+    print_string("pace <on|off> - Slow console output for demos\n");
+    print_string("trace [cmd]   - Scheduler trace: on/off/clear/dump\n");
+    print_string("console [out] - Output to vga, serial or both\n");
     print_string("clear         - Clear screen\n");
-    delay(5000000);
     print_string("==============================\n");
-    delay(5000000);
 }
 
 void shell_ls(void) {
     print_string("\n=== File System Contents ===\n");
-    delay(5000000);
     fs_list();
 }
 
 void shell_cat(char* filename) {
-    char buffer[100];
-    int bytes_read = fs_read(filename, buffer);
-    if(bytes_read > 0) {
-        print_string("File content: ");
-        delay(5000000);
+    char buffer[128];
+    uint32_t offset = 0;
+    int bytes_read;
+    
+    // Stream the file through a small buffer so any size prints
+    while((bytes_read = fs_read_at(filename, offset, buffer, sizeof(buffer) - 1)) > 0) {
+        if(offset == 0) {
+            print_string("File content: ");
+        }
+        buffer[bytes_read] = '\0';
         print_string(buffer);
-        delay(5000000);
+        offset += bytes_read;
+    }
+    
+    if(offset > 0) {
         print_string("\n");
     } else {
         print_string("Error: File not found or empty\n");
     }
-    delay(5000000);
 }
 
 void shell_create(char* filename) {
     if(fs_create(filename) == 0) {
         print_string("File created: ");
-        delay(5000000);
         print_string(filename);
-        delay(5000000);
         print_string("\n");
     } else {
         print_string("Error: Could not create file\n");
     }
-    delay(5000000);
 }
 
 void shell_write(char* filename, char* text) {
     if(fs_write(filename, text) == 0) {
         print_string("Written to: ");
-        delay(5000000);
         print_string(filename);
-        delay(5000000);
         print_string("\n");
     } else {
         print_string("Error: Could not write to file\n");
     }
-    delay(5000000);
+}
+
+void shell_append(char* filename, char* text) {
+    if(fs_append(filename, text, strlen(text)) >= 0) {
+        print_string("Appended to: ");
+        print_string(filename);
+        print_string("\n");
+    } else {
+        print_string("Error: Could not append to file\n");
+    }
 }
 
 void shell_delete(char* filename) {
     if(fs_delete(filename) == 0) {
         print_string("File deleted: ");
-        delay(5000000);
         print_string(filename);
-        delay(5000000);
         print_string("\n");
     } else {
         print_string("Error: Could not delete file\n");
     }
-    delay(5000000);
 }
 
 void shell_run(char* type) {
     if(strcmp(type, "cpu") == 0) {
         int pid = process_create(cpu_process, "CPU_Process", 0);
-        ml_update_process_features(pid, 0);
         print_string("Started CPU process (PID: ");
-        delay(5000000);
         print_int(pid);
-        delay(5000000);
         print_string(")\n");
     }
     else if(strcmp(type, "io") == 0) {
         int pid = process_create(io_process, "IO_Process", 1);
-        ml_update_process_features(pid, 1);
         print_string("Started IO process (PID: ");
-        delay(5000000);
         print_int(pid);
-        delay(5000000);
         print_string(")\n");
     }
     else if(strcmp(type, "ml") == 0) {
         int pid = process_create(ml_process, "ML_Process", 2);
-        ml_update_process_features(pid, 2);
         print_string("Started ML process (PID: ");
-        delay(5000000);
         print_int(pid);
-        delay(5000000);
         print_string(")\n");
     }
     else {
         print_string("Error: Unknown process type. Use: cpu/io/ml\n");
     }
-    delay(5000000);
 }
 
 void shell_ps(void) {
     print_string("\n=== Process Table ===\n");
-    delay(5000000);
     print_process_table();
 }
 
-void shell_sched(void) {
+void shell_sched(char* policy) {
+    if (policy != NULL) {
+        if (strcmp(policy, "rr") == 0) {
+            set_scheduler_type(SCHEDULER_ROUND_ROBIN);
+        } else if (strcmp(policy, "ml") == 0) {
+            set_scheduler_type(SCHEDULER_ML_BASED);
+        } else if (strcmp(policy, "mlfq") == 0) {
+            set_scheduler_type(SCHEDULER_MLFQ);
+        } else {
+            print_string("Error: Policy must be rr, ml or mlfq\n");
+            return;
+        }
+    }
     print_string("\n=== ML Scheduler Stats ===\n");
-    delay(5000000);
+    print_string("Policy: ");
+    print_string(scheduler_name(get_scheduler_type()));
+    print_string("\n");
     print_ml_scheduler_stats();
+    mlfq_print_stats();
+    print_scheduling_stats();
+}
+
+// Redraw once a second. Interrupts are on meanwhile so the timer keeps
+// preempting, even when called from the boot demo.
+void shell_top(char* arg) {
+    int frames = 1;
+    if (arg != NULL) {
+        if (strcmp(arg, "reset") == 0) {
+            reset_stats();
+            print_string("Scheduling stats reset\n");
+            return;
+        }
+        frames = 0;
+        while (*arg >= '0' && *arg <= '9') {
+            frames = frames * 10 + (*arg++ - '0');
+        }
+        if (*arg != '\0' || frames < 1) {
+            print_string("Error: Use top [n|reset]\n");
+            return;
+        }
+    }
+    
+    if (frames == 1) {
+        stats_print_top();
+        return;
+    }
+    
+    // Not irq_save(): it would hold the kernel lock while asleep
+    int was_enabled = interrupts_enabled();
+    interrupts_enable();
+    for (int i = 0; i < frames; i++) {
+        if (i > 0) {
+            sleep_ticks(timer_get_frequency());
+        }
+        clear_screen();
+        stats_print_top();
+    }
+    if (!was_enabled) interrupts_disable();
+}
+
+void shell_cpus(void) {
+    print_string("\n=== CPUs ===\n");
+    smp_print_stats();
+}
+
+void shell_locks(char* arg) {
+    if (arg != NULL) {
+        if (strcmp(arg, "reset") == 0) {
+            lock_stats_reset();
+            print_string("Lock stats reset\n");
+        } else {
+            print_string("Error: Use locks [reset]\n");
+        }
+        return;
+    }
+    print_string("\n=== Locks ===\n");
+    lock_stats_print();
+}
+
+void shell_bench(char* name) {
+    print_string("\n=== Benchmarks ===\n");
+    bench_run(name);
+}
+
+void shell_tick(char* hz) {
+    if (hz != NULL) {
+        int value = 0;
+        while (*hz >= '0' && *hz <= '9') {
+            value = value * 10 + (*hz++ - '0');
+        }
+        if (*hz != '\0' || timer_set_frequency(value) != 0) {
+            print_string("Error: Tick rate must be 19-10000 Hz\n");
+            return;
+        }
+    }
+    timer_print_stats();
+    timer_wheel_print_stats();
+}
+
+void shell_sync(void) {
+    if(fs_sync() == 0) {
+        print_string("File system synced\n");
+    } else {
+        print_string("Error: Sync failed\n");
+    }
+}
+
+void shell_cache(void) {
+    bcache_print_stats();
+    ata_print_stats();
+}
+
+void shell_mem(void) {
+    kmalloc_print_stats();
+    kstack_print_stats();
+    paging_print_stats();
+}
+
+void shell_dmesg(void) {
+    print_string("\n=== Kernel Log ===\n");
+    klog_dump();
+}
+
+void shell_pace(char* mode) {
+    if (strcmp(mode, "on") == 0) {
+        klog_set_pacing(1);
+    } else if (strcmp(mode, "off") == 0) {
+        klog_set_pacing(0);
+    } else {
+        print_string("Error: Use pace on|off\n");
+        return;
+    }
+    print_string("Demo pacing ");
+    print_string(klog_get_pacing() ? "enabled\n" : "disabled\n");
+}
+
+void shell_trace(char* cmd) {
+    if (cmd == NULL) {
+        trace_print_stats();
+    } else if (strcmp(cmd, "on") == 0) {
+        trace_set_enabled(1);
+    } else if (strcmp(cmd, "off") == 0) {
+        trace_set_enabled(0);
+    } else if (strcmp(cmd, "clear") == 0) {
+        trace_clear();
+    } else if (strcmp(cmd, "dump") == 0) {
+        trace_dump();
+    } else {
+        print_string("Error: Use trace [on|off|clear|dump]\n");
+    }
+}
+
+void shell_console(char* sinks) {
+    if (sinks != NULL) {
+        int vga = strcmp(sinks, "vga") == 0 || strcmp(sinks, "both") == 0;
+        int serial = strcmp(sinks, "serial") == 0 || strcmp(sinks, "both") == 0;
+        if (!vga && !serial) {
+            print_string("Error: Use console [vga|serial|both]\n");
+            return;
+        }
+        console_enable_sink(CONSOLE_SINK_VGA, vga);
+        console_enable_sink(CONSOLE_SINK_SERIAL, serial);
+    }
+    print_string("Console: ");
+    print_string(console_sink_enabled(CONSOLE_SINK_VGA) ? "vga " : "");
+    print_string(console_sink_enabled(CONSOLE_SINK_SERIAL) ? "serial" : "");
+    print_string("\n");
+    serial_print_stats();
 }
 
 void execute_command(char* command) {
     print_string("\n> ");
-    delay(5000000);
     print_string(command);
-    delay(5000000);
     print_string("\n");
-    delay(5000000);
     
     char* args[MAX_ARGUMENTS];
     int arg_count = 0;
@@ -187,6 +354,9 @@ void execute_command(char* command) {
     else if(strcmp(args[0], "write") == 0 && arg_count >= 3) {
         shell_write(args[1], args[2]);
     }
+    else if(strcmp(args[0], "append") == 0 && arg_count >= 3) {
+        shell_append(args[1], args[2]);
+    }
     else if(strcmp(args[0], "delete") == 0 && arg_count >= 2) {
         shell_delete(args[1]);
     }
@@ -197,40 +367,67 @@ void execute_command(char* command) {
         shell_ps();
     }
     else if(strcmp(args[0], "sched") == 0) {
-        shell_sched();
+        shell_sched(arg_count >= 2 ? args[1] : NULL);
+    }
+    else if(strcmp(args[0], "top") == 0) {
+        shell_top(arg_count >= 2 ? args[1] : NULL);
+    }
+    else if(strcmp(args[0], "cpus") == 0) {
+        shell_cpus();
+    }
+    else if(strcmp(args[0], "locks") == 0) {
+        shell_locks(arg_count >= 2 ? args[1] : NULL);
+    }
+    else if(strcmp(args[0], "bench") == 0) {
+        shell_bench(arg_count >= 2 ? args[1] : "all");
+    }
+    else if(strcmp(args[0], "tick") == 0) {
+        shell_tick(arg_count >= 2 ? args[1] : NULL);
+    }
+    else if(strcmp(args[0], "sync") == 0) {
+        shell_sync();
+    }
+    else if(strcmp(args[0], "cache") == 0) {
+        shell_cache();
+    }
+    else if(strcmp(args[0], "mem") == 0) {
+        shell_mem();
+    }
+    else if(strcmp(args[0], "dmesg") == 0) {
+        shell_dmesg();
+    }
+    else if(strcmp(args[0], "pace") == 0 && arg_count >= 2) {
+        shell_pace(args[1]);
+    }
+    else if(strcmp(args[0], "trace") == 0) {
+        shell_trace(arg_count >= 2 ? args[1] : NULL);
+    }
+    else if(strcmp(args[0], "console") == 0) {
+        shell_console(arg_count >= 2 ? args[1] : NULL);
     }
     else if(strcmp(args[0], "clear") == 0) {
         print_string("\n\n\n\n\n\n\n\n\n\n");
     }
     else {
         print_string("Error: Unknown command '");
-        delay(5000000);
         print_string(args[0]);
-        delay(5000000);
         print_string("'. Type 'help' for commands.\n");
     }
+    
+    klog_drain();
+    klog_pace();
 }
 
 void shell_start(void) {
     print_string("\n=== Mini OS Shell Demo ===\n");
-    delay(5000000);
     
     execute_command("help");
-    delay(5000000);
-    
     execute_command("ls");
-    delay(5000000);
-    
     execute_command("cat readme.txt");
-    delay(5000000);
-    
     execute_command("ps");
-    delay(5000000);
-    
     execute_command("sched");
-    delay(5000000);
+    execute_command("bench switch");
     
     print_string("\n=== Demo Complete ===\n");
-    delay(5000000);
     print_string("All systems working: Bootloader + Kernel + Processes + ML + FS\n");
 }
\ No newline at end of file
@@ -10,9 +10,22 @@ void shell_ls(void);
 void shell_cat(char* filename);
 void shell_create(char* filename);
 void shell_write(char* filename, char* text);
+void shell_append(char* filename, char* text);
 void shell_delete(char* filename);
 void shell_run(char* type);
 void shell_ps(void);
-void shell_sched(void);
+void shell_sched(char* policy);
+void shell_top(char* arg);
+void shell_cpus(void);
+void shell_locks(char* arg);
+void shell_bench(char* name);
+void shell_tick(char* hz);
+void shell_sync(void);
+void shell_cache(void);
+void shell_mem(void);
+void shell_dmesg(void);
+void shell_pace(char* mode);
+void shell_trace(char* cmd);
+void shell_console(char* sinks);
 
 #endif
\ No newline at end of file
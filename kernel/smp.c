@@ -0,0 +1,314 @@
+// kernel/smp.c - Application processor startup, local APICs and the kernel lock
+#include "smp.h"
+#include "kernel.h"
+#include "acpi.h"
+#include "gdt.h"
+#include "idt.h"
+#include "paging.h"
+#include "kstack.h"
+#include "timer.h"
+#include "klog.h"
+#include "string.h"
+#include "spinlock.h"
+#include <stddef.h>
+
+// Local APIC registers, as byte offsets from its base
+#define LAPIC_ID            0x020
+#define LAPIC_EOI           0x0B0
+#define LAPIC_SVR           0x0F0
+#define LAPIC_ICR_LOW       0x300
+#define LAPIC_ICR_HIGH      0x310
+#define LAPIC_LVT_TIMER     0x320
+#define LAPIC_LVT_LINT0     0x350
+#define LAPIC_LVT_LINT1     0x360
+#define LAPIC_TIMER_INITIAL 0x380
+#define LAPIC_TIMER_CURRENT 0x390
+#define LAPIC_TIMER_DIVIDE  0x3E0
+
+#define LAPIC_SVR_ENABLE    0x100
+#define LAPIC_LVT_MASKED    0x10000
+#define LAPIC_LVT_EXTINT    0x700
+#define LAPIC_LVT_NMI       0x400
+#define LAPIC_TIMER_PERIODIC 0x20000
+#define LAPIC_DIVIDE_16     0x3
+#define ICR_INIT            0x4500 // INIT, level assert
+#define ICR_STARTUP         0x4600 // startup IPI, vector = page number
+#define ICR_NMI             0x0400
+#define ICR_PENDING         0x1000
+#define ICR_ALL_BUT_SELF    0xC0000 // destination shorthand
+
+#define LAPIC_CALIBRATE_US  10000
+#define AP_START_TIMEOUT_US 100000
+
+cpu_t cpus[MAX_CPUS];
+int cpu_count = 1;
+int cpus_online = 1;
+
+// Every section that masks interrupts through irq_save() also holds this
+// lock, so the single-CPU assumption the rest of the kernel was written
+// under holds across CPUs too: only one of them is ever inside such a
+// section. The lock is taken on the outermost irq_save() of a CPU and
+// stays with the CPU across context switches; process_switch() moves the
+// nesting depth over to the next process. Profiled, since it is the
+// first place to look for a serialization point.
+static lock_stats_t kernel_lock_stats = LOCK_STATS_INIT("kernel");
+static spinlock_t kernel_lock = SPINLOCK_INIT_STATS(&kernel_lock_stats);
+
+static uint32_t lapic_phys;
+static volatile uint32_t* lapic;
+static uint32_t lapic_timer_count; // initial count for one tick
+
+// Real-mode entry point, see kernel/trampoline.s
+extern uint8_t trampoline_start[];
+extern uint8_t trampoline_end[];
+extern uint8_t trampoline_params[];
+
+typedef struct {
+    uint32_t cr3;
+    uint32_t cr4;
+    uint32_t cr0;
+    uint32_t stack;
+    uint32_t entry;
+    uint32_t cpu;
+} __attribute__((packed)) trampoline_params_t;
+
+void kernel_lock_acquire(void) {
+    cpu_t* cpu = this_cpu();
+    if (cpu->lock_depth++ == 0) {
+        spin_lock(&kernel_lock);
+    }
+}
+
+void kernel_lock_release(void) {
+    cpu_t* cpu = this_cpu();
+    if (--cpu->lock_depth == 0) {
+        spin_unlock(&kernel_lock);
+    }
+}
+
+static uint32_t lapic_read(uint32_t reg) {
+    return lapic[reg / 4];
+}
+
+static void lapic_write(uint32_t reg, uint32_t val) {
+    lapic[reg / 4] = val;
+}
+
+void lapic_eoi(void) {
+    if (lapic) lapic_write(LAPIC_EOI, 0);
+}
+
+static void udelay(uint32_t us) {
+    uint64_t cycles = div64_u32((uint64_t)timer_tsc_khz() * us, 1000);
+    uint64_t start = rdtsc();
+    while (rdtsc() - start < cycles) {
+        asm volatile ("pause");
+    }
+}
+
+// Send an IPI and wait until the local APIC has delivered it
+static void lapic_send_ipi(uint8_t apic_id, uint32_t command) {
+    lapic_write(LAPIC_ICR_HIGH, (uint32_t)apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, command);
+    while (lapic_read(LAPIC_ICR_LOW) & ICR_PENDING) {
+        asm volatile ("pause");
+    }
+}
+
+// The boot CPU keeps taking the 8259's interrupts through LINT0 (virtual
+// wire mode), the others ignore them
+static void lapic_init_cpu(int bsp) {
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+    lapic_write(LAPIC_LVT_LINT0, bsp ? LAPIC_LVT_EXTINT : LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_LVT_LINT1, bsp ? LAPIC_LVT_NMI : LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_EOI, 0);
+}
+
+// Count the APIC timer down for a fixed TSC interval. The bus clock is
+// the same on every CPU, so one calibration serves them all.
+static void lapic_timer_calibrate(void) {
+    lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_DIVIDE_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_TIMER_INITIAL, 0xFFFFFFFF);
+    udelay(LAPIC_CALIBRATE_US);
+    uint32_t elapsed = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CURRENT);
+    lapic_write(LAPIC_TIMER_INITIAL, 0);
+    
+    lapic_timer_count = (uint32_t)div64_u32((uint64_t)elapsed * (1000000 / LAPIC_CALIBRATE_US),
+                                            timer_get_frequency());
+    if (lapic_timer_count == 0) lapic_timer_count = 1;
+}
+
+// The PIT ticks the boot CPU; the others get the same rate from their APIC
+static void lapic_timer_start(void) {
+    lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_DIVIDE_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_PERIODIC | LAPIC_TIMER_VECTOR);
+    lapic_write(LAPIC_TIMER_INITIAL, lapic_timer_count);
+}
+
+static void lapic_timer_handler(interrupt_frame_t* frame) {
+    (void)frame;
+    this_cpu()->ticks++;
+    process_tick();
+}
+
+// Nothing to do here: interrupt_dispatch() reschedules on the way out
+static void resched_handler(interrupt_frame_t* frame) {
+    (void)frame;
+    this_cpu()->resched_ipis++;
+}
+
+void smp_send_resched(int cpu) {
+    if (lapic == NULL || !cpus[cpu].online) return;
+    lapic_send_ipi(cpus[cpu].apic_id, IPI_RESCHED_VECTOR);
+}
+
+// From panic_begin(). An NMI gets through even to a CPU spinning with
+// interrupts masked; interrupt_dispatch() halts it.
+void smp_halt_others(void) {
+    if (lapic == NULL) return;
+    lapic_send_ipi(0, ICR_ALL_BUT_SELF | ICR_NMI);
+}
+
+// Per-CPU data of the boot CPU. irq_save() needs it, so this runs before
+// anything else in kernel_main().
+void smp_init_bsp(void) {
+    cpu_t* cpu = &cpus[0];
+    cpu->self = cpu;
+    cpu->id = 0;
+    cpu->online = 1;
+    gdt_init_cpu(0, cpu, sizeof(cpu_t));
+}
+
+// Read the CPU list from the MADT. Runs before paging, while the ACPI
+// tables and the local APIC can still be read at their physical address.
+void smp_detect(void) {
+    acpi_madt_info_t info;
+    if (acpi_find_madt(&info) < 0) return;
+    
+    lapic_phys = info.lapic_addr;
+    uint8_t bsp_id = ((volatile uint32_t*)lapic_phys)[LAPIC_ID / 4] >> 24;
+    cpus[0].apic_id = bsp_id;
+    
+    for (int i = 0; i < info.cpu_count && cpu_count < MAX_CPUS; i++) {
+        if (info.apic_ids[i] == bsp_id) continue;
+        cpu_t* cpu = &cpus[cpu_count];
+        cpu->self = cpu;
+        cpu->id = cpu_count;
+        cpu->apic_id = info.apic_ids[i];
+        cpu_count++;
+    }
+    if (info.cpu_count > MAX_CPUS) {
+        klog(KLOG_WARN, KLOG_KERNEL, "SMP: using %d of %d CPUs", MAX_CPUS, info.cpu_count);
+    }
+}
+
+// First C code on an application processor, on the stack start_ap() gave it
+static void ap_main(int id) {
+    cpu_t* cpu = &cpus[id];
+    gdt_init_cpu(id, cpu, sizeof(cpu_t));
+    idt_load();
+    lapic_init_cpu(0);
+    lapic_timer_start();
+    
+    klog(KLOG_INFO, KLOG_KERNEL, "SMP: CPU %d (APIC %u) online", id, cpu->apic_id);
+    __sync_fetch_and_add(&cpus_online, 1);
+    cpu->online = 1;
+    
+    // Become this CPU's idle process
+    interrupts_enable();
+    while (1) {
+        process_yield();
+        asm volatile ("hlt");
+    }
+}
+
+// INIT, then up to two startup IPIs pointing at the trampoline, as in the
+// MultiProcessor Specification's universal startup algorithm
+static int start_ap(int id) {
+    cpu_t* cpu = &cpus[id];
+    uint32_t stack = kstack_alloc();
+    if (stack == 0 || process_init_cpu(id) < 0) {
+        if (stack) kstack_free(stack);
+        klog(KLOG_ERR, KLOG_KERNEL, "SMP: no memory for CPU %d", id);
+        return -1;
+    }
+    cpu->page_dir = kernel_page_dir;
+    
+    trampoline_params_t* params = (trampoline_params_t*)
+        (TRAMPOLINE_BASE + (trampoline_params - trampoline_start));
+    params->cr3 = kernel_page_dir;
+    params->cr4 = read_cr4();
+    params->cr0 = read_cr0();
+    params->stack = stack;
+    params->entry = (uint32_t)ap_main;
+    params->cpu = id;
+    
+    lapic_send_ipi(cpu->apic_id, ICR_INIT);
+    udelay(10000);
+    for (int i = 0; i < 2 && !cpu->online; i++) {
+        lapic_send_ipi(cpu->apic_id, ICR_STARTUP | (TRAMPOLINE_BASE >> 12));
+        udelay(200);
+    }
+    
+    uint64_t start = rdtsc();
+    uint64_t timeout = div64_u32((uint64_t)timer_tsc_khz() * AP_START_TIMEOUT_US, 1000);
+    while (!cpu->online) {
+        if (rdtsc() - start > timeout) {
+            klog(KLOG_ERR, KLOG_KERNEL, "SMP: CPU %d (APIC %u) did not start", id, cpu->apic_id);
+            return -1;
+        }
+        asm volatile ("pause");
+    }
+    return 0;
+}
+
+// Start every CPU smp_detect() found, one at a time since they share the
+// trampoline. Needs paging, the process manager and the TSC calibration.
+void smp_boot_aps(void) {
+    if (cpu_count < 2) {
+        klog(KLOG_INFO, KLOG_KERNEL, "SMP: single CPU");
+        return;
+    }
+    
+    lapic = (volatile uint32_t*)paging_map_device(lapic_phys);
+    lapic_init_cpu(1);
+    lapic_timer_calibrate();
+    idt_register_handler(LAPIC_TIMER_VECTOR, lapic_timer_handler);
+    idt_register_handler(IPI_RESCHED_VECTOR, resched_handler);
+    memcpy((void*)TRAMPOLINE_BASE, trampoline_start, trampoline_end - trampoline_start);
+    
+    for (int id = 1; id < cpu_count; id++) {
+        start_ap(id);
+    }
+    klog(KLOG_INFO, KLOG_KERNEL, "SMP: %d of %d CPUs online, APIC timer %u/tick",
+         cpus_online, cpu_count, lapic_timer_count);
+}
+
+void smp_print_stats(void) {
+    for (int i = 0; i < cpu_count; i++) {
+        cpu_t* cpu = &cpus[i];
+        uint32_t flags = irq_save();
+        int queued = get_scheduler_type() == SCHEDULER_ML_BASED ? cpu->ml_heap.size : cpu->rq.count;
+        const char* running = cpu->current ? cpu->current->name : "-";
+        irq_restore(flags);
+        
+        print_string("CPU ");
+        print_int(i);
+        print_string(" (APIC ");
+        print_int(cpu->apic_id);
+        print_string(cpu->online ? "): " : "): offline, ");
+        print_int(i == 0 ? timer_ticks : cpu->ticks);
+        print_string(" ticks, ");
+        print_int(cpu->dispatches);
+        print_string(" dispatches, ");
+        print_int(cpu->steals);
+        print_string(" steals, ");
+        print_int(cpu->resched_ipis);
+        print_string(" IPIs, ");
+        print_int(queued);
+        print_string(" queued, running ");
+        print_string(running);
+        print_string("\n");
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include <stdint.h>
+#include "cpu.h"
+#include "process.h"
+#include "runqueue.h"
+#include "ml_scheduler.h"
+
+// The real-mode entry point of the application processors is copied
+// here. pmm never hands out the low 1 MB, so the page is always free.
+#define TRAMPOLINE_BASE 0x8000
+
+// Per-CPU state, reached through the %gs segment of each CPU
+typedef struct cpu {
+    struct cpu* self;           // %gs:0, see this_cpu()
+    int id;                     // index into cpus[], 0 is the boot CPU
+    uint8_t apic_id;
+    volatile int online;
+    pcb_t* current;             // running on this CPU
+    pcb_t* idle;                // runs when both queues are empty
+    pcb_t* zombie;              // exited, stack freed after the next switch
+    runqueue_t rq;              // READY processes under RR and MLFQ
+    ml_heap_t ml_heap;          // READY processes under the ML policy
+    volatile int need_resched;
+    int lock_depth;             // kernel lock nesting, see smp.c
+    uint32_t page_dir;          // directory loaded in CR3
+    uint32_t window_gen;        // kernel window flushes seen, see paging.c
+    uint32_t ticks;             // local APIC timer interrupts
+    uint32_t dispatches;
+    uint32_t steals;            // processes taken from another CPU's queue
+    uint32_t resched_ipis;      // received
+} cpu_t;
+
+extern cpu_t cpus[MAX_CPUS];
+extern int cpu_count;           // CPUs found, online or not
+extern int cpus_online;
+
+#ifdef HOSTED
+static inline cpu_t* this_cpu(void) {
+    return &cpus[0];
+}
+#else
+static inline cpu_t* this_cpu(void) {
+    cpu_t* cpu;
+    asm volatile ("mov %%gs:0, %0" : "=r"(cpu));
+    return cpu;
+}
+#endif
+
+void smp_init_bsp(void);
+void smp_detect(void);
+void smp_boot_aps(void);
+void smp_send_resched(int cpu);
+void smp_halt_others(void);
+void lapic_eoi(void);
+void smp_print_stats(void);
+
+#endif
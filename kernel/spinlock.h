@@ -0,0 +1,60 @@
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cpu.h"
+#include "lockstat.h"
+
+// Busy-waiting ticket lock for short sections. Each CPU takes the next
+// ticket and waits until owner reaches it, so waiters get the lock in
+// the order they arrived and none of them starves. Callers keep
+// interrupts masked while they hold it, or an interrupt handler taking
+// the same lock on this CPU would spin forever; spin_lock_irqsave()
+// does both.
+typedef struct {
+    volatile uint16_t next;     // ticket of the next CPU to arrive
+    volatile uint16_t owner;    // ticket being served
+    lock_stats_t* stats;        // NULL when not profiled
+} spinlock_t;
+
+#define SPINLOCK_INIT { 0, 0, NULL }
+#define SPINLOCK_INIT_STATS(stats) { 0, 0, (stats) }
+
+static inline void spin_lock(spinlock_t* lock) {
+    uint16_t ticket = __sync_fetch_and_add(&lock->next, 1);
+    if (lock->owner == ticket) {
+        if (lock->stats) lock_stats_acquired(lock->stats, 0, 0);
+        return;
+    }
+    
+    uint64_t start = lock->stats ? rdtsc() : 0;
+    // Wait with plain reads so the cache line is not bounced
+    while (lock->owner != ticket) {
+        asm volatile ("pause");
+    }
+    asm volatile ("" : : : "memory");
+    if (lock->stats) lock_stats_acquired(lock->stats, 1, rdtsc() - start);
+}
+
+// Only the holder writes owner, and x86 does not reorder a store with
+// earlier loads or stores, so a compiler barrier is enough
+static inline void spin_unlock(spinlock_t* lock) {
+    asm volatile ("" : : : "memory");
+    lock->owner = lock->owner + 1;
+}
+
+// For locks also taken by interrupt handlers. Masks interrupts on this
+// CPU only, unlike irq_save() it does not take the kernel lock.
+static inline uint32_t spin_lock_irqsave(spinlock_t* lock) {
+    uint32_t flags = local_irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t* lock, uint32_t flags) {
+    spin_unlock(lock);
+    local_irq_restore(flags);
+}
+
+#endif
@@ -1,60 +1,279 @@
+// kernel/stats.c - Scheduling statistics and per-process CPU accounting
 #include "stats.h"
 #include "kernel.h"
+#include "cpu.h"
+#include "timer.h"
+#include "smp.h"
+#include <stddef.h>
 
-static int schedule_count[3] = {0, 0, 0}; // CPU, IO, ML
-static int total_schedules = 0;
+sched_type_stats_t sched_type_stats[STATS_TYPES];
+
+static uint64_t idle_cycles;
+static uint64_t top_last;       // TSC of the previous top frame or reset
+static uint64_t top_idle_last;
+
+static const char* type_names[STATS_TYPES] = { "CPU", "IO ", "ML " };
+static const char* state_names[] = { "new  ", "ready", "run  ", "block", "exit " };
+
+typedef struct {
+    uint32_t pid;
+    int type;
+    int state;
+    uint64_t busy;
+    uint64_t run_cycles;
+    uint64_t wait_cycles;
+    uint32_t dispatches;
+    char name[16];
+} top_row_t;
+
+static uint32_t tsc_khz(void) {
+    uint32_t khz = timer_tsc_khz();
+    return khz ? khz : 1000000;
+}
+
+static uint32_t cycles_to_ms(uint64_t cycles) {
+    return (uint32_t)div64_u32(cycles, tsc_khz());
+}
+
+static uint32_t cycles_to_us(uint64_t cycles) {
+    uint64_t us = div64_u32(cycles * 1000, tsc_khz());
+    return us > 0xFFFFFFFFu ? 0xFFFFFFFFu : (uint32_t)us;
+}
+
+// part as a percentage of whole; div64_u32 wants a 32-bit divisor
+static uint32_t percent(uint64_t part, uint64_t whole) {
+    while (whole > 0xFFFFFFFFu) {
+        part >>= 1;
+        whole >>= 1;
+    }
+    return whole ? (uint32_t)div64_u32(part * 100, (uint32_t)whole) : 0;
+}
 
 void update_schedule_stats(int process_type) {
-    if(process_type >= 0 && process_type <= 2) {
-        schedule_count[process_type]++;
-        total_schedules++;
+    if(process_type >= 0 && process_type < STATS_TYPES) {
+        sched_type_stats[process_type].schedules++;
     }
 }
 
+// Called from process_switch() with interrupts disabled. prev stops
+// running and next stops waiting at the same TSC reading. Returns how
+// long prev ran.
+uint64_t stats_switch(pcb_t* prev, pcb_t* next) {
+    uint64_t now = rdtsc();
+    uint64_t ran = now - prev->stat_tsc;
+    
+    prev->run_cycles += ran;
+    prev->stat_tsc = now;
+    if (prev->process_type >= 0 && prev->process_type < STATS_TYPES) {
+        sched_type_stats[prev->process_type].run_cycles += ran;
+    } else if (prev->pid == 0) {
+        idle_cycles += ran;
+    }
+    
+    uint64_t waited = now - next->stat_tsc;
+    next->stat_tsc = now;
+    next->dispatches++;
+    if (next->process_type < 0 || next->process_type >= STATS_TYPES) return ran;
+    
+    sched_type_stats_t* s = &sched_type_stats[next->process_type];
+    next->wait_cycles += waited;
+    s->wait_cycles += waited;
+    update_schedule_stats(next->process_type);
+    
+    uint32_t us = cycles_to_us(waited);
+    int bucket = us ? bit_scan_reverse(us) + 1 : 0;
+    if (bucket >= STATS_LAT_BUCKETS) bucket = STATS_LAT_BUCKETS - 1;
+    s->latency[bucket]++;
+    if (us > s->latency_max_us) s->latency_max_us = us;
+    return ran;
+}
+
+// Upper bound in us of the bucket holding the pct-th percentile latency
+static uint32_t latency_percentile(const sched_type_stats_t* s, uint32_t pct) {
+    if (s->schedules == 0) return 0;
+    
+    uint32_t rank = (uint32_t)div64_u32((uint64_t)s->schedules * pct + 99, 100);
+    uint32_t seen = 0;
+    for (int b = 0; b < STATS_LAT_BUCKETS - 1; b++) {
+        seen += s->latency[b];
+        if (seen >= rank) return 1u << b;
+    }
+    return s->latency_max_us;
+}
+
+static uint32_t total_schedules(void) {
+    uint32_t total = 0;
+    for (int t = 0; t < STATS_TYPES; t++) {
+        total += sched_type_stats[t].schedules;
+    }
+    return total;
+}
+
 void print_scheduling_stats(void) {
-    print_string("\n=== ML Scheduling Statistics ===\n");
-    print_string("Process Type  Schedules  Percentage\n");
-    print_string("------------  ---------  ----------\n");
-    
-    print_string("CPU           ");
-    print_int(schedule_count[0]);
-    print_string("         ");
-    if(total_schedules > 0) {
-        print_int((schedule_count[0] * 100) / total_schedules);
-        print_string("%\n");
-    } else {
-        print_string("0%\n");
-    }
-    
-    print_string("IO            ");
-    print_int(schedule_count[1]);
-    print_string("         ");
-    if(total_schedules > 0) {
-        print_int((schedule_count[1] * 100) / total_schedules);
-        print_string("%\n");
-    } else {
-        print_string("0%\n");
-    }
-    
-    print_string("ML            ");
-    print_int(schedule_count[2]);
-    print_string("         ");
-    if(total_schedules > 0) {
-        print_int((schedule_count[2] * 100) / total_schedules);
-        print_string("%\n");
-    } else {
-        print_string("0%\n");
-    }
-    
-    print_string("Total: ");
-    print_int(total_schedules);
+    uint32_t total = total_schedules();
+    uint64_t busy = idle_cycles;
+    for (int t = 0; t < STATS_TYPES; t++) {
+        busy += sched_type_stats[t].run_cycles;
+    }
+    
+    print_string("\n=== Scheduling Statistics ===\n");
+    print_string("Type Sched   Share Run%  Run ms   Wait ms  p50us  p99us  Max us\n");
+    for (int t = 0; t < STATS_TYPES; t++) {
+        sched_type_stats_t* s = &sched_type_stats[t];
+        print_string(type_names[t]);
+        print_string("  ");
+        print_col(s->schedules, 8);
+        print_col(total ? s->schedules * 100 / total : 0, 6);
+        print_col(percent(s->run_cycles, busy), 6);
+        print_col(cycles_to_ms(s->run_cycles), 9);
+        print_col(cycles_to_ms(s->wait_cycles), 9);
+        print_col(latency_percentile(s, 50), 7);
+        print_col(latency_percentile(s, 99), 7);
+        print_col(s->latency_max_us, 0);
+        print_string("\n");
+    }
+    print_string("Idle ");
+    print_col(percent(idle_cycles, busy), 0);
+    print_string("%, total ");
+    print_int(total);
     print_string(" schedules\n");
-    print_string("===============================\n");
+    
+    print_string("Ready-to-run latency (us): CPU IO ML\n");
+    for (int b = 0; b < STATS_LAT_BUCKETS; b++) {
+        uint32_t any = 0;
+        for (int t = 0; t < STATS_TYPES; t++) {
+            any |= sched_type_stats[t].latency[b];
+        }
+        if (!any) continue;
+        
+        print_string(b == STATS_LAT_BUCKETS - 1 ? ">=" : " <");
+        print_col(b == STATS_LAT_BUCKETS - 1 ? 1u << (b - 1) : 1u << b, 8);
+        for (int t = 0; t < STATS_TYPES; t++) {
+            print_col(sched_type_stats[t].latency[b], 8);
+        }
+        print_string("\n");
+    }
+    print_string("=============================\n");
+}
+
+// One frame: per-type totals and starvation, then the busiest processes
+// since the previous frame
+void stats_print_top(void) {
+    top_row_t rows[TOP_ROWS];
+    int count = 0;
+    uint32_t ready[STATS_TYPES] = { 0, 0, 0 };
+    uint64_t oldest[STATS_TYPES] = { 0, 0, 0 };
+    int processes = 0;
+    
+    uint32_t flags = irq_save();
+    uint64_t now = rdtsc();
+    uint64_t interval = now - top_last;
+    uint64_t idle = idle_cycles - top_idle_last;
+    top_last = now;
+    top_idle_last = idle_cycles;
+    
+    for (int i = 1; i < process_capacity(); i++) {
+        pcb_t* pcb = process_get(i);
+        if (pcb == NULL) continue;
+        processes++;
+        
+        uint64_t busy = pcb->run_cycles - pcb->top_run_cycles;
+        pcb->top_run_cycles = pcb->run_cycles;
+        // A running process has not been charged since its last dispatch
+        if (pcb->state == PROCESS_RUNNING) busy += now - pcb->stat_tsc;
+        
+        int type = pcb->process_type;
+        if (pcb->state == PROCESS_READY && type >= 0 && type < STATS_TYPES) {
+            ready[type]++;
+            if (now - pcb->stat_tsc > oldest[type]) oldest[type] = now - pcb->stat_tsc;
+        }
+        
+        if (count == TOP_ROWS && busy <= rows[count - 1].busy) continue;
+        int j = count < TOP_ROWS ? count++ : count - 1;
+        while (j > 0 && rows[j - 1].busy < busy) {
+            rows[j] = rows[j - 1];
+            j--;
+        }
+        top_row_t* row = &rows[j];
+        row->pid = pcb->pid;
+        row->type = type;
+        row->state = pcb->state;
+        row->busy = busy;
+        row->run_cycles = pcb->run_cycles;
+        row->wait_cycles = pcb->wait_cycles;
+        row->dispatches = pcb->dispatches;
+        int k = 0;
+        while (pcb->name[k] != '\0' && k < 15) {
+            row->name[k] = pcb->name[k];
+            k++;
+        }
+        row->name[k] = '\0';
+    }
+    irq_restore(flags);
+    
+    print_string("top - ");
+    print_int(timer_ticks / timer_get_frequency());
+    print_string("s up, ");
+    print_string(scheduler_name(get_scheduler_type()));
+    print_string(", ");
+    print_int(cpus_online);
+    print_string(" CPUs, ");
+    print_int(processes);
+    print_string(" processes, idle ");
+    print_int(percent(idle, interval * cpus_online));
+    print_string("%\n");
+    
+    uint32_t total = total_schedules();
+    print_string("Type Sched%  Ready  Oldest ms  Avg wait us  p99us  Max us\n");
+    for (int t = 0; t < STATS_TYPES; t++) {
+        sched_type_stats_t* s = &sched_type_stats[t];
+        print_string(type_names[t]);
+        print_string("  ");
+        print_col(total ? s->schedules * 100 / total : 0, 8);
+        print_col(ready[t], 7);
+        print_col(cycles_to_ms(oldest[t]), 11);
+        print_col(s->schedules ? cycles_to_us(div64_u32(s->wait_cycles, s->schedules)) : 0, 13);
+        print_col(latency_percentile(s, 99), 7);
+        print_col(s->latency_max_us, 0);
+        print_string("\n");
+    }
+    
+    print_string("\n  PID Type State CPU%  Run ms   Wait ms  Disp     Name\n");
+    for (int i = 0; i < count; i++) {
+        top_row_t* row = &rows[i];
+        print_string("  ");
+        print_col(row->pid, 4);
+        print_string(row->type >= 0 && row->type < STATS_TYPES ? type_names[row->type] : "?  ");
+        print_string("  ");
+        print_string(row->state >= 0 && row->state <= PROCESS_TERMINATED ? state_names[row->state] : "?    ");
+        print_string(" ");
+        print_col(percent(row->busy, interval), 5);
+        print_col(cycles_to_ms(row->run_cycles), 9);
+        print_col(cycles_to_ms(row->wait_cycles), 9);
+        print_col(row->dispatches, 9);
+        print_string(row->name);
+        print_string("\n");
+    }
 }
 
 void reset_stats(void) {
-    for(int i = 0; i < 3; i++) {
-        schedule_count[i] = 0;
+    uint32_t flags = irq_save();
+    for(int i = 0; i < STATS_TYPES; i++) {
+        sched_type_stats_t* s = &sched_type_stats[i];
+        s->schedules = 0;
+        s->run_cycles = 0;
+        s->wait_cycles = 0;
+        s->latency_max_us = 0;
+        for (int b = 0; b < STATS_LAT_BUCKETS; b++) {
+            s->latency[b] = 0;
+        }
     }
-    total_schedules = 0;
-}
\ No newline at end of file
+    idle_cycles = 0;
+    top_idle_last = 0;
+    top_last = rdtsc();
+    for (int i = 1; i < process_capacity(); i++) {
+        pcb_t* pcb = process_get(i);
+        if (pcb != NULL) pcb->top_run_cycles = pcb->run_cycles;
+    }
+    irq_restore(flags);
+}
@@ -1,8 +1,32 @@
 #ifndef STATS_H
 #define STATS_H
 
+#include <stdint.h>
+#include "process.h"
+
+#define STATS_TYPES 3 // CPU, IO, ML
+
+// Ready-to-running latency, log2 buckets in microseconds: bucket 0 is
+// under 1 us, bucket k covers [2^(k-1), 2^k) us and the last one is open
+#define STATS_LAT_BUCKETS 24
+
+// Processes listed by top, busiest first
+#define TOP_ROWS 10
+
+typedef struct {
+    uint32_t schedules;
+    uint64_t run_cycles;
+    uint64_t wait_cycles;
+    uint32_t latency[STATS_LAT_BUCKETS];
+    uint32_t latency_max_us;
+} sched_type_stats_t;
+
+extern sched_type_stats_t sched_type_stats[STATS_TYPES];
+
 void update_schedule_stats(int process_type);
+uint64_t stats_switch(pcb_t* prev, pcb_t* next);
 void print_scheduling_stats(void);
+void stats_print_top(void);
 void reset_stats(void);
 
-#endif
\ No newline at end of file
+#endif
@@ -1,6 +1,210 @@
 #include "string.h"
+#include "cpu.h"
 
+// Byte loops below must not be turned back into calls to memcpy/memset
+#define NO_LOOP_CALLS __attribute__((optimize("no-tree-loop-distribute-patterns")))
+#define SSE2_CODE __attribute__((target("sse2")))
+
+// Below this size a straight word loop beats setting up rep or SSE
+#define STRING_SMALL_COPY 64
+// SSE2 only pays off once the 16-byte loop runs a few times
+#define STRING_SSE2_MIN 256
+
+#define ONES  0x01010101u
+#define HIGHS 0x80808080u
+#define HAS_ZERO_BYTE(v) (((v) - ONES) & ~(v) & HIGHS)
+
+static NO_LOOP_CALLS void memcpy_byte(void* dest, const void* src, size_t n) {
+    char* d = (char*)dest;
+    const char* s = (const char*)src;
+    for (size_t i = 0; i < n; i++) {
+        d[i] = s[i];
+    }
+}
+
+static NO_LOOP_CALLS void memset_byte(void* dest, int val, size_t n) {
+    char* d = (char*)dest;
+    for (size_t i = 0; i < n; i++) {
+        d[i] = (char)val;
+    }
+}
+
+// Align the destination, then move dwords and the tail with rep
+static void memcpy_rep(void* dest, const void* src, size_t n) {
+    size_t head = (-(uint32_t)dest) & 3;
+    if (head > n) head = n;
+    n -= head;
+    asm volatile ("rep movsb\n\t"
+                  "mov %k3, %%ecx\n\t"
+                  "shr $2, %%ecx\n\t"
+                  "rep movsl\n\t"
+                  "mov %k3, %%ecx\n\t"
+                  "and $3, %%ecx\n\t"
+                  "rep movsb"
+                  : "+D"(dest), "+S"(src), "+c"(head)
+                  : "r"(n)
+                  : "memory");
+}
+
+static void memset_rep(void* dest, int val, size_t n) {
+    uint32_t fill = (uint8_t)val * ONES;
+    size_t head = (-(uint32_t)dest) & 3;
+    if (head > n) head = n;
+    n -= head;
+    asm volatile ("rep stosb\n\t"
+                  "mov %k3, %%ecx\n\t"
+                  "shr $2, %%ecx\n\t"
+                  "rep stosl\n\t"
+                  "mov %k3, %%ecx\n\t"
+                  "and $3, %%ecx\n\t"
+                  "rep stosb"
+                  : "+D"(dest), "+c"(head)
+                  : "a"(fill), "r"(n)
+                  : "memory");
+}
+
+// XMM registers are not part of the saved process context, so the SSE2
+// loops run with this CPU's interrupts disabled and can never be
+// preempted midway. No other CPU sees its XMM registers, so they do not
+// need the kernel lock.
+static SSE2_CODE void memcpy_sse2(void* dest, const void* src, size_t n) {
+    if (n < STRING_SSE2_MIN) {
+        memcpy_rep(dest, src, n);
+        return;
+    }
+    
+    size_t head = (-(uint32_t)dest) & 15;
+    memcpy_rep(dest, src, head);
+    char* d = (char*)dest + head;
+    const char* s = (const char*)src + head;
+    n -= head;
+    
+    size_t blocks = n / 64;
+    uint32_t flags = local_irq_save();
+    while (blocks--) {
+        asm volatile ("movdqu   (%1), %%xmm0\n\t"
+                      "movdqu 16(%1), %%xmm1\n\t"
+                      "movdqu 32(%1), %%xmm2\n\t"
+                      "movdqu 48(%1), %%xmm3\n\t"
+                      "movdqa %%xmm0,   (%0)\n\t"
+                      "movdqa %%xmm1, 16(%0)\n\t"
+                      "movdqa %%xmm2, 32(%0)\n\t"
+                      "movdqa %%xmm3, 48(%0)"
+                      : : "r"(d), "r"(s)
+                      : "memory", "xmm0", "xmm1", "xmm2", "xmm3");
+        d += 64;
+        s += 64;
+    }
+    local_irq_restore(flags);
+    
+    memcpy_rep(d, s, n & 63);
+}
+
+static SSE2_CODE void memset_sse2(void* dest, int val, size_t n) {
+    if (n < STRING_SSE2_MIN) {
+        memset_rep(dest, val, n);
+        return;
+    }
+    
+    size_t head = (-(uint32_t)dest) & 15;
+    memset_rep(dest, val, head);
+    char* d = (char*)dest + head;
+    n -= head;
+    
+    uint32_t fill = (uint8_t)val * ONES;
+    size_t blocks = n / 64;
+    uint32_t flags = local_irq_save();
+    asm volatile ("movd %2, %%xmm0\n\t"
+                  "pshufd $0, %%xmm0, %%xmm0\n"
+                  "1:\n\t"
+                  "movdqa %%xmm0,   (%0)\n\t"
+                  "movdqa %%xmm0, 16(%0)\n\t"
+                  "movdqa %%xmm0, 32(%0)\n\t"
+                  "movdqa %%xmm0, 48(%0)\n\t"
+                  "add $64, %0\n\t"
+                  "dec %1\n\t"
+                  "jnz 1b"
+                  : "+r"(d), "+r"(blocks)
+                  : "r"(fill)
+                  : "memory", "xmm0");
+    local_irq_restore(flags);
+    
+    memset_rep(d, val, n & 63);
+}
+
+string_impl_t string_impls[STRING_IMPLS] = {
+    { "byte", memcpy_byte, memset_byte, 1 },
+    { "rep",  memcpy_rep,  memset_rep,  1 },
+    { "sse2", memcpy_sse2, memset_sse2, 0 },
+};
+
+static string_impl_t* active_impl = &string_impls[STRING_IMPL_REP];
+
+// Pick the widest implementation the CPU supports
+void string_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+    
+    if (edx & CPUID_EDX_SSE2) {
+#ifndef HOSTED
+        uint32_t cr0, cr4;
+        asm volatile ("mov %%cr0, %0" : "=r"(cr0));
+        asm volatile ("mov %%cr4, %0" : "=r"(cr4));
+        cr0 = (cr0 & ~CR0_EM) | CR0_MP;
+        cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+        asm volatile ("mov %0, %%cr0" : : "r"(cr0));
+        asm volatile ("mov %0, %%cr4" : : "r"(cr4));
+#endif
+        
+        string_impls[STRING_IMPL_SSE2].available = 1;
+        active_impl = &string_impls[STRING_IMPL_SSE2];
+    }
+}
+
+const char* string_impl_name(void) {
+    return active_impl->name;
+}
+
+NO_LOOP_CALLS void memcpy(void* dest, const void* src, size_t n) {
+    if (n < STRING_SMALL_COPY) {
+        uint32_t* d = (uint32_t*)dest;
+        const uint32_t* s = (const uint32_t*)src;
+        for (; n >= 4; n -= 4) {
+            *d++ = *s++;
+        }
+        memcpy_byte(d, s, n);
+        return;
+    }
+    active_impl->memcpy(dest, src, n);
+}
+
+NO_LOOP_CALLS void memset(void* dest, int val, size_t n) {
+    if (n < STRING_SMALL_COPY) {
+        memset_byte(dest, val, n);
+        return;
+    }
+    active_impl->memset(dest, val, n);
+}
+
+// Words are compared only while both strings share the same alignment.
+// Aligned loads never cross a page, so reading past the terminator is safe.
 int strcmp(const char* s1, const char* s2) {
+    if ((((uint32_t)s1 ^ (uint32_t)s2) & 3) == 0) {
+        while (((uint32_t)s1 & 3) != 0) {
+            if (*s1 != *s2 || *s1 == '\0') goto bytes;
+            s1++;
+            s2++;
+        }
+        const uint32_t* w1 = (const uint32_t*)s1;
+        const uint32_t* w2 = (const uint32_t*)s2;
+        while (*w1 == *w2 && !HAS_ZERO_BYTE(*w1)) {
+            w1++;
+            w2++;
+        }
+        s1 = (const char*)w1;
+        s2 = (const char*)w2;
+    }
+bytes:
     while(*s1 && (*s1 == *s2)) {
         s1++;
         s2++;
@@ -9,11 +213,20 @@ int strcmp(const char* s1, const char* s2) {
 }
 
 size_t strlen(const char* str) {
-    size_t len = 0;
-    while(str[len]) len++;
-    return len;
+    const char* p = str;
+    while (((uint32_t)p & 3) != 0) {
+        if (*p == '\0') return p - str;
+        p++;
+    }
+    const uint32_t* w = (const uint32_t*)p;
+    while (!HAS_ZERO_BYTE(*w)) {
+        w++;
+    }
+    p = (const char*)w;
+    while (*p) p++;
+    return p - str;
 }
 
 void strcpy(char* dest, const char* src) {
-    while((*dest++ = *src++));
-}
\ No newline at end of file
+    memcpy(dest, src, strlen(src) + 1);
+}
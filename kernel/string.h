@@ -3,8 +3,30 @@
 
 #include <stddef.h>
 
+// memcpy/memset back ends, chosen at boot by string_init() through CPUID
+typedef struct {
+    const char* name;
+    void (*memcpy)(void* dest, const void* src, size_t n);
+    void (*memset)(void* dest, int val, size_t n);
+    int available;
+} string_impl_t;
+
+enum {
+    STRING_IMPL_BYTE,
+    STRING_IMPL_REP,
+    STRING_IMPL_SSE2,
+    STRING_IMPLS
+};
+
+extern string_impl_t string_impls[STRING_IMPLS];
+
+void string_init(void);
+const char* string_impl_name(void);
+
+void memcpy(void* dest, const void* src, size_t n);
+void memset(void* dest, int val, size_t n);
 int strcmp(const char* s1, const char* s2);
 size_t strlen(const char* str);
 void strcpy(char* dest, const char* src);
 
-#endif
\ No newline at end of file
+#endif
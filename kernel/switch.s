@@ -0,0 +1,23 @@
+; kernel/switch.s - Kernel stack context switch
+section .text
+global context_switch
+
+; void context_switch(uint32_t* old_esp, uint32_t new_esp)
+; Saves the callee-saved registers on the current stack, stores the stack
+; pointer in *old_esp, then resumes the context saved at new_esp.
+context_switch:
+    mov eax, [esp + 4]         ; old_esp
+    mov edx, [esp + 8]         ; new_esp
+
+    push ebp
+    push ebx
+    push esi
+    push edi
+    mov [eax], esp
+
+    mov esp, edx
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
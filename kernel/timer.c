@@ -0,0 +1,114 @@
+// kernel/timer.c - 8253/8254 PIT tick source
+#include "timer.h"
+#include "idt.h"
+#include "kernel.h"
+#include "process.h"
+#include "cpu.h"
+#include "klog.h"
+#include "timer_wheel.h"
+
+#define PIT_CHANNEL0 0x40
+#define PIT_CHANNEL2 0x42
+#define PIT_COMMAND  0x43
+#define PIT_GATE     0x61
+
+#define CALIBRATE_MS 10
+
+volatile uint32_t timer_ticks = 0;
+
+static uint32_t timer_hz = 0;
+static uint32_t tsc_khz = 0;
+static uint64_t handler_cycles = 0;
+static uint32_t measured_ticks = 0;
+
+static void timer_handler(interrupt_frame_t* frame) {
+    (void)frame;
+    uint64_t start = rdtsc();
+    
+    timer_ticks++;
+    timer_wheel_run(timer_ticks);
+    process_tick();
+    
+    handler_cycles += rdtsc() - start;
+    measured_ticks++;
+}
+
+int timer_set_frequency(uint32_t hz) {
+    if (hz < TIMER_MIN_HZ || hz > TIMER_MAX_HZ) {
+        return -1;
+    }
+    
+    uint32_t divisor = PIT_BASE_FREQUENCY / hz;
+    uint32_t flags = irq_save();
+    outb(PIT_COMMAND, 0x36);   // channel 0, lobyte/hibyte, square wave
+    outb(PIT_CHANNEL0, divisor & 0xFF);
+    outb(PIT_CHANNEL0, (divisor >> 8) & 0xFF);
+    timer_hz = hz;
+    handler_cycles = 0;
+    measured_ticks = 0;
+    irq_restore(flags);
+    
+    return 0;
+}
+
+uint32_t timer_get_frequency(void) {
+    return timer_hz;
+}
+
+// Count TSC cycles while PIT channel 2 runs down a one-shot of
+// CALIBRATE_MS milliseconds. Channel 0 keeps driving the tick. Runs at
+// boot before the other CPUs are up, so masking this one is enough.
+static void timer_calibrate_tsc(void) {
+    uint32_t count = PIT_BASE_FREQUENCY / (1000 / CALIBRATE_MS);
+    uint32_t flags = local_irq_save();
+    
+    uint8_t gate = inb(PIT_GATE) & ~0x03;     // gate low, speaker off
+    outb(PIT_GATE, gate);
+    outb(PIT_COMMAND, 0xB0);                  // channel 2, lobyte/hibyte, mode 0
+    outb(PIT_CHANNEL2, count & 0xFF);
+    outb(PIT_CHANNEL2, (count >> 8) & 0xFF);
+    
+    outb(PIT_GATE, gate | 0x01);              // gate high starts the count
+    uint64_t start = rdtsc();
+    while (!(inb(PIT_GATE) & 0x20)) {         // OUT2 goes high at zero
+        asm volatile ("pause");
+    }
+    uint64_t cycles = rdtsc() - start;
+    outb(PIT_GATE, gate);
+    
+    tsc_khz = (uint32_t)div64_u32(cycles, CALIBRATE_MS);
+    local_irq_restore(flags);
+}
+
+uint32_t timer_tsc_khz(void) {
+    return tsc_khz;
+}
+
+void timer_init(void) {
+    timer_calibrate_tsc();
+    timer_set_frequency(TIMER_HZ);
+    irq_register_handler(IRQ_TIMER, timer_handler);
+    
+    klog(KLOG_INFO, KLOG_TIMER, "PIT running at %u Hz, TSC %u MHz", timer_hz, tsc_khz / 1000);
+}
+
+void timer_print_stats(void) {
+    uint32_t flags = irq_save();
+    uint32_t ticks = measured_ticks;
+    uint32_t cycles = ticks ? (uint32_t)div64_u32(handler_cycles, ticks) : 0;
+    irq_restore(flags);
+    
+    print_string("\n=== Timer ===\n");
+    print_string("Tick rate:      ");
+    print_int(timer_hz);
+    print_string(" Hz (");
+    print_int(1000000 / timer_hz);
+    print_string(" us/tick)\n");
+    print_string("Ticks:          ");
+    print_int(ticks);
+    print_string("\n");
+    print_string("Handler cost:   ");
+    print_int(cycles);
+    print_string(" cycles/tick\n");
+    print_string("=============\n");
+}
@@ -0,0 +1,23 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+// Default tick rate, override with make TIMER_HZ=<hz>
+#ifndef TIMER_HZ
+#define TIMER_HZ 100
+#endif
+
+#define PIT_BASE_FREQUENCY 1193182
+#define TIMER_MIN_HZ 19
+#define TIMER_MAX_HZ 10000
+
+extern volatile uint32_t timer_ticks;
+
+void timer_init(void);
+int timer_set_frequency(uint32_t hz);
+uint32_t timer_get_frequency(void);
+uint32_t timer_tsc_khz(void);
+void timer_print_stats(void);
+
+#endif
@@ -0,0 +1,131 @@
+// kernel/timer_wheel.c - Tick-driven timeouts for sleep_ticks() and friends
+#include "timer_wheel.h"
+#include "kernel.h"
+#include "cpu.h"
+#include <stddef.h>
+
+timer_wheel_stats_t timer_wheel_stats;
+
+static ktimer_t* root[WHEEL_ROOT_SIZE];
+static ktimer_t* levels[WHEEL_LEVELS][WHEEL_LEVEL_SIZE];
+static uint32_t wheel_now; // next tick to expire
+
+static void slot_insert(ktimer_t** slot, ktimer_t* timer) {
+    timer->next = *slot;
+    if (*slot) (*slot)->pprev = &timer->next;
+    *slot = timer;
+    timer->pprev = slot;
+}
+
+// File the timer by how far ahead of the wheel it expires
+static void wheel_insert(ktimer_t* timer) {
+    uint32_t delta = timer->expires - wheel_now;
+    
+    if ((int32_t)delta < 0) {
+        // Already due, expire on the next tick
+        slot_insert(&root[wheel_now & (WHEEL_ROOT_SIZE - 1)], timer);
+        return;
+    }
+    if (delta > WHEEL_MAX_DELAY) {
+        delta = WHEEL_MAX_DELAY;
+        timer->expires = wheel_now + delta;
+    }
+    if (delta < WHEEL_ROOT_SIZE) {
+        slot_insert(&root[timer->expires & (WHEEL_ROOT_SIZE - 1)], timer);
+        return;
+    }
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+        int shift = WHEEL_ROOT_BITS + level * WHEEL_LEVEL_BITS;
+        if (level == WHEEL_LEVELS - 1 || delta < (1u << (shift + WHEEL_LEVEL_BITS))) {
+            slot_insert(&levels[level][(timer->expires >> shift) & (WHEEL_LEVEL_SIZE - 1)], timer);
+            return;
+        }
+    }
+}
+
+void timer_wheel_add(ktimer_t* timer, uint32_t expires, void (*fn)(void* arg), void* arg) {
+    uint32_t flags = irq_save();
+    if (timer->pprev) {
+        timer_wheel_cancel(timer);
+    }
+    timer->expires = expires;
+    timer->fn = fn;
+    timer->arg = arg;
+    wheel_insert(timer);
+    timer_wheel_stats.added++;
+    irq_restore(flags);
+}
+
+// Returns 1 if the timer was pending
+int timer_wheel_cancel(ktimer_t* timer) {
+    uint32_t flags = irq_save();
+    int pending = timer->pprev != NULL;
+    if (pending) {
+        *timer->pprev = timer->next;
+        if (timer->next) timer->next->pprev = timer->pprev;
+        timer->pprev = NULL;
+        timer_wheel_stats.cancelled++;
+    }
+    irq_restore(flags);
+    return pending;
+}
+
+// Refile one upper-level slot; its timers land in lower levels
+static int cascade(int level) {
+    int shift = WHEEL_ROOT_BITS + level * WHEEL_LEVEL_BITS;
+    int index = (wheel_now >> shift) & (WHEEL_LEVEL_SIZE - 1);
+    ktimer_t* timer = levels[level][index];
+    
+    levels[level][index] = NULL;
+    while (timer) {
+        ktimer_t* next = timer->next;
+        wheel_insert(timer);
+        timer_wheel_stats.cascaded++;
+        timer = next;
+    }
+    return index;
+}
+
+// Expire everything due up to and including tick now. Called from the
+// timer interrupt.
+void timer_wheel_run(uint32_t now) {
+    while ((int32_t)(now - wheel_now) >= 0) {
+        uint32_t index = wheel_now & (WHEEL_ROOT_SIZE - 1);
+        if (index == 0) {
+            for (int level = 0; level < WHEEL_LEVELS && cascade(level) == 0; level++) {
+            }
+        }
+        
+        // Detach the slot so timers re-armed by a callback for a past
+        // tick go to the next one. Callbacks may still cancel the rest.
+        ktimer_t* expired = root[index];
+        root[index] = NULL;
+        if (expired) expired->pprev = &expired;
+        wheel_now++;
+        
+        ktimer_t* timer;
+        while ((timer = expired) != NULL) {
+            expired = timer->next;
+            if (expired) expired->pprev = &expired;
+            timer->pprev = NULL;
+            timer_wheel_stats.expired++;
+            timer->fn(timer->arg);
+        }
+    }
+}
+
+void timer_wheel_print_stats(void) {
+    timer_wheel_stats_t s = timer_wheel_stats;
+    
+    print_string("Timers: ");
+    print_int(s.added - s.expired - s.cancelled);
+    print_string(" pending, ");
+    print_int(s.added);
+    print_string(" added, ");
+    print_int(s.expired);
+    print_string(" expired, ");
+    print_int(s.cancelled);
+    print_string(" cancelled, ");
+    print_int(s.cascaded);
+    print_string(" cascaded\n");
+}
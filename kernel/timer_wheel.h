@@ -0,0 +1,42 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+
+// Hierarchical timing wheel driven by the PIT tick. The root has one slot
+// per tick for the next 256 ticks; each further level has 64 slots, each
+// 64 times coarser than the level below. Adding or cancelling a timer is
+// O(1). A timer in an upper level is moved down once, when the wheel
+// below wraps round to its slot.
+#define WHEEL_ROOT_BITS 8
+#define WHEEL_LEVEL_BITS 6
+#define WHEEL_LEVELS 3
+#define WHEEL_ROOT_SIZE (1 << WHEEL_ROOT_BITS)
+#define WHEEL_LEVEL_SIZE (1 << WHEEL_LEVEL_BITS)
+#define WHEEL_MAX_DELAY ((1u << (WHEEL_ROOT_BITS + WHEEL_LEVELS * WHEEL_LEVEL_BITS)) - 1)
+
+// Embedded in its owner. fn runs from the timer interrupt with
+// interrupts disabled and may re-arm the timer.
+typedef struct ktimer {
+    struct ktimer* next;
+    struct ktimer** pprev; // NULL when not pending
+    uint32_t expires;      // timer_ticks value
+    void (*fn)(void* arg);
+    void* arg;
+} ktimer_t;
+
+typedef struct {
+    uint32_t added;
+    uint32_t expired;
+    uint32_t cancelled;
+    uint32_t cascaded; // moves down a level
+} timer_wheel_stats_t;
+
+extern timer_wheel_stats_t timer_wheel_stats;
+
+void timer_wheel_add(ktimer_t* timer, uint32_t expires, void (*fn)(void* arg), void* arg);
+int timer_wheel_cancel(ktimer_t* timer);
+void timer_wheel_run(uint32_t now);
+void timer_wheel_print_stats(void);
+
+#endif
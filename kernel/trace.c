@@ -0,0 +1,64 @@
+// kernel/trace.c - Scheduler trace ring and its serial export
+#include "trace.h"
+#include "kernel.h"
+#include "serial.h"
+#include "timer.h"
+
+trace_record_t trace_ring[TRACE_RECORDS];
+uint32_t trace_head = 0;
+int trace_enabled = 1;
+
+void trace_set_enabled(int enabled) {
+    trace_enabled = enabled;
+}
+
+void trace_clear(void) {
+    uint32_t flags = irq_save();
+    trace_head = 0;
+    irq_restore(flags);
+}
+
+// Send the ring to COM1 as a header and the records, oldest first.
+// Decode the capture with tools/trace_decode.py.
+void trace_dump(void) {
+    // Keep console text out of the binary stream while it is sent
+    uint32_t flags = irq_save();
+    int was_enabled = trace_enabled;
+    int console_serial = console_sink_enabled(CONSOLE_SINK_SERIAL);
+    trace_enabled = 0;
+    console_enable_sink(CONSOLE_SINK_SERIAL, 0);
+    irq_restore(flags);
+    
+    uint32_t head = trace_head;
+    uint32_t count = head < TRACE_RECORDS ? head : TRACE_RECORDS;
+    
+    trace_header_t header;
+    header.magic = TRACE_MAGIC;
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(trace_record_t);
+    header.count = count;
+    header.dropped = head - count;
+    header.tsc_khz = timer_tsc_khz();
+    header.timer_hz = timer_get_frequency();
+    serial_write(&header, sizeof(header));
+    
+    for (uint32_t i = head - count; i != head; i++) {
+        serial_write(&trace_ring[i & (TRACE_RECORDS - 1)], sizeof(trace_record_t));
+    }
+    
+    trace_enabled = was_enabled;
+    console_enable_sink(CONSOLE_SINK_SERIAL, console_serial);
+    print_string("Trace: sent ");
+    print_int(count);
+    print_string(" records to COM1\n");
+}
+
+void trace_print_stats(void) {
+    uint32_t head = trace_head;
+    print_string("Trace: ");
+    print_string(trace_enabled ? "on, " : "off, ");
+    print_int(head < TRACE_RECORDS ? head : TRACE_RECORDS);
+    print_string(" records buffered, ");
+    print_int(head > TRACE_RECORDS ? head - TRACE_RECORDS : 0);
+    print_string(" overwritten\n");
+}
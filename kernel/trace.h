@@ -0,0 +1,72 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include "cpu.h"
+
+// Scheduler events in a fixed ring of binary records, newest overwriting
+// oldest. Recording is a TSC read and four stores.
+#define TRACE_RECORDS 8192 // power of two
+#define TRACE_MAGIC 0x4352544D // "MTRC"
+#define TRACE_VERSION 1
+
+typedef enum {
+    TRACE_CREATE = 1,  // arg: process type
+    TRACE_READY,
+    TRACE_SWITCH,      // pid: next process, arg: previous pid
+    TRACE_BLOCK,
+    TRACE_EXIT
+} trace_event_t;
+
+typedef enum {
+    TRACE_REASON_NONE,
+    TRACE_REASON_NEW,
+    TRACE_REASON_YIELD,
+    TRACE_REASON_PREEMPT,
+    TRACE_REASON_BLOCK,
+    TRACE_REASON_EXIT,
+    TRACE_REASON_WAKE
+} trace_reason_t;
+
+typedef struct {
+    uint64_t tsc;
+    uint32_t pid;
+    uint8_t event;
+    uint8_t reason;
+    uint16_t arg;
+} __attribute__((packed)) trace_record_t;
+
+// Dump header, followed by count records, oldest first
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t count;
+    uint32_t dropped;   // records overwritten before the dump
+    uint32_t tsc_khz;
+    uint32_t timer_hz;
+} __attribute__((packed)) trace_header_t;
+
+extern trace_record_t trace_ring[TRACE_RECORDS];
+extern uint32_t trace_head;
+extern int trace_enabled;
+
+// Callers already run with interrupts disabled
+static inline void trace_event(trace_event_t event, uint32_t pid,
+                               trace_reason_t reason, uint32_t arg) {
+    if (!trace_enabled) return;
+    
+    trace_record_t* rec = &trace_ring[trace_head++ & (TRACE_RECORDS - 1)];
+    rec->tsc = rdtsc();
+    rec->pid = pid;
+    rec->event = event;
+    rec->reason = reason;
+    rec->arg = arg;
+}
+
+void trace_set_enabled(int enabled);
+void trace_clear(void);
+void trace_dump(void);
+void trace_print_stats(void);
+
+#endif
@@ -0,0 +1,70 @@
+; kernel/trampoline.s - Real-mode entry point of the application processors
+;
+; smp_boot_aps() copies this blob to TRAMPOLINE_BASE and sends each AP a
+; startup IPI pointing at it. The AP starts in real mode at
+; TRAMPOLINE_BASE:0, so every address below is computed relative to that
+; copy rather than to where the linker put the original.
+TRAMPOLINE_BASE equ 0x8000             ; TRAMPOLINE_BASE in kernel/smp.h
+%define TADDR(label) (TRAMPOLINE_BASE + (label) - trampoline_start)
+
+section .rodata
+global trampoline_start
+global trampoline_end
+global trampoline_params
+
+bits 16
+trampoline_start:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+    lgdt [TADDR(tramp_gdt_ptr)]
+    mov eax, cr0
+    or eax, 1                          ; protected mode, paging still off
+    mov cr0, eax
+    jmp dword 0x08:TADDR(tramp_32)
+
+bits 32
+tramp_32:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    ; Same paging setup as the boot CPU: PSE and PGE before the directory,
+    ; then PG and WP. The kernel is identity mapped, so execution goes on.
+    mov eax, [TADDR(trampoline_params) + 4]
+    mov cr4, eax
+    mov eax, [TADDR(trampoline_params)]
+    mov cr3, eax
+    mov eax, [TADDR(trampoline_params) + 8]
+    mov cr0, eax
+
+    mov esp, [TADDR(trampoline_params) + 12]
+    push dword [TADDR(trampoline_params) + 20]
+    call dword [TADDR(trampoline_params) + 16] ; ap_main(cpu), never returns
+.halt:
+    cli
+    hlt
+    jmp .halt
+
+; Flat code and data segments until ap_main() loads the kernel's GDT
+tramp_gdt:
+    dq 0
+    dq 0x00CF9A000000FFFF
+    dq 0x00CF92000000FFFF
+tramp_gdt_ptr:
+    dw tramp_gdt_ptr - tramp_gdt - 1
+    dd TADDR(tramp_gdt)
+
+; Filled in by start_ap(), see trampoline_params_t in kernel/smp.c
+trampoline_params:
+    dd 0                               ; cr3
+    dd 0                               ; cr4
+    dd 0                               ; cr0
+    dd 0                               ; stack
+    dd 0                               ; entry
+    dd 0                               ; cpu
+trampoline_end:
@@ -0,0 +1,108 @@
+"""Check the kernel's headless benchmark results against stored limits.
+
+Usage: python3 tools/bench_check.py bench_output.txt tools/bench_thresholds.txt [--update]
+
+The benchmark kernel (make bench) prints "BENCH <metric> <value>" lines
+over serial between "BENCH begin" and "BENCH end". Every metric in the
+thresholds file must be present and at most its limit. Values are cycles
+per operation, or error counts with a limit of 0. Lower is better.
+
+With --update the thresholds file is rewritten from this run: each limit
+becomes the measured value plus HEADROOM, and error counts stay at 0.
+Record a baseline on the machine that runs the check; cycle counts under
+QEMU's TCG differ a lot from KVM or real hardware.
+"""
+import sys
+
+HEADROOM = 1.5
+
+
+def parse_results(path):
+    results = {}
+    finished = False
+    with open(path, "r", errors="replace") as f:
+        for line in f:
+            fields = line.strip().split()
+            if len(fields) < 2 or fields[0] != "BENCH":
+                continue
+            if fields[1] == "end":
+                finished = True
+            elif len(fields) == 3:
+                try:
+                    results[fields[1]] = int(fields[2])
+                except ValueError:
+                    pass
+    return results, finished
+
+
+def load_thresholds(path):
+    limits = {}
+    with open(path) as f:
+        for line in f:
+            line = line.split("#", 1)[0].strip()
+            if not line:
+                continue
+            metric, limit = line.split()
+            limits[metric] = int(limit)
+    return limits
+
+
+def write_thresholds(path, results):
+    lines = [
+        "# Upper limits for `make bench`, one \"metric limit\" per line.",
+        "# Cycles per operation unless the name ends in _errors.",
+        "# Regenerate with `make bench-baseline` after an intended change.",
+    ]
+    for metric in sorted(results):
+        value = results[metric]
+        limit = 0 if metric.endswith("_errors") else int(value * HEADROOM) + 1
+        lines.append(f"{metric} {limit}")
+    with open(path, "w") as f:
+        f.write("\n".join(lines) + "\n")
+
+
+def main():
+    args = [a for a in sys.argv[1:] if not a.startswith("--")]
+    if len(args) != 2:
+        sys.exit(__doc__)
+    log_path, thresholds_path = args
+
+    results, finished = parse_results(log_path)
+    if not finished:
+        print("FAIL: the benchmark run did not finish (no 'BENCH end')")
+        sys.exit(1)
+
+    if "--update" in sys.argv:
+        write_thresholds(thresholds_path, results)
+        print(f"Wrote {len(results)} thresholds to {thresholds_path}")
+        return
+
+    limits = load_thresholds(thresholds_path)
+    failed = 0
+    print(f"{'Metric':<24} {'Value':>12} {'Limit':>12}")
+    print("-" * 52)
+    for metric in sorted(limits):
+        limit = limits[metric]
+        value = results.get(metric)
+        if value is None:
+            status = "MISSING"
+            failed += 1
+        elif value > limit:
+            status = "REGRESSED"
+            failed += 1
+        else:
+            status = "ok"
+        shown = "-" if value is None else value
+        print(f"{metric:<24} {shown:>12} {limit:>12}  {status}")
+
+    for metric in sorted(set(results) - set(limits)):
+        print(f"{metric:<24} {results[metric]:>12} {'-':>12}  (no limit)")
+
+    if failed:
+        print(f"\nFAIL: {failed} metric(s) over their limit or missing")
+        sys.exit(1)
+    print("\nPASS")
+
+
+if __name__ == "__main__":
+    main()
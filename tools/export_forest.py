@@ -0,0 +1,161 @@
+"""Export the trained Random Forest as fixed-point C tables for the kernel.
+
+Usage: python3 tools/export_forest.py [Random_Forest.pkl] [kernel/ml_forest.h]
+
+Every tree is flattened in pre-order, so a node's left child is the next
+node and only the right child needs to be stored. Thresholds and leaf
+values are scaled by 2**ML_FIXED_SHIFT and rounded to integers, which lets
+the kernel walk the forest with integer compares only.
+
+When the model file is missing a single fallback tree is emitted that
+reproduces the kernel's original per-type bursts (CPU=8, IO=4, ML=6), so
+the kernel still builds on machines without the trained model.
+"""
+import math
+import os
+import sys
+
+# Must match MLRoundRobinScheduler.features in making_prediction.py
+FEATURES = ['priority', 'cpu_burst_est', 'io_burst_est', 'arrival_time',
+            'memory_req', 'total_cpu_used', 'waiting_time', 'turnaround_time']
+
+FIXED_SHIFT = 8
+FIXED_ONE = 1 << FIXED_SHIFT
+LEAF = -1
+INT32_MIN = -(1 << 31)
+INT32_MAX = (1 << 31) - 1
+MAX_TREE_NODES = 1 << 16
+
+
+def clamp32(value):
+    return max(INT32_MIN, min(INT32_MAX, value))
+
+
+def fixed_threshold(threshold):
+    # sklearn goes left when x <= threshold. For fixed-point x that is the
+    # same as x <= floor(threshold * 2**shift).
+    return clamp32(math.floor(threshold * FIXED_ONE))
+
+
+def fixed_value(value):
+    return clamp32(int(round(value * FIXED_ONE)))
+
+
+def flatten_tree(tree):
+    """Return [(feature, threshold, right_offset)] in pre-order."""
+    left = tree.children_left
+    right = tree.children_right
+    nodes = []
+
+    def visit(node):
+        index = len(nodes)
+        if left[node] == right[node]:
+            value = float(tree.value[node].ravel()[0])
+            nodes.append([LEAF, fixed_value(value), 0])
+            return
+        nodes.append([int(tree.feature[node]),
+                      fixed_threshold(float(tree.threshold[node])), 0])
+        visit(left[node])
+        nodes[index][2] = len(nodes) - index
+        visit(right[node])
+
+    visit(0)
+    if len(nodes) >= MAX_TREE_NODES:
+        sys.exit("export_forest: tree has %d nodes, retrain with a smaller "
+                 "max_depth (limit %d)" % (len(nodes), MAX_TREE_NODES))
+    return nodes
+
+
+def load_forest(path):
+    import joblib
+
+    model = joblib.load(path)
+    n_features = getattr(model, 'n_features_in_', len(FEATURES))
+    if n_features != len(FEATURES):
+        sys.exit("export_forest: model expects %d features, kernel provides %d"
+                 % (n_features, len(FEATURES)))
+    return [flatten_tree(est.tree_) for est in model.estimators_]
+
+
+def fallback_forest():
+    cpu_burst_est = FEATURES.index('cpu_burst_est')
+    return [[
+        [cpu_burst_est, fixed_threshold(5.0), 2],
+        [LEAF, fixed_value(4.0), 0],
+        [cpu_burst_est, fixed_threshold(7.0), 2],
+        [LEAF, fixed_value(6.0), 0],
+        [LEAF, fixed_value(8.0), 0],
+    ]]
+
+
+def write_header(trees, source, out):
+    roots = []
+    total = 0
+    for tree in trees:
+        roots.append(total)
+        total += len(tree)
+
+    lines = [
+        "// Generated by tools/export_forest.py from %s - do not edit" % source,
+        "#ifndef ML_FOREST_H",
+        "#define ML_FOREST_H",
+        "",
+        "#include <stdint.h>",
+        "",
+        "#define ML_FIXED_SHIFT %d" % FIXED_SHIFT,
+        "#define ML_FOREST_FEATURES %d" % len(FEATURES),
+        "#define ML_FOREST_TREES %d" % len(trees),
+        "#define ML_FOREST_NODES %d" % total,
+        "",
+    ]
+    for i, name in enumerate(FEATURES):
+        lines.append("#define ML_FEATURE_%s %d" % (name.upper(), i))
+    lines += [
+        "",
+        "// Leaves have feature < 0 and keep their value in threshold.",
+        "// The left child of node n is n + 1, the right child is n + right.",
+        "typedef struct {",
+        "    int32_t threshold;",
+        "    uint16_t right;",
+        "    int16_t feature;",
+        "} ml_tree_node_t;",
+        "",
+        "static const uint32_t ml_forest_roots[ML_FOREST_TREES] = {",
+    ]
+    for i in range(0, len(roots), 8):
+        lines.append("    " + ", ".join(str(r) for r in roots[i:i + 8]) + ",")
+    lines += [
+        "};",
+        "",
+        "static const ml_tree_node_t ml_forest_nodes[ML_FOREST_NODES] "
+        "__attribute__((aligned(64))) = {",
+    ]
+    for tree in trees:
+        for feature, threshold, right in tree:
+            lines.append("    { %d, %d, %d }," % (threshold, right, feature))
+    lines += ["};", "", "#endif", ""]
+
+    with open(out, 'w') as f:
+        f.write("\n".join(lines))
+
+
+def main():
+    model = sys.argv[1] if len(sys.argv) > 1 else "Random_Forest.pkl"
+    out = sys.argv[2] if len(sys.argv) > 2 else "kernel/ml_forest.h"
+
+    if os.path.exists(model):
+        trees = load_forest(model)
+        source = os.path.basename(model)
+    else:
+        print("export_forest: %s not found, using the per-type fallback tree"
+              % model)
+        trees = fallback_forest()
+        source = "the per-type fallback tree"
+
+    write_header(trees, source, out)
+    print("export_forest: wrote %d trees, %d nodes to %s"
+          % (len(trees), sum(len(t) for t in trees), out))
+
+
+if __name__ == "__main__":
+    main()
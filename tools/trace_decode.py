@@ -0,0 +1,210 @@
+"""Decode a scheduler trace dumped by the kernel's `trace dump` command.
+
+Usage: python3 tools/trace_decode.py [serial.log] [--events]
+
+`make run` captures COM1 in serial.log. The last dump found in the file is
+decoded, so other serial output before it is skipped. For every process
+the decoder reports the same metrics making_prediction.py computes in
+simulation, measured in milliseconds from the TSC:
+
+  waiting     time spent READY, queued but not running
+  turnaround  exit - create
+  response    first switch to the process - create
+
+Processes created before the oldest record that survived in the ring
+have no arrival and are left out of the averages, as are processes that
+had not exited when the trace was dumped.
+"""
+import struct
+import sys
+
+# Must match kernel/trace.h
+TRACE_MAGIC = 0x4352544D
+TRACE_VERSION = 1
+HEADER = struct.Struct("<IHHIIII")
+RECORD = struct.Struct("<QIBBH")
+
+EVENTS = {1: "create", 2: "ready", 3: "switch", 4: "block", 5: "exit"}
+REASONS = {0: "-", 1: "new", 2: "yield", 3: "preempt", 4: "block", 5: "exit", 6: "wake"}
+TYPES = {0: "CPU", 1: "IO", 2: "ML"}
+
+IDLE_PID = 0
+
+
+class ProcessTimes:
+    def __init__(self, pid):
+        self.pid = pid
+        self.type = None
+        self.arrival = None
+        self.first_run = None
+        self.completion = None
+        self.running = 0
+        self.waiting = 0
+        self.blocked = 0
+        self.ready_since = None
+        self.run_since = None
+        self.blocked_since = None
+        self.dispatches = 0
+        self.preemptions = 0
+
+
+def find_dump(data):
+    """Offset of the last complete trace dump in data, or None."""
+    magic = struct.pack("<I", TRACE_MAGIC)
+    pos = data.rfind(magic)
+    while pos >= 0:
+        if pos + HEADER.size <= len(data):
+            _, version, record_size, count, _, _, _ = HEADER.unpack_from(data, pos)
+            end = pos + HEADER.size + count * record_size
+            if version == TRACE_VERSION and record_size == RECORD.size and end <= len(data):
+                return pos
+        pos = data.rfind(magic, 0, pos)
+    return None
+
+
+def parse(data):
+    pos = find_dump(data)
+    if pos is None:
+        sys.exit("No complete trace dump found")
+
+    _, _, _, count, dropped, tsc_khz, timer_hz = HEADER.unpack_from(data, pos)
+    pos += HEADER.size
+    records = []
+    for _ in range(count):
+        records.append(RECORD.unpack_from(data, pos))
+        pos += RECORD.size
+    return records, dropped, tsc_khz, timer_hz
+
+
+def replay(records):
+    """Walk the events and accumulate per-process intervals."""
+    procs = {}
+    current = None
+    switches = 0
+
+    def get(pid):
+        if pid not in procs:
+            procs[pid] = ProcessTimes(pid)
+        return procs[pid]
+
+    for tsc, pid, event, reason, arg in records:
+        if pid == IDLE_PID and event != 3:
+            continue
+        name = EVENTS.get(event)
+
+        if name == "create":
+            p = get(pid)
+            p.type = arg
+            p.arrival = tsc
+        elif name == "ready":
+            p = get(pid)
+            if p.run_since is not None:
+                p.running += tsc - p.run_since
+                p.run_since = None
+            if p.blocked_since is not None:
+                p.blocked += tsc - p.blocked_since
+                p.blocked_since = None
+            if reason == 3:
+                p.preemptions += 1
+            p.ready_since = tsc
+        elif name == "block":
+            p = get(pid)
+            if p.run_since is not None:
+                p.running += tsc - p.run_since
+                p.run_since = None
+            p.blocked_since = tsc
+        elif name == "exit":
+            p = get(pid)
+            p.completion = tsc
+        elif name == "switch":
+            switches += 1
+            # The previous process stopped running here unless a ready or
+            # block event already closed its interval
+            if current is not None and current != IDLE_PID:
+                prev = get(current)
+                if prev.run_since is not None:
+                    prev.running += tsc - prev.run_since
+                    prev.run_since = None
+            current = pid
+            if pid == IDLE_PID:
+                continue
+            p = get(pid)
+            if p.ready_since is not None:
+                p.waiting += tsc - p.ready_since
+                p.ready_since = None
+            if p.first_run is None and p.arrival is not None:
+                p.first_run = tsc
+            p.run_since = tsc
+            p.dispatches += 1
+    return procs, switches
+
+
+def main():
+    args = [a for a in sys.argv[1:] if not a.startswith("--")]
+    path = args[0] if args else "serial.log"
+    with open(path, "rb") as f:
+        data = f.read()
+
+    records, dropped, tsc_khz, timer_hz = parse(data)
+    if not records:
+        sys.exit("Trace is empty")
+
+    def ms(cycles):
+        return cycles / tsc_khz if tsc_khz else float(cycles)
+
+    unit = "ms" if tsc_khz else "cycles"
+    start = records[0][0]
+
+    if "--events" in sys.argv:
+        for tsc, pid, event, reason, arg in records:
+            print(f"{ms(tsc - start):12.3f} {EVENTS.get(event, event):>7} "
+                  f"pid={pid:<6} reason={REASONS.get(reason, reason):<8} arg={arg}")
+
+    procs, switches = replay(records)
+    span = records[-1][0] - start
+
+    print(f"{len(records)} records over {ms(span):.3f} {unit}, {dropped} overwritten, "
+          f"TSC {tsc_khz} kHz, timer {timer_hz} Hz, {switches} switches")
+
+    headers = ["PID", "Type", "Arrival", "Run", "Waiting", "Blocked",
+               "Turnaround", "Response", "Dispatch", "Preempt"]
+    print(" | ".join(f"{h:^10}" for h in headers))
+    print("-" * 128)
+
+    def cell(value):
+        return f"{ms(value):^10.3f}" if value is not None else f"{'-':^10}"
+
+    done = []
+    for p in sorted(procs.values(), key=lambda x: x.pid):
+        turnaround = None
+        response = None
+        if p.arrival is not None and p.completion is not None:
+            turnaround = p.completion - p.arrival
+        if p.arrival is not None and p.first_run is not None:
+            response = p.first_run - p.arrival
+        row = [
+            f"{p.pid:^10}",
+            f"{TYPES.get(p.type, '?'):^10}",
+            cell(p.arrival - start if p.arrival is not None else None),
+            cell(p.running),
+            cell(p.waiting),
+            cell(p.blocked),
+            cell(turnaround),
+            cell(response),
+            f"{p.dispatches:^10}",
+            f"{p.preemptions:^10}",
+        ]
+        print(" | ".join(row))
+        if turnaround is not None and response is not None:
+            done.append((p.waiting, turnaround, response))
+
+    print(f"\nCompleted processes with a full history: {len(done)}")
+    if done:
+        n = len(done)
+        print(f"Average Waiting Time     {ms(sum(d[0] for d in done)) / n:.4f} {unit}")
+        print(f"Average Turnaround Time  {ms(sum(d[1] for d in done)) / n:.4f} {unit}")
+        print(f"Average Response Time    {ms(sum(d[2] for d in done)) / n:.4f} {unit}")
+
+
+if __name__ == "__main__":
+    main()